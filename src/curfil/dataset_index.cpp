@@ -0,0 +1,293 @@
+#include "dataset_index.h"
+
+#include <algorithm>
+#include <boost/format.hpp>
+#include <boost/random.hpp>
+#include <tbb/parallel_for.h>
+#include <unordered_set>
+
+#include "utils.h"
+
+namespace curfil {
+
+DatasetIndex::DatasetIndex(const std::vector<LabeledRGBDImage>& images, bool storeCoordinates) :
+        images(images), storeCoordinates(storeCoordinates), validPixels(images.size()),
+                validCounts(images.size()), labelCounts(images.size()) {
+
+    utils::Timer indexTimer;
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, images.size()),
+            [&](const tbb::blocked_range<size_t>& range) {
+                for (size_t imageNr = range.begin(); imageNr != range.end(); imageNr++) {
+                    const RGBDImage& image = images[imageNr].getRGBDImage();
+                    const LabelImage& labelImage = images[imageNr].getLabelImage();
+
+                    std::vector<std::vector<PixelCoordinate> >& pixels = validPixels[imageNr];
+                    std::vector<size_t>& valid = validCounts[imageNr];
+                    std::vector<size_t>& counts = labelCounts[imageNr];
+
+                    for (int y = 0; y < labelImage.getHeight(); y++) {
+                        for (int x = 0; x < labelImage.getWidth(); x++) {
+                            const LabelType label = labelImage.getLabel(x, y);
+                            if (label >= counts.size()) {
+                                counts.resize(label + 1, 0);
+                                valid.resize(label + 1, 0);
+                                if (storeCoordinates) {
+                                    pixels.resize(label + 1);
+                                }
+                            }
+                            counts[label]++;
+
+                            PixelInstance sample(&image, label, x, y);
+                            if (!sample.getDepth().isValid()) {
+                                continue;
+                            }
+
+                            valid[label]++;
+                            if (storeCoordinates) {
+                                PixelCoordinate coordinate;
+                                coordinate.x = static_cast<uint16_t>(x);
+                                coordinate.y = static_cast<uint16_t>(y);
+                                pixels[label].push_back(coordinate);
+                            }
+                        }
+                    }
+                }
+            });
+
+    size_t numValidPixels = 0;
+    for (size_t imageNr = 0; imageNr < images.size(); imageNr++) {
+        for (const size_t count : validCounts[imageNr]) {
+            numValidPixels += count;
+        }
+    }
+
+    CURFIL_INFO("indexed " << numValidPixels << " pixels with valid depth in " << images.size() << " images in "
+            << indexTimer.format(2));
+}
+
+size_t DatasetIndex::getNumClasses(const std::vector<size_t>& imageNrs) const {
+    size_t numClasses = 0;
+    for (const size_t imageNr : imageNrs) {
+        assert(imageNr < labelCounts.size());
+        numClasses = std::max(numClasses, labelCounts[imageNr].size());
+    }
+    return numClasses;
+}
+
+cuv::ndarray<WeightType, cuv::host_memory_space> DatasetIndex::getClassLabelPriorDistribution(
+        const std::vector<size_t>& imageNrs) const {
+
+    cuv::ndarray<WeightType, cuv::host_memory_space> priorDistribution(getNumClasses(imageNrs));
+    for (size_t label = 0; label < priorDistribution.size(); label++) {
+        priorDistribution[label] = 0;
+    }
+
+    for (const size_t imageNr : imageNrs) {
+        const std::vector<size_t>& counts = labelCounts[imageNr];
+        for (size_t label = 0; label < counts.size(); label++) {
+            priorDistribution[label] += counts[label];
+        }
+    }
+
+    return priorDistribution;
+}
+
+void DatasetIndex::findCoordinates(size_t imageNr, const std::vector<PixelNumber>& pixelNumbers,
+        size_t begin, size_t end, std::vector<PixelCoordinate>& coordinates) const {
+
+    const RGBDImage& image = images[imageNr].getRGBDImage();
+    const LabelImage& labelImage = images[imageNr].getLabelImage();
+    const size_t numClasses = validCounts[imageNr].size();
+
+    // per class: the requested pixel numbers in ascending order, with the position of the request
+    std::vector<std::vector<std::pair<size_t, size_t> > > requests(numClasses);
+    for (size_t i = begin; i < end; i++) {
+        assert(pixelNumbers[i].imageNr == imageNr);
+        assert(pixelNumbers[i].pixelNr < getNumValidPixels(imageNr, pixelNumbers[i].label));
+        requests[pixelNumbers[i].label].push_back(std::make_pair(pixelNumbers[i].pixelNr, i));
+    }
+    for (auto& classRequests : requests) {
+        std::sort(classRequests.begin(), classRequests.end());
+    }
+
+    std::vector<size_t> nextRequest(numClasses, 0);
+    std::vector<size_t> pixelNrs(numClasses, 0);
+    size_t remaining = end - begin;
+
+    for (int y = 0; y < labelImage.getHeight() && remaining > 0; y++) {
+        for (int x = 0; x < labelImage.getWidth(); x++) {
+            const LabelType label = labelImage.getLabel(x, y);
+            if (nextRequest[label] == requests[label].size()) {
+                continue;
+            }
+            if (!PixelInstance(&image, label, x, y).getDepth().isValid()) {
+                continue;
+            }
+            const size_t pixelNr = pixelNrs[label]++;
+            // pixels can be drawn more than once
+            while (nextRequest[label] < requests[label].size()
+                    && requests[label][nextRequest[label]].first == pixelNr) {
+                PixelCoordinate& coordinate = coordinates[requests[label][nextRequest[label]].second];
+                coordinate.x = static_cast<uint16_t>(x);
+                coordinate.y = static_cast<uint16_t>(y);
+                nextRequest[label]++;
+                remaining--;
+            }
+        }
+    }
+
+    assert(remaining == 0);
+}
+
+std::vector<PixelInstance> DatasetIndex::getPixels(const std::vector<PixelNumber>& pixelNumbers) const {
+
+    std::vector<PixelCoordinate> coordinates(pixelNumbers.size());
+
+    if (storeCoordinates) {
+        for (size_t i = 0; i < pixelNumbers.size(); i++) {
+            const PixelNumber& pixel = pixelNumbers[i];
+            assert(pixel.pixelNr < getNumValidPixels(pixel.imageNr, pixel.label));
+            coordinates[i] = validPixels[pixel.imageNr][pixel.label][pixel.pixelNr];
+        }
+    } else {
+        // the pixels are ordered by image. one scan per image
+        std::vector<std::pair<size_t, size_t> > ranges;
+        for (size_t begin = 0; begin < pixelNumbers.size();) {
+            size_t end = begin + 1;
+            while (end < pixelNumbers.size() && pixelNumbers[end].imageNr == pixelNumbers[begin].imageNr) {
+                end++;
+            }
+            ranges.push_back(std::make_pair(begin, end));
+            begin = end;
+        }
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, ranges.size(), 1),
+                [&](const tbb::blocked_range<size_t>& range) {
+                    for (size_t i = range.begin(); i != range.end(); i++) {
+                        const size_t begin = ranges[i].first;
+                        findCoordinates(pixelNumbers[begin].imageNr, pixelNumbers, begin, ranges[i].second,
+                                coordinates);
+                    }
+                });
+    }
+
+    std::vector<PixelInstance> pixels;
+    pixels.reserve(pixelNumbers.size());
+    for (size_t i = 0; i < pixelNumbers.size(); i++) {
+        const PixelNumber& pixel = pixelNumbers[i];
+        pixels.push_back(PixelInstance(&(images[pixel.imageNr].getRGBDImage()), pixel.label,
+                coordinates[i].x, coordinates[i].y));
+    }
+    return pixels;
+}
+
+std::vector<PixelInstance> DatasetIndex::samplePixelsOfClass(const std::vector<size_t>& imageNrs,
+        const LabelType label, const size_t samples, const int seed) const {
+
+    // pixels of image i have the numbers offsets[i] to offsets[i + 1] - 1
+    std::vector<size_t> offsets(imageNrs.size() + 1, 0);
+    for (size_t i = 0; i < imageNrs.size(); i++) {
+        offsets[i + 1] = offsets[i] + getNumValidPixels(imageNrs[i], label);
+    }
+    const size_t numPixels = offsets.back();
+
+    std::vector<size_t> pixelNrs;
+    if (numPixels <= samples) {
+        pixelNrs.resize(numPixels);
+        for (size_t pixelNr = 0; pixelNr < numPixels; pixelNr++) {
+            pixelNrs[pixelNr] = pixelNr;
+        }
+    } else {
+        // Floyd's algorithm: draws distinct numbers with one random number per sample
+        boost::mt19937 rng(seed);
+        std::unordered_set<size_t> selected(2 * samples);
+        for (size_t j = numPixels - samples; j < numPixels; j++) {
+            boost::uniform_int<size_t> distribution(0, j);
+            if (!selected.insert(distribution(rng)).second) {
+                selected.insert(j);
+            }
+        }
+        pixelNrs.assign(selected.begin(), selected.end());
+        std::sort(pixelNrs.begin(), pixelNrs.end());
+    }
+
+    std::vector<PixelNumber> pixelNumbers;
+    pixelNumbers.reserve(pixelNrs.size());
+
+    size_t i = 0;
+    for (const size_t pixelNr : pixelNrs) {
+        while (pixelNr >= offsets[i + 1]) {
+            i++;
+        }
+        PixelNumber pixel;
+        pixel.imageNr = imageNrs[i];
+        pixel.label = label;
+        pixel.pixelNr = pixelNr - offsets[i];
+        pixelNumbers.push_back(pixel);
+    }
+
+    return getPixels(pixelNumbers);
+}
+
+std::vector<PixelInstance> DatasetIndex::samplePixels(const std::vector<size_t>& imageNrs,
+        const std::vector<bool>& ignoredLabels, const size_t samples, const int seed) const {
+
+    std::vector<size_t> offsets(imageNrs.size() + 1, 0);
+    for (size_t i = 0; i < imageNrs.size(); i++) {
+        size_t numPixels = 0;
+        for (size_t label = 0; label < validCounts[imageNrs[i]].size(); label++) {
+            if (label < ignoredLabels.size() && ignoredLabels[label]) {
+                continue;
+            }
+            numPixels += getNumValidPixels(imageNrs[i], label);
+        }
+        offsets[i + 1] = offsets[i] + numPixels;
+    }
+    const size_t numPixels = offsets.back();
+
+    if (numPixels == 0) {
+        throw std::runtime_error("no pixels to sample");
+    }
+
+    boost::mt19937 rng(seed);
+    boost::uniform_int<size_t> distribution(0, numPixels - 1);
+
+    std::vector<size_t> pixelNrs(samples);
+    for (size_t sample = 0; sample < samples; sample++) {
+        pixelNrs[sample] = distribution(rng);
+    }
+    std::sort(pixelNrs.begin(), pixelNrs.end());
+
+    std::vector<PixelNumber> pixelNumbers;
+    pixelNumbers.reserve(samples);
+
+    size_t i = 0;
+    for (const size_t pixelNr : pixelNrs) {
+        while (pixelNr >= offsets[i + 1]) {
+            i++;
+        }
+        const size_t imageNr = imageNrs[i];
+        size_t offset = pixelNr - offsets[i];
+        for (size_t label = 0; label < validCounts[imageNr].size(); label++) {
+            if (label < ignoredLabels.size() && ignoredLabels[label]) {
+                continue;
+            }
+            const size_t numLabelPixels = getNumValidPixels(imageNr, label);
+            if (offset < numLabelPixels) {
+                PixelNumber pixel;
+                pixel.imageNr = imageNr;
+                pixel.label = static_cast<LabelType>(label);
+                pixel.pixelNr = offset;
+                pixelNumbers.push_back(pixel);
+                break;
+            }
+            offset -= numLabelPixels;
+        }
+    }
+
+    assert(pixelNumbers.size() == samples);
+
+    return getPixels(pixelNumbers);
+}
+
+}
@@ -0,0 +1,114 @@
+#ifndef CURFIL_DATASET_INDEX_H
+#define CURFIL_DATASET_INDEX_H
+
+#include <cuv/ndarray.hpp>
+#include <stdint.h>
+#include <vector>
+
+#include "image.h"
+#include "random_tree_image.h"
+
+namespace curfil {
+
+/**
+ * Index of the labeled pixels of a training dataset.
+ *
+ * The index is built once per training run (in parallel) and is shared by all trees.
+ * It stores the number of pixels per image and class (including pixels with invalid depth),
+ * the number of pixels with valid depth per image and class and optionally their coordinates.
+ * Subsampling then draws random pixels from the index instead of scanning all images.
+ *
+ * The coordinates take four bytes per valid pixel. Without them, the index only keeps the counts and the
+ * coordinates of the drawn pixels are found by scanning the images that contain drawn pixels once per draw.
+ * The drawn pixels are the same in both cases.
+ */
+class DatasetIndex {
+public:
+
+    /**
+     * @param storeCoordinates whether to keep the coordinates of all valid pixels in memory.
+     *        should be false for datasets that do not fit into memory (memory-mapped images)
+     */
+    explicit DatasetIndex(const std::vector<LabeledRGBDImage>& images, bool storeCoordinates = true);
+
+    size_t getNumImages() const {
+        return images.size();
+    }
+
+    const LabeledRGBDImage& getImage(size_t imageNr) const {
+        assert(imageNr < images.size());
+        return images[imageNr];
+    }
+
+    /**
+     * @return the largest label in the given images plus one
+     */
+    size_t getNumClasses(const std::vector<size_t>& imageNrs) const;
+
+    /**
+     * @return the number of pixels per class in the given images
+     */
+    cuv::ndarray<WeightType, cuv::host_memory_space> getClassLabelPriorDistribution(
+            const std::vector<size_t>& imageNrs) const;
+
+    /**
+     * @return the number of pixels with valid depth of the class in the image
+     */
+    size_t getNumValidPixels(size_t imageNr, LabelType label) const {
+        assert(imageNr < validCounts.size());
+        if (label >= validCounts[imageNr].size()) {
+            return 0;
+        }
+        return validCounts[imageNr][label];
+    }
+
+    bool isStoreCoordinates() const {
+        return storeCoordinates;
+    }
+
+    /**
+     * Draws up to 'samples' distinct pixels of the class with valid depth uniformly from the given images.
+     * All pixels of the class are returned if there are not more than 'samples'.
+     */
+    std::vector<PixelInstance> samplePixelsOfClass(const std::vector<size_t>& imageNrs, LabelType label,
+            size_t samples, int seed) const;
+
+    /**
+     * Draws 'samples' pixels with valid depth uniformly (with replacement) from the given images.
+     * Pixels of ignored labels are not sampled.
+     */
+    std::vector<PixelInstance> samplePixels(const std::vector<size_t>& imageNrs,
+            const std::vector<bool>& ignoredLabels, size_t samples, int seed) const;
+
+private:
+
+    struct PixelCoordinate {
+        uint16_t x;
+        uint16_t y;
+    };
+
+    // the valid pixel number 'pixelNr' of a class in an image. valid pixels of a class are numbered in row-major order
+    struct PixelNumber {
+        size_t imageNr;
+        LabelType label;
+        size_t pixelNr;
+    };
+
+    std::vector<PixelInstance> getPixels(const std::vector<PixelNumber>& pixelNumbers) const;
+
+    // finds the coordinates of the given pixels of one image by scanning the image
+    void findCoordinates(size_t imageNr, const std::vector<PixelNumber>& pixelNumbers, size_t begin, size_t end,
+            std::vector<PixelCoordinate>& coordinates) const;
+
+    std::vector<LabeledRGBDImage> images;
+    bool storeCoordinates;
+
+    // per image and class. the coordinates are empty if they are not stored
+    std::vector<std::vector<std::vector<PixelCoordinate> > > validPixels;
+    std::vector<std::vector<size_t> > validCounts;
+    std::vector<std::vector<size_t> > labelCounts;
+};
+
+}
+
+#endif
@@ -15,6 +15,7 @@
 #include <unistd.h>
 #include <vector>
 
+#include "predict.h"
 #include "version.h"
 
 namespace curfil {
@@ -183,6 +184,13 @@ void RandomTreeExport::writeTree(boost::property_tree::ptree& pt, const RandomTr
     pt.put("useCIELab", configuration.isUseCIELab());
     pt.put("useDepthFilling", configuration.isUseDepthFilling());
     pt.put_child("ignoredColors", toPropertyTree(configuration.getIgnoredColors()));
+    pt.put("useFloatResponses", configuration.isUseFloatResponses());
+    pt.put("useFlipAugmentation", configuration.isUseFlipAugmentation());
+    pt.put("scaleJitter", configuration.getScaleJitter());
+    pt.put("pyramidLevel", configuration.getPyramidLevel());
+    pt.put("depthFeatureCost", configuration.getDepthFeatureCost());
+    pt.put("colorFeatureCost", configuration.getColorFeatureCost());
+    pt.put("nanResponseCost", configuration.getNaNResponseCost());
 
     const cuv::ndarray<WeightType, cuv::host_memory_space>& priorDistribution = tree.getClassLabelPriorDistribution();
     for (LabelType label = 0; label < priorDistribution.size(); label++) {
@@ -200,7 +208,13 @@ void RandomTreeExport::writeTree(boost::property_tree::ptree& pt,
 
     pt.put("id", tree.getNodeId());
     pt.put("level", tree.getLevel());
-    pt.put("samples", tree.getNumTrainSamples());
+    // the histogram sum equals the number of train samples. we do not use getNumTrainSamples()
+    // since the train samples are not available if the tree was imported from JSON (e.g. for pruning)
+    size_t numSamples = 0;
+    for (size_t i = 0; i < tree.getHistogram().size(); i++) {
+        numSamples += tree.getHistogram()[i];
+    }
+    pt.put("samples", numSamples);
     pt.put("leaf", tree.isLeaf());
 
     if (verbose) {
@@ -278,4 +292,32 @@ void RandomTreeExport::writeJSON(const RandomTreeImage& tree, size_t treeNr) con
     double filesize = (boost::filesystem::file_size(filename)) / static_cast<double>(1024 * 1024);
     CURFIL_INFO("wrote " << filename << (boost::format(" (%.2f MB)") % filesize).str());
 }
+
+void RandomTreeExport::writeOutOfBagJSON(const ConfusionMatrix& confusionMatrix) const {
+
+    boost::property_tree::ptree pt;
+    pt.put("date", date);
+    pt.put("folderTraining", trainingFolder);
+    pt.put("pixelAccuracy", confusionMatrix.pixelAccuracy(true));
+    pt.put("pixelAccuracyWithoutVoid", confusionMatrix.pixelAccuracy(false));
+    pt.put("classAccuracy", confusionMatrix.averageClassAccuracy(true));
+    pt.put("classAccuracyWithoutVoid", confusionMatrix.averageClassAccuracy(false));
+
+    // absolute counts. y: labels, x: predictions
+    boost::property_tree::ptree matrix;
+    for (unsigned int label = 0; label < confusionMatrix.getNumClasses(); label++) {
+        std::vector<double> row(confusionMatrix.getNumClasses());
+        for (unsigned int prediction = 0; prediction < row.size(); prediction++) {
+            row[prediction] = confusionMatrix(label, prediction);
+        }
+        matrix.push_back(std::make_pair("", toPropertyTree(row)));
+    }
+    pt.add_child("confusionMatrix", matrix);
+
+    assert(!outputFolder.empty());
+    const std::string filename = outputFolder + "/outOfBag.json";
+    boost::property_tree::write_json(filename, pt);
+
+    CURFIL_INFO("wrote " << filename);
+}
 }
@@ -45,6 +45,11 @@ public:
 
     void writeJSON(const RandomTreeImage& tree, size_t treeNr) const;
 
+    /**
+     * Writes the out-of-bag accuracies and the confusion matrix of the training to 'outOfBag.json'
+     */
+    void writeOutOfBagJSON(const ConfusionMatrix& confusionMatrix) const;
+
     template<class TreeEnsemble>
     void writeJSON(const TreeEnsemble& ensemble) const {
 
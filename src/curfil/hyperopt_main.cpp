@@ -28,6 +28,7 @@ int main(int argc, char **argv) {
     int deviceId = 0;
     bool profiling = false;
     std::string lossFunction;
+    std::string cacheFolder = "";
 
     // Declare the supported options.
     po::options_description options("options");
@@ -52,6 +53,8 @@ int main(int argc, char **argv) {
     ("profile", po::value<bool>(&profiling)->implicit_value(true)->default_value(profiling), "profiling")
     ("ignoreColor", po::value<std::vector<std::string> >(&ignoredColors),
             "do not sample pixels of this color. Format: R,G,B in the range 0-255.")
+    ("cacheFolder", po::value<std::string>(&cacheFolder)->default_value(cacheFolder),
+            "folder of the binary cache of preprocessed images. leave it empty to disable the cache")
 
     ("lossFunction", po::value<std::string>(&lossFunction)->required(),
             "measure the loss function should be based on. one of 'classAccuracy', 'classAccuracyWithoutVoid', 'pixelAccuracy', 'pixelAccuracyWithoutVoid'")
@@ -87,8 +90,8 @@ int main(int argc, char **argv) {
 
     tbb::task_scheduler_init init(numThreads);
 
-    const auto trainImages = loadImages(trainingFolder, useCIELab, useDepthFilling);
-    const auto testImages = loadImages(testingFolder, useCIELab, useDepthFilling);
+    const auto trainImages = loadImages(trainingFolder, useCIELab, useDepthFilling, 0, 0, cacheFolder);
+    const auto testImages = loadImages(testingFolder, useCIELab, useDepthFilling, 0, 0, cacheFolder);
 
     // currently training on only on GPU is tested
     std::vector<int> deviceIds(1, deviceId);
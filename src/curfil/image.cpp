@@ -1,14 +1,20 @@
 #include "image.h"
 
+#include <atomic>
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
 #include <cmath>
+#include <cstring>
+#include <fstream>
 #include <iomanip>
+#include <limits>
 #include <map>
 #include <string>
 #include <tbb/mutex.h>
 #include <tbb/parallel_for.h>
+#include <tbb/parallel_invoke.h>
 #include <vigra/colorconversions.hxx>
 #include <vigra/imageinfo.hxx>
 #include <vigra/impex.hxx>
@@ -77,57 +83,148 @@ static vigra::DVector3Image convertCIELab2RGB(const vigra::DVector3Image& srcIma
     return dstImage;
 }
 
-template<class T>
-static void loadImage(const std::string& filename, T& image) {
-    vigra::ImageImportInfo info(filename.c_str());
+/**
+ * 8-bit color value to linear RGB in [0, 1].
+ * As in vigra::RGB2LabFunctor, the color values are interpreted as linear (not gamma-corrected) RGB.
+ */
+static const std::vector<float>& linearRGBTable() {
+    static const std::vector<float> table = [] {
+        std::vector<float> t(std::numeric_limits<uint8_t>::max() + 1);
+        for (size_t v = 0; v < t.size(); v++) {
+            t[v] = v / static_cast<float>(std::numeric_limits<uint8_t>::max());
+        }
+        return t;
+    }();
+    return table;
+}
 
-    if (info.isGrayscale() || !info.isColor() || info.numBands() != 3) {
-        throw std::runtime_error("loading of non-RGB images is not yet supported");
+/**
+ * Cube root of x >= 0 from an exponent bit trick (relative error < 6%), refined by two Halley iterations.
+ * The relative error is below 5e-7 for x in [1e-6, 1].
+ * The function is free of branches and library calls, such that the loops that call it are vectorized.
+ */
+static inline float fastCubeRoot(float x) {
+    // avoids a division by zero for x = 0. the offset is rounded away for x > 1e-5
+    x += 1e-12f;
+    int32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    bits = bits / 3 + 709921077;
+    float y;
+    std::memcpy(&y, &bits, sizeof(y));
+    for (int i = 0; i < 2; i++) {
+        const float y3 = y * y * y;
+        y = y * (y3 + 2.0f * x) / (2.0f * y3 + x);
     }
+    return y;
+}
+
+/**
+ * Converts one row of linear RGB values to CIELab as vigra::RGB2LabFunctor does.
+ * The loop contains no branches such that it is vectorized by the compiler.
+ */
+static void convertRGB2CIELabRow(const float* __restrict__ red, const float* __restrict__ green,
+        const float* __restrict__ blue, float* __restrict__ l, float* __restrict__ a, float* __restrict__ b,
+        const int width) {
+
+    // the coefficients of vigra::RGB2XYZFunctor, divided by the reference white of vigra::XYZ2LabFunctor
+    const float XR = 0.412453f / 0.950456f, XG = 0.357580f / 0.950456f, XB = 0.180423f / 0.950456f;
+    const float YR = 0.212671f, YG = 0.715160f, YB = 0.072169f;
+    const float ZR = 0.019334f / 1.088754f, ZG = 0.119193f / 1.088754f, ZB = 0.950227f / 1.088754f;
+
+    const float EPSILON = 216.0f / 24389.0f;
+    const float KAPPA = 24389.0f / 27.0f;
+
+    for (int x = 0; x < width; x++) {
+        const float X = XR * red[x] + XG * green[x] + XB * blue[x];
+        const float Y = YR * red[x] + YG * green[x] + YB * blue[x];
+        const float Z = ZR * red[x] + ZG * green[x] + ZB * blue[x];
+        const float xGamma = fastCubeRoot(X);
+        const float yGamma = fastCubeRoot(Y);
+        const float zGamma = fastCubeRoot(Z);
+        // a blend instead of a conditional expression, which would prevent the vectorization
+        const float linear = (Y < EPSILON) ? 1.0f : 0.0f;
+        l[x] = linear * (KAPPA * Y) + (1.0f - linear) * (116.0f * yGamma - 16.0f);
+        a[x] = 500.0f * (xGamma - yGamma);
+        b[x] = 200.0f * (yGamma - zGamma);
+    }
+}
 
-    vigra::Size2D size = info.size();
-    image = T(size.width(), size.height());
+void convertRGB2CIELab(const uint8_t* rgb, int width, int height, float* lab) {
 
-    vigra::importImage(info, vigra::destImage(image));
+    const std::vector<float>& linear = linearRGBTable();
+    const size_t planeSize = static_cast<size_t>(width) * height;
+
+    tbb::parallel_for(tbb::blocked_range<int>(0, height),
+            [&](const tbb::blocked_range<int>& range) {
+                std::vector<float> red(width), green(width), blue(width);
+                for (int y = range.begin(); y != range.end(); y++) {
+                    const uint8_t* row = rgb + 3 * static_cast<size_t>(y) * width;
+                    for (int x = 0; x < width; x++) {
+                        red[x] = linear[row[3 * x]];
+                        green[x] = linear[row[3 * x + 1]];
+                        blue[x] = linear[row[3 * x + 2]];
+                    }
+
+                    float* l = lab + static_cast<size_t>(y) * width;
+                    convertRGB2CIELabRow(red.data(), green.data(), blue.data(), l, l + planeSize,
+                            l + 2 * planeSize, width);
+                }
+            });
 }
 
 RGBDImage::RGBDImage(const std::string& filename, const std::string& depthFilename, bool convertToCIELab,
-        bool useDepthFilling, bool calculateIntegralImage) :
+        bool useDepthFilling, bool calculateIntegralImage, bool loadColor) :
         filename(filename), depthFilename(depthFilename),
                 colorImage(boost::make_shared<cuv::cuda_allocator>()),
                 depthImage(boost::make_shared<cuv::cuda_allocator>()),
-                inCIELab(false), integratedColor(false), integratedDepth(false) {
+                inCIELab(false), integratedColor(false), integratedDepth(false),
+                interleavedColor(false), integralStorage(FLOAT_INTEGRALS), padding(0), columnSentinels(), rowSentinels() {
 
+    DecodedImage color;
+    DecodedImage depth;
     {
-        utils::Profile profile("loadImage");
-
-        vigra::DVector3Image image;
-        try {
-            loadImage(filename, image);
-        } catch (const std::exception& e) {
-            throw std::runtime_error(std::string("failed to load image '") + filename + "': " + e.what());
+        utils::Profile profile("decodeImage");
+        if (loadColor) {
+            color = decodeImage(filename);
         }
+        depth = decodeImage(depthFilename);
+    }
 
-        if (convertToCIELab) {
-            image = convertRGB2CIELab(image);
-        }
+    load(loadColor ? &color : 0, depth, convertToCIELab, useDepthFilling, calculateIntegralImage);
+}
 
-        width = image.width();
-        height = image.height();
-        assert(width >= 0 && height >= 0);
-        colorImage.resize(cuv::extents[COLOR_CHANNELS][getHeight()][getWidth()]);
-        for (int y = 0; y < getHeight(); ++y) {
-            for (int x = 0; x < getWidth(); ++x) {
-                for (unsigned int c = 0; c < COLOR_CHANNELS; ++c) {
-                    setColor(x, y, c, image(x, y)[c]);
-                }
+RGBDImage::RGBDImage(const std::string& filename, const std::string& depthFilename, const DecodedImage* color,
+        const DecodedImage& depth, bool convertToCIELab, bool useDepthFilling, bool calculateIntegralImage) :
+        filename(filename), depthFilename(depthFilename),
+                colorImage(boost::make_shared<cuv::cuda_allocator>()),
+                depthImage(boost::make_shared<cuv::cuda_allocator>()),
+                inCIELab(false), integratedColor(false), integratedDepth(false),
+                interleavedColor(false), integralStorage(FLOAT_INTEGRALS), padding(0), columnSentinels(), rowSentinels() {
+    load(color, depth, convertToCIELab, useDepthFilling, calculateIntegralImage);
+}
+
+void RGBDImage::load(const DecodedImage* color, const DecodedImage& depth, bool convertToCIELab,
+        bool useDepthFilling, bool calculateIntegralImage) {
+
+    {
+        utils::Profile profile("loadImage");
+
+        if (color) {
+            try {
+                loadColorImage(*color, convertToCIELab);
+            } catch (const std::exception& e) {
+                throw std::runtime_error(std::string("failed to load image '") + filename + "': " + e.what());
             }
-        }
 
-        inCIELab = true;
+            inCIELab = true;
+        } else {
+            // the size is taken from the depth image
+            width = depth.getWidth();
+            height = depth.getHeight();
+        }
 
         try {
-            loadDepthImage(depthFilename);
+            loadDepthImage(depth);
         } catch (const std::exception& e) {
             throw std::runtime_error(std::string("failed to load depth image '") + depthFilename + "': " + e.what());
         }
@@ -143,12 +240,61 @@ RGBDImage::RGBDImage(const std::string& filename, const std::string& depthFilena
     }
 }
 
+RGBDImage::RGBDImage(const std::string& filename, const std::string& depthFilename, int width, int height,
+        bool inCIELab, const float* colorIntegral, const int* depthIntegral) :
+        filename(filename), depthFilename(depthFilename),
+                width(width), height(height),
+                colorImage(cuv::extents[COLOR_CHANNELS][height][width], boost::make_shared<cuv::cuda_allocator>()),
+                depthImage(cuv::extents[DEPTH_CHANNELS][height][width], boost::make_shared<cuv::cuda_allocator>()),
+                inCIELab(inCIELab), integratedColor(true), integratedDepth(true),
+                interleavedColor(false), integralStorage(FLOAT_INTEGRALS), padding(0), columnSentinels(), rowSentinels() {
+    assert(width >= 0 && height >= 0);
+    std::copy(colorIntegral, colorIntegral + colorImage.size(), colorImage.ptr());
+    std::copy(depthIntegral, depthIntegral + depthImage.size(), depthImage.ptr());
+}
+
+RGBDImage::RGBDImage(const std::string& filename, const std::string& depthFilename, int width, int height,
+        bool inCIELab, float* colorIntegral, int* depthIntegral, const boost::shared_ptr<void>& mappedFile) :
+        filename(filename), depthFilename(depthFilename),
+                width(width), height(height),
+                colorImage(cuv::extents[COLOR_CHANNELS][height][width], colorIntegral),
+                depthImage(cuv::extents[DEPTH_CHANNELS][height][width], depthIntegral),
+                inCIELab(inCIELab), integratedColor(true), integratedDepth(true),
+                interleavedColor(false), integralStorage(FLOAT_INTEGRALS), padding(0), columnSentinels(), rowSentinels(), mappedFile(mappedFile) {
+    assert(width >= 0 && height >= 0);
+    assert(mappedFile);
+}
+
 RGBDImage::RGBDImage(const RGBDImage& other) :
         filename(other.filename), depthFilename(other.depthFilename),
                 width(other.width), height(other.height),
                 colorImage(other.colorImage.copy()),
                 depthImage(other.depthImage.copy()),
-                inCIELab(other.inCIELab), integratedColor(other.integratedColor), integratedDepth(other.integratedDepth) {
+                integrals16(other.integrals16), integrals32(other.integrals32), integrals64(other.integrals64),
+                inCIELab(other.inCIELab), integratedColor(other.integratedColor), integratedDepth(other.integratedDepth),
+                interleavedColor(other.interleavedColor), integralStorage(other.integralStorage),
+                padding(other.padding), columnSentinels(other.columnSentinels), rowSentinels(other.rowSentinels) {
+}
+
+void RGBDImage::swap(RGBDImage& other) {
+    std::swap(filename, other.filename);
+    std::swap(depthFilename, other.depthFilename);
+    std::swap(width, other.width);
+    std::swap(height, other.height);
+    std::swap(colorImage, other.colorImage);
+    std::swap(depthImage, other.depthImage);
+    integrals16.swap(other.integrals16);
+    integrals32.swap(other.integrals32);
+    integrals64.swap(other.integrals64);
+    std::swap(inCIELab, other.inCIELab);
+    std::swap(integratedColor, other.integratedColor);
+    std::swap(integratedDepth, other.integratedDepth);
+    std::swap(interleavedColor, other.interleavedColor);
+    std::swap(integralStorage, other.integralStorage);
+    std::swap(padding, other.padding);
+    columnSentinels.swap(other.columnSentinels);
+    rowSentinels.swap(other.rowSentinels);
+    mappedFile.swap(other.mappedFile);
 }
 
 template<class A, class B>
@@ -200,48 +346,96 @@ void RGBDImage::calculateDerivative(cuv::ndarray_view<T, cuv::host_memory_space>
     }
 }
 
-// integrates channel in double precision
-void RGBDImage::calculateIntegral(cuv::ndarray_view<float, cuv::host_memory_space>& data) {
-
-    assert(data.ndim() == 2);
-
-    cuv::ndarray<double, cuv::host_memory_space> tempData(data.shape());
-    copy(tempData, data);
-
-    cuv::ndarray_view<double, cuv::host_memory_space> view =
-            tempData[cuv::indices[cuv::index_range()][cuv::index_range()]];
-    calculateIntegral<double>(view);
-
-    copy(data, tempData);
+// number of columns per task in the column pass of the integral images
+static const int INTEGRAL_COLUMN_BLOCK = 256;
+
+// adds a row to the running column sums with Kahan summation and writes the compensated sums back to the row.
+// the loop is vectorized over the columns
+static void accumulateColumns(float* __restrict__ row, float* __restrict__ sum, float* __restrict__ compensation,
+        const int columns) {
+    for (int x = 0; x < columns; x++) {
+        const float y = row[x] - compensation[x];
+        const float t = sum[x] + y;
+        compensation[x] = (t - sum[x]) - y;
+        sum[x] = t;
+        row[x] = t - compensation[x];
+    }
 }
 
-template<class T>
-void RGBDImage::calculateIntegral(cuv::ndarray_view<T, cuv::host_memory_space>& view) {
+// integrates the channel in place: prefix sums of the rows (in parallel over the rows),
+// then prefix sums of the columns (in parallel over blocks of columns).
+// both passes use the Kahan summation algorithm
+// http://en.wikipedia.org/wiki/Kahan_summation_algorithm
+void RGBDImage::calculateIntegral(cuv::ndarray_view<float, cuv::host_memory_space>& view) {
 
     assert(view.ndim() == 2);
     const int height = view.shape(0);
     const int width = view.shape(1);
-    T* data = view.ptr();
+    float* data = view.ptr();
+
+    tbb::parallel_for(tbb::blocked_range<int>(0, height),
+            [&](const tbb::blocked_range<int>& range) {
+                for (int y = range.begin(); y != range.end(); y++) {
+                    float* row = data + static_cast<size_t>(y) * width;
+                    float sum = 0.0f;
+                    float c = 0.0f;
+                    for (int x = 0; x < width; x++) {
+                        const float dy = row[x] - c;
+                        const float t = sum + dy;
+                        c = (t - sum) - dy;
+                        sum = t;
+                        row[x] = t - c;
+                    }
+                }
+            });
 
-    // Kahan summation algorithm
-    // http://en.wikipedia.org/wiki/Kahan_summation_algorithm
-    double c = 0.0;
+    tbb::parallel_for(tbb::blocked_range<int>(0, width, INTEGRAL_COLUMN_BLOCK),
+            [&](const tbb::blocked_range<int>& range) {
+                const int columns = range.end() - range.begin();
+                std::vector<float> sum(columns, 0.0f);
+                std::vector<float> compensation(columns, 0.0f);
+                for (int y = 0; y < height; y++) {
+                    float* row = data + static_cast<size_t>(y) * width + range.begin();
+                    accumulateColumns(row, sum.data(), compensation.data(), columns);
+                }
+            });
+}
 
-    for (int y = 0; y < height; ++y) {
-        const int previousRow = (y - 1) * width;
-        const int rowOffset = y * width;
-        for (int x = 0; x < width; ++x) {
-            T above = (y > 0) ? static_cast<T>(data[previousRow + x]) : T();
-            T left = (x > 0) ? static_cast<T>(data[rowOffset + x - 1]) : T();
-            T aboveLeft = (x > 0 && y > 0) ? static_cast<T>(data[previousRow + x - 1]) : T();
+// integrates the plane in place in unsigned arithmetic, i.e. modulo 2^bits of T.
+// region sums (the differences of four integral values) are exact as long as they fit into T
+template<class T>
+static void integrateModular(T* data, const int width, const int height) {
+
+    tbb::parallel_for(tbb::blocked_range<int>(0, height),
+            [&](const tbb::blocked_range<int>& range) {
+                for (int y = range.begin(); y != range.end(); y++) {
+                    T* row = data + static_cast<size_t>(y) * width;
+                    T sum = 0;
+                    for (int x = 0; x < width; x++) {
+                        sum += row[x];
+                        row[x] = sum;
+                    }
+                }
+            });
 
-            double dy = (left + above - aboveLeft) - c;
-            double t = data[rowOffset + x] + dy;
-            c = (t - data[rowOffset + x]) - dy;
+    tbb::parallel_for(tbb::blocked_range<int>(0, width, INTEGRAL_COLUMN_BLOCK),
+            [&](const tbb::blocked_range<int>& range) {
+                for (int y = 1; y < height; y++) {
+                    T* row = data + static_cast<size_t>(y) * width;
+                    const T* previousRow = row - width;
+                    for (int x = range.begin(); x != range.end(); x++) {
+                        row[x] += previousRow[x];
+                    }
+                }
+            });
+}
 
-            data[rowOffset + x] = t;
-        }
-    }
+// integrates the channel in place like the color channels, with exact integer sums.
+// the sums are calculated in unsigned arithmetic as the integral of a large depth image can exceed the range of int.
+// region sums (the differences of four integral values) are then still exact modulo 2^32
+void RGBDImage::calculateIntegral(cuv::ndarray_view<int, cuv::host_memory_space>& view) {
+    assert(view.ndim() == 2);
+    integrateModular(reinterpret_cast<unsigned int*>(view.ptr()), view.shape(1), view.shape(0));
 }
 
 void RGBDImage::fillDepth() {
@@ -344,29 +538,76 @@ void RGBDImage::fillDepthFromBottom() {
     }
 }
 
-void RGBDImage::loadDepthImage(const std::string& depthFilename) {
+void RGBDImage::loadColorImage(const DecodedImage& image, bool convertToCIELab) {
 
-    vigra::ImageImportInfo info(depthFilename.c_str());
+    if (image.getChannels() != static_cast<int>(COLOR_CHANNELS)) {
+        throw std::runtime_error("loading of non-RGB images is not yet supported");
+    }
 
-    if (!info.isGrayscale() || info.isColor() || info.numBands() != 1) {
-        throw std::runtime_error("invalid depth image format");
+    width = image.getWidth();
+    height = image.getHeight();
+    assert(width >= 0 && height >= 0);
+    colorImage.resize(cuv::extents[COLOR_CHANNELS][getHeight()][getWidth()]);
+
+    if (image.getBytesPerSample() != 1) {
+        // fall back to the double precision conversion of vigra for other pixel types
+        vigra::DVector3Image doubleImage(getWidth(), getHeight());
+        for (int y = 0; y < getHeight(); ++y) {
+            for (int x = 0; x < getWidth(); ++x) {
+                for (unsigned int c = 0; c < COLOR_CHANNELS; ++c) {
+                    const size_t pixel = static_cast<size_t>(y) * getWidth() + x;
+                    doubleImage(x, y)[c] = image.getSample(pixel * COLOR_CHANNELS + c);
+                }
+            }
+        }
+        if (convertToCIELab) {
+            doubleImage = convertRGB2CIELab(doubleImage);
+        }
+        for (int y = 0; y < getHeight(); ++y) {
+            for (int x = 0; x < getWidth(); ++x) {
+                for (unsigned int c = 0; c < COLOR_CHANNELS; ++c) {
+                    setColor(x, y, c, doubleImage(x, y)[c]);
+                }
+            }
+        }
+        return;
     }
 
-    vigra::Size2D size = info.size();
+    // a view of the memory-mapped file for raw, PNM and NPY images
+    const uint8_t* rgb = image.getData();
+
+    if (convertToCIELab) {
+        convertRGB2CIELab(rgb, getWidth(), getHeight(), colorImage.ptr());
+        return;
+    }
 
-    if (size.width() != getWidth()) {
+    const size_t planeSize = static_cast<size_t>(getWidth()) * getHeight();
+    float* color = colorImage.ptr();
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, planeSize),
+            [&](const tbb::blocked_range<size_t>& range) {
+                for (size_t i = range.begin(); i != range.end(); i++) {
+                    for (unsigned int c = 0; c < COLOR_CHANNELS; ++c) {
+                        color[c * planeSize + i] = rgb[COLOR_CHANNELS * i + c];
+                    }
+                }
+            });
+}
+
+void RGBDImage::loadDepthImage(const DecodedImage& image) {
+
+    if (image.getChannels() != 1) {
+        throw std::runtime_error("invalid depth image format");
+    }
+
+    if (image.getWidth() != getWidth()) {
         throw std::runtime_error(
-                (boost::format("width of color and depth image differ: %d vs. %d") % getWidth() % size.width()).str());
+                (boost::format("width of color and depth image differ: %d vs. %d") % getWidth() % image.getWidth()).str());
     }
-    if (size.height() != getHeight()) {
+    if (image.getHeight() != getHeight()) {
         throw std::runtime_error(
-                (boost::format("height of color and depth image differ: %d vs. %d") % getHeight() % size.height()).str());
+                (boost::format("height of color and depth image differ: %d vs. %d") % getHeight() % image.getHeight()).str());
     }
 
-    vigra::UInt16Image image(size.width(), size.height());
-
-    vigra::importImage(info, vigra::destImage(image));
-
     depthImage.resize(cuv::extents[DEPTH_CHANNELS][getHeight()][getWidth()]);
 
     utils::Average depthAverage;
@@ -377,8 +618,8 @@ void RGBDImage::loadDepthImage(const std::string& depthFilename) {
     for (int y = 0; y < getHeight(); y++) {
         const size_t rowOffset = y * getWidth();
         for (int x = 0; x < getWidth(); x++) {
-            const int depth = image(x, y);
-            if (depth < 0 || depth > 50000) {
+            const int depth = image.getSample(rowOffset + x);
+            if (depth > 50000) {
                 throw std::runtime_error((boost::format("illegal depth value in image %s @%d,%d: %d")
                         % depthFilename % x % y % depth).str());
             }
@@ -460,7 +701,18 @@ void RGBDImage::calculateIntegral() {
         throw std::runtime_error("image already integrated");
     }
 
-    tbb::parallel_for(tbb::blocked_range<size_t>(0, COLOR_CHANNELS + DEPTH_CHANNELS, 1),
+    if (padding > 0) {
+        throw std::runtime_error("cannot integrate a padded image");
+    }
+
+    if (interleavedColor) {
+        throw std::runtime_error("cannot integrate an interleaved image");
+    }
+
+    // the color channels come first. images without color only integrate the depth channels
+    const unsigned int firstChannel = hasColorImage() ? 0 : COLOR_CHANNELS;
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(firstChannel, COLOR_CHANNELS + DEPTH_CHANNELS, 1),
             [&](const tbb::blocked_range<size_t>& range) {
                 for(unsigned int channelNr = range.begin(); channelNr != range.end(); channelNr++) {
                     if (channelNr >= COLOR_CHANNELS) {
@@ -475,6 +727,106 @@ void RGBDImage::calculateIntegral() {
                 }
             });
 
+    integratedColor = hasColorImage();
+    integratedDepth = true;
+}
+
+// quantizes the color to fixed point and integrates the color, depth and valid planes into the compact planes
+template<class Format>
+static void integrateCompact(const float* color, const int* depths, const int* valids, unsigned int colorChannels,
+        int width, int height, std::vector<typename Format::Value>& values,
+        std::vector<typename Format::Count>& counts) {
+
+    typedef typename Format::Value Value;
+    typedef typename Format::SignedValue SignedValue;
+
+    const size_t planeSize = static_cast<size_t>(width) * height;
+    values.resize((colorChannels + 1) * planeSize);
+    counts.resize(planeSize);
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, planeSize),
+            [&](const tbb::blocked_range<size_t>& range) {
+                for (size_t i = range.begin(); i != range.end(); i++) {
+                    for (unsigned int c = 0; c < colorChannels; c++) {
+                        const double fixedPoint = std::floor(color[c * planeSize + i] * RGBDImage::COLOR_SCALE + 0.5);
+                        // two's complement of negative values
+                        values[c * planeSize + i] = static_cast<Value>(static_cast<SignedValue>(fixedPoint));
+                    }
+                    // invalid depth is zero
+                    values[colorChannels * planeSize + i] = static_cast<Value>(depths[i]);
+                    counts[i] = static_cast<typename Format::Count>(valids[i]);
+                }
+            });
+
+    for (unsigned int plane = 0; plane <= colorChannels; plane++) {
+        integrateModular(values.data() + plane * planeSize, width, height);
+    }
+    integrateModular(counts.data(), width, height);
+}
+
+void RGBDImage::calculateCompactIntegral(float maxRegionSize) {
+
+    utils::Profile profile("calculateCompactIntegral");
+
+    if (maxRegionSize <= 0) {
+        throw std::runtime_error((boost::format("illegal region size: %f") % maxRegionSize).str());
+    }
+
+    if (integratedColor || integratedDepth) {
+        throw std::runtime_error("image already integrated");
+    }
+
+    if (!hasColorImage()) {
+        throw std::runtime_error("compact integral images require a color image");
+    }
+
+    assert(padding == 0);
+    assert(!interleavedColor);
+
+    const size_t planeSize = static_cast<size_t>(getWidth()) * getHeight();
+    const float* color = colorImage.ptr();
+    const int* depths = depthImage.ptr();
+    const int* valids = depths + planeSize;
+
+    int minDepth = std::numeric_limits<int>::max();
+    int maxDepth = 0;
+    for (size_t i = 0; i < planeSize; i++) {
+        if (valids[i]) {
+            minDepth = std::min(minDepth, depths[i]);
+            maxDepth = std::max(maxDepth, depths[i]);
+        }
+    }
+
+    float maxColor = 0.0f;
+    for (size_t i = 0; i < COLOR_CHANNELS * planeSize; i++) {
+        maxColor = std::max(maxColor, std::abs(color[i]));
+    }
+
+    // a region in the image covers at most the image. a feature region is normalized by the depth of its pixel
+    // (see XY::normalize()). one is added to the half size for the rounding of the normalization
+    double maxArea = static_cast<double>(planeSize);
+    if (maxDepth > 0) {
+        const double maxHalfSize = std::max(1.0, std::ceil(maxRegionSize * 1000.0 / minDepth)) + 1;
+        maxArea = std::min(maxArea, 4 * maxHalfSize * maxHalfSize);
+    }
+
+    const double maxColorSum = maxArea * std::ceil(maxColor * COLOR_SCALE + 0.5);
+    const bool compact = (maxArea < (1 << 16) && maxArea * maxDepth < 4294967296.0 && maxColorSum < 2147483648.0);
+
+    if (compact) {
+        integrateCompact<CompactFormat>(color, depths, valids, COLOR_CHANNELS, getWidth(), getHeight(),
+                integrals32, integrals16);
+        integralStorage = COMPACT_INTEGRALS;
+    } else {
+        CURFIL_DEBUG("image " << filename << ": regions of up to " << maxArea << " pixels need wide integral images");
+        integrateCompact<WideFormat>(color, depths, valids, COLOR_CHANNELS, getWidth(), getHeight(),
+                integrals64, integrals32);
+        integralStorage = WIDE_INTEGRALS;
+    }
+
+    colorImage = cuv::ndarray<float, cuv::host_memory_space>();
+    depthImage = cuv::ndarray<int, cuv::host_memory_space>();
+
     integratedColor = true;
     integratedDepth = true;
 }
@@ -484,6 +836,18 @@ void RGBDImage::calculateDerivative() {
         throw std::runtime_error("image not integrated");
     }
 
+    if (isCompact()) {
+        throw std::runtime_error("cannot derive compact integral images");
+    }
+
+    if (padding > 0) {
+        throw std::runtime_error("cannot derive a padded image");
+    }
+
+    if (interleavedColor) {
+        throw std::runtime_error("cannot derive an interleaved image");
+    }
+
     tbb::parallel_for(tbb::blocked_range<size_t>(0, COLOR_CHANNELS + DEPTH_CHANNELS, 1),
             [&](const tbb::blocked_range<size_t>& range) {
                 for(unsigned int channelNr = range.begin(); channelNr != range.end(); channelNr++) {
@@ -503,10 +867,227 @@ void RGBDImage::calculateDerivative() {
     integratedDepth = false;
 }
 
+// copies the planes of the given size into planes with a zero border
+template<class T>
+static std::vector<T> padPlanes(const std::vector<T>& planes, int width, int height, int padding) {
+
+    const size_t planeSize = static_cast<size_t>(width) * height;
+    const size_t paddedWidth = width + 2 * padding;
+    const size_t paddedHeight = height + 2 * padding;
+    const size_t numPlanes = (planeSize > 0) ? planes.size() / planeSize : 0;
+
+    std::vector<T> paddedPlanes(numPlanes * paddedHeight * paddedWidth, 0);
+    for (size_t plane = 0; plane < numPlanes; plane++) {
+        for (int y = 0; y < height; y++) {
+            const T* row = planes.data() + (plane * height + y) * width;
+            std::copy(row, row + width, paddedPlanes.data() + (plane * paddedHeight + y + padding) * paddedWidth + padding);
+        }
+    }
+    return paddedPlanes;
+}
+
+void RGBDImage::padIntegralImages(int padding) {
+
+    if (padding < 0) {
+        throw std::runtime_error((boost::format("illegal padding: %d") % padding).str());
+    }
+
+    if (!integratedColor || !integratedDepth) {
+        throw std::runtime_error("image not integrated");
+    }
+
+    if (this->padding > 0) {
+        throw std::runtime_error("image already padded");
+    }
+
+    if (interleavedColor) {
+        throw std::runtime_error("cannot pad an interleaved image");
+    }
+
+    if (padding == 0) {
+        return;
+    }
+
+    const size_t paddedWidth = getWidth() + 2 * padding;
+    const size_t paddedHeight = getHeight() + 2 * padding;
+
+    if (isCompact()) {
+        // out-of-image regions are detected with the sentinels, the border of all planes is zero
+        integrals16 = padPlanes(integrals16, getWidth(), getHeight(), padding);
+        integrals32 = padPlanes(integrals32, getWidth(), getHeight(), padding);
+        integrals64 = padPlanes(integrals64, getWidth(), getHeight(), padding);
+        setPadding(padding);
+        return;
+    }
+
+    cuv::ndarray<float, cuv::host_memory_space> paddedColorImage(
+            cuv::extents[COLOR_CHANNELS][paddedHeight][paddedWidth], boost::make_shared<cuv::cuda_allocator>());
+    cuv::ndarray<int, cuv::host_memory_space> paddedDepthImage(
+            cuv::extents[DEPTH_CHANNELS][paddedHeight][paddedWidth], boost::make_shared<cuv::cuda_allocator>());
+
+    paddedColorImage = std::numeric_limits<float>::quiet_NaN();
+    paddedDepthImage = 0;
+
+    for (unsigned int c = 0; c < COLOR_CHANNELS; c++) {
+        for (int y = 0; y < getHeight(); y++) {
+            const float* row = colorImage.ptr() + (c * getHeight() + y) * getWidth();
+            std::copy(row, row + getWidth(),
+                    paddedColorImage.ptr() + (c * paddedHeight + y + padding) * paddedWidth + padding);
+        }
+    }
+
+    for (unsigned int c = 0; c < DEPTH_CHANNELS; c++) {
+        for (int y = 0; y < getHeight(); y++) {
+            const int* row = depthImage.ptr() + (c * getHeight() + y) * getWidth();
+            std::copy(row, row + getWidth(),
+                    paddedDepthImage.ptr() + (c * paddedHeight + y + padding) * paddedWidth + padding);
+        }
+    }
+
+    colorImage = paddedColorImage;
+    depthImage = paddedDepthImage;
+    mappedFile.reset();
+
+    setPadding(padding);
+}
+
+void RGBDImage::setPadding(int padding) {
+
+    const size_t paddedWidth = getWidth() + 2 * padding;
+    const size_t paddedHeight = getHeight() + 2 * padding;
+
+    this->padding = padding;
+
+    columnSentinels.assign(paddedWidth, std::numeric_limits<float>::quiet_NaN());
+    std::fill(columnSentinels.begin() + padding, columnSentinels.begin() + padding + getWidth(), 0.0f);
+
+    rowSentinels.assign(paddedHeight, std::numeric_limits<float>::quiet_NaN());
+    std::fill(rowSentinels.begin() + padding, rowSentinels.begin() + padding + getHeight(), 0.0f);
+}
+
+void RGBDImage::interleaveColorImage() {
+
+    if (!integratedColor) {
+        throw std::runtime_error("color image not integrated");
+    }
+
+    if (interleavedColor) {
+        throw std::runtime_error("image already interleaved");
+    }
+
+    if (isCompact()) {
+        throw std::runtime_error("cannot interleave compact integral images");
+    }
+
+    const size_t paddedWidth = getWidth() + 2 * padding;
+    const size_t paddedHeight = getHeight() + 2 * padding;
+    const size_t planeSize = paddedWidth * paddedHeight;
+
+    cuv::ndarray<float, cuv::host_memory_space> interleavedColorImage(
+            cuv::extents[paddedHeight][paddedWidth][INTERLEAVED_COLOR_CHANNELS],
+            boost::make_shared<cuv::cuda_allocator>());
+
+    const float* planes = colorImage.ptr();
+    float* pixels = interleavedColorImage.ptr();
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, paddedHeight),
+            [&](const tbb::blocked_range<size_t>& range) {
+                for (size_t y = range.begin(); y != range.end(); y++) {
+                    for (size_t x = 0; x < paddedWidth; x++) {
+                        const size_t pos = y * paddedWidth + x;
+                        for (unsigned int c = 0; c < COLOR_CHANNELS; c++) {
+                            pixels[pos * INTERLEAVED_COLOR_CHANNELS + c] = planes[c * planeSize + pos];
+                        }
+                        pixels[pos * INTERLEAVED_COLOR_CHANNELS + COLOR_CHANNELS] = 0.0f;
+                    }
+                }
+            });
+
+    // the depth integral images of a mapped image stay mapped
+    colorImage = interleavedColorImage;
+    interleavedColor = true;
+}
+
+void RGBDImage::downsample(int level) {
+
+    if (level < 0) {
+        throw std::runtime_error((boost::format("illegal pyramid level: %d") % level).str());
+    }
+
+    if (integratedColor || integratedDepth) {
+        throw std::runtime_error("cannot downsample an integrated image");
+    }
+
+    assert(padding == 0);
+
+    if (level == 0) {
+        return;
+    }
+
+    const int factor = 1 << level;
+    const int newWidth = getWidth() / factor;
+    const int newHeight = getHeight() / factor;
+
+    if (newWidth == 0 || newHeight == 0) {
+        throw std::runtime_error((boost::format("image %s (%dx%d) is too small for pyramid level %d")
+                % filename % getWidth() % getHeight() % level).str());
+    }
+
+    RGBDImage downsampled(newWidth, newHeight);
+    const bool withColor = hasColorImage();
+
+    tbb::parallel_for(tbb::blocked_range<int>(0, newHeight),
+            [&](const tbb::blocked_range<int>& range) {
+                for (int y = range.begin(); y != range.end(); y++) {
+                    for (int x = 0; x < newWidth; x++) {
+                        for (unsigned int c = 0; withColor && c < COLOR_CHANNELS; c++) {
+                            float sum = 0.0f;
+                            for (int dy = 0; dy < factor; dy++) {
+                                for (int dx = 0; dx < factor; dx++) {
+                                    sum += getColor(x * factor + dx, y * factor + dy, c);
+                                }
+                            }
+                            downsampled.setColor(x, y, c, sum / (factor * factor));
+                        }
+
+                        int depthSum = 0;
+                        int numValid = 0;
+                        for (int dy = 0; dy < factor; dy++) {
+                            for (int dx = 0; dx < factor; dx++) {
+                                if (getDepthValid(x * factor + dx, y * factor + dy)) {
+                                    depthSum += getDepth(x * factor + dx, y * factor + dy).getIntValue();
+                                    numValid++;
+                                }
+                            }
+                        }
+                        downsampled.setDepth(x, y, numValid > 0 ? Depth(depthSum / numValid) : Depth::INVALID);
+                    }
+                }
+            });
+
+    width = newWidth;
+    height = newHeight;
+    if (withColor) {
+        colorImage = downsampled.colorImage;
+    }
+    depthImage = downsampled.depthImage;
+}
+
 // http://www.cs.washington.edu/rgbd-dataset/trd5326jglrepxk649ed/rgbd-dataset_full/README.txt
 void RGBDImage::saveDepth(const std::string& filename) const {
 
-    cuv::ndarray<int, cuv::host_memory_space> tempDepthData = depthImage.copy();
+    if (isCompact()) {
+        throw std::runtime_error("cannot save compact integral images");
+    }
+
+    // copy without the border of a padded image
+    cuv::ndarray<int, cuv::host_memory_space> tempDepthData(cuv::extents[DEPTH_CHANNELS][getHeight()][getWidth()]);
+    for (int y = 0; y < getHeight(); ++y) {
+        for (int x = 0; x < getWidth(); ++x) {
+            tempDepthData(0, y, x) = getDepth(x, y).getIntValue();
+            tempDepthData(1, y, x) = getDepthValid(x, y);
+        }
+    }
 
     if (integratedDepth) {
         for (unsigned int c = 0; c < DEPTH_CHANNELS; c++) {
@@ -535,9 +1116,21 @@ void RGBDImage::saveDepth(const std::string& filename) const {
 
 void RGBDImage::saveColor(const std::string& filename) const {
 
+    if (isCompact()) {
+        throw std::runtime_error("cannot save compact integral images");
+    }
+
     vigra::DVector3Image image(getWidth(), getHeight());
 
-    cuv::ndarray<float, cuv::host_memory_space> tmpColorImage = colorImage.copy();
+    // copy without the border of a padded image
+    cuv::ndarray<float, cuv::host_memory_space> tmpColorImage(cuv::extents[COLOR_CHANNELS][getHeight()][getWidth()]);
+    for (unsigned int c = 0; c < COLOR_CHANNELS; ++c) {
+        for (int y = 0; y < getHeight(); ++y) {
+            for (int x = 0; x < getWidth(); ++x) {
+                tmpColorImage(c, y, x) = getColor(x, y, c);
+            }
+        }
+    }
 
     if (integratedColor) {
         for (unsigned int c = 0; c < COLOR_CHANNELS; ++c) {
@@ -575,91 +1168,220 @@ void RGBDImage::saveColor(const std::string& filename) const {
 
 }
 
-std::map<RGBColor, LabelType> colors;
-tbb::mutex colorsMutex;
+// label colors are packed as 0xRRGGBB
+static uint32_t packColor(uint8_t r, uint8_t g, uint8_t b) {
+    return (static_cast<uint32_t>(r) << 16) | (static_cast<uint32_t>(g) << 8) | b;
+}
+
+static uint32_t packColor(const RGBColor& color) {
+    assert(color.size() == 3);
+    return packColor(color[0], color[1], color[2]);
+}
 
-LabelType getOrAddColorId(const RGBColor& color, const LabelType& id) {
-    if (colors.find(color) == colors.end()) {
-        addColorId(color, id);
-    }
-    return colors[color];
+static RGBColor unpackColor(uint32_t color) {
+    return RGBColor((color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF);
 }
 
+/**
+ * Maps label colors to labels and back. Lookups are lock-free.
+ * New colors are added under the mutex such that concurrently loaded images get consistent labels.
+ */
+class LabelColorRegistry {
+
+public:
+
+    LabelColorRegistry() :
+            numColors(0) {
+        clear();
+    }
+
+    // the mutex must be locked. there must be no concurrent lookups
+    void clear() {
+        for (auto& slot : slots) {
+            slot.store(EMPTY, std::memory_order_relaxed);
+        }
+        for (auto& color : labelColors) {
+            color.store(EMPTY, std::memory_order_relaxed);
+        }
+        numColors = 0;
+    }
+
+    /**
+     * @return the label of the packed color or -1 if the color is unknown
+     */
+    int findLabel(uint32_t color) const {
+        for (size_t i = hash(color);; i = (i + 1) % NUM_SLOTS) {
+            const uint64_t slot = slots[i].load(std::memory_order_acquire);
+            if (slot == EMPTY) {
+                return -1;
+            }
+            if (static_cast<uint32_t>((slot >> 8) & 0xFFFFFF) == color) {
+                return static_cast<LabelType>(slot & 0xFF);
+            }
+        }
+    }
+
+    /**
+     * @return the packed color of the label or -1 if no color was added for the label
+     */
+    int64_t findColor(LabelType label) const {
+        const uint64_t color = labelColors[label].load(std::memory_order_acquire);
+        if (color == EMPTY) {
+            return -1;
+        }
+        return static_cast<int64_t>(color & 0xFFFFFF);
+    }
+
+    size_t getNumColors() const {
+        return numColors;
+    }
+
+    // the mutex must be locked. the color must be new
+    void add(uint32_t color, LabelType label) {
+        assert(findLabel(color) < 0);
+        if (numColors >= NUM_SLOTS / 2) {
+            throw std::runtime_error((boost::format("too many label colors: %d") % numColors).str());
+        }
+
+        size_t i = hash(color);
+        while (slots[i].load(std::memory_order_relaxed) != EMPTY) {
+            i = (i + 1) % NUM_SLOTS;
+        }
+        // the color and its label are published at once
+        slots[i].store(OCCUPIED | (static_cast<uint64_t>(color) << 8) | label, std::memory_order_release);
+        numColors++;
+
+        // several colors can have the same label. the label is decoded to the smallest color
+        const int64_t labelColor = findColor(label);
+        if (labelColor < 0 || color < labelColor) {
+            labelColors[label].store(OCCUPIED | color, std::memory_order_release);
+        }
+    }
+
+    tbb::mutex mutex;
+
+private:
+
+    static const uint64_t EMPTY = 0;
+    static const uint64_t OCCUPIED = 1lu << 32;
+    // the number of colors is limited by the number of labels. the table is at most half full
+    static const size_t NUM_SLOTS = 1024;
+
+    static size_t hash(uint32_t color) {
+        return (color * 2654435761u) % NUM_SLOTS;
+    }
+
+    std::atomic<uint64_t> slots[NUM_SLOTS];
+    std::atomic<uint64_t> labelColors[std::numeric_limits<LabelType>::max() + 1];
+    size_t numColors;
+};
+
+static LabelColorRegistry labelColorRegistry;
+
 void addColorId(const RGBColor& color, const LabelType& id) {
-    if (colors.find(color) != colors.end()) {
-        if (colors[color] != id) {
+    tbb::mutex::scoped_lock lock(labelColorRegistry.mutex);
+    const int label = labelColorRegistry.findLabel(packColor(color));
+    if (label >= 0) {
+        if (label != id) {
             std::ostringstream o;
             o << "color RGB(" << color << "): ";
-            o << "existing label: " << static_cast<int>(colors[color]);
+            o << "existing label: " << label;
             o << ", new label: " << static_cast<int>(id);
             throw std::runtime_error(o.str());
         }
     } else {
-        colors[color] = id;
+        labelColorRegistry.add(packColor(color), id);
     }
 }
 
-static LabelType encodeColor(const vigra::UInt8RGBImage& labelImage, int x, int y) {
-    const vigra::RGBValue<vigra::UInt8> c = labelImage(x, y);
-    RGBColor color(c[0], c[1], c[2]);
+void clearColorIds() {
+    tbb::mutex::scoped_lock lock(labelColorRegistry.mutex);
+    labelColorRegistry.clear();
+}
 
-    std::map<RGBColor, LabelType>::iterator it = colors.find(color);
-    if (it != colors.end()) {
-        return it->second;
+LabelType getOrAddColorId(const RGBColor& color, const LabelType& id) {
+    const uint32_t packedColor = packColor(color);
+    int label = labelColorRegistry.findLabel(packedColor);
+    if (label >= 0) {
+        return label;
     }
 
-    LabelType id = static_cast<LabelType>(colors.size());
-    addColorId(color, id);
+    tbb::mutex::scoped_lock lock(labelColorRegistry.mutex);
+    label = labelColorRegistry.findLabel(packedColor);
+    if (label >= 0) {
+        return label;
+    }
+    labelColorRegistry.add(packedColor, id);
     return id;
 }
 
-RGBColor LabelImage::decodeLabel(const LabelType& v) {
+// new colors get the next free label
+static LabelType encodeColor(uint32_t color) {
+    int label = labelColorRegistry.findLabel(color);
+    if (label >= 0) {
+        return label;
+    }
 
-    tbb::mutex::scoped_lock lock(colorsMutex);
+    tbb::mutex::scoped_lock lock(labelColorRegistry.mutex);
+    label = labelColorRegistry.findLabel(color);
+    if (label >= 0) {
+        return label;
+    }
+    const LabelType id = static_cast<LabelType>(labelColorRegistry.getNumColors());
+    labelColorRegistry.add(color, id);
+    return id;
+}
 
-    std::map<RGBColor, LabelType>::iterator it;
-    for (it = colors.begin(); it != colors.end(); it++) {
-        if (it->second == v) {
-            lock.release();
-            assert(it->first.size() == 3);
-            return it->first;
-        }
+static uint32_t decodePackedLabel(const LabelType& v) {
+    const int64_t color = labelColorRegistry.findColor(v);
+    if (color >= 0) {
+        return static_cast<uint32_t>(color);
     }
+
     std::ostringstream o;
     o << "color for label " << static_cast<int>(v) << " not found" << std::endl;
     o << "available colors:" << std::endl;
-    for (auto& c : colors) {
-        o << static_cast<int>(c.second) << ": ";
-        o << c.first[0] << ",";
-        o << c.first[1] << ",";
-        o << c.first[2];
-        o << std::endl;
+    for (int label = 0; label <= std::numeric_limits<LabelType>::max(); label++) {
+        const int64_t labelColor = labelColorRegistry.findColor(label);
+        if (labelColor >= 0) {
+            o << label << ": " << unpackColor(labelColor) << std::endl;
+        }
     }
     throw std::runtime_error(o.str());
 }
 
+RGBColor LabelImage::decodeLabel(const LabelType& v) {
+    return unpackColor(decodePackedLabel(v));
+}
+
 LabelImage::LabelImage(const std::string& filename) :
         filename(filename) {
+    load(decodeImage(filename));
+}
 
-    vigra::UInt8RGBImage labelImage;
-    try {
-        loadImage(filename, labelImage);
-    } catch (const std::exception& e) {
-        throw std::runtime_error(std::string("failed to load label image '") + filename + "': " + e.what());
+LabelImage::LabelImage(const std::string& filename, const DecodedImage& labelImage) :
+        filename(filename) {
+    load(labelImage);
+}
+
+void LabelImage::load(const DecodedImage& labelImage) {
+
+    if (labelImage.getChannels() != 3 || labelImage.getBytesPerSample() != 1) {
+        throw std::runtime_error(std::string("failed to load label image '") + filename
+                + "': label images must have 8-bit RGB pixels");
     }
 
-    width = labelImage.width();
-    height = labelImage.height();
+    width = labelImage.getWidth();
+    height = labelImage.getHeight();
     image.resize(height, width);
     image = LabelType();
 
-    utils::Timer timer;
-
-    tbb::mutex::scoped_lock lock(colorsMutex);
-
-    for (int x = 0; x < labelImage.width(); ++x) {
-        for (int y = 0; y < labelImage.height(); ++y) {
-            setLabel(x, y, encodeColor(labelImage, x, y));
+    // the order of the pixels determines the labels of new colors
+    const uint8_t* rgb = labelImage.getData();
+    for (int x = 0; x < width; ++x) {
+        for (int y = 0; y < height; ++y) {
+            const uint8_t* c = rgb + 3 * (static_cast<size_t>(y) * width + x);
+            setLabel(x, y, encodeColor(packColor(c[0], c[1], c[2])));
         }
     }
 }
@@ -667,12 +1389,12 @@ LabelImage::LabelImage(const std::string& filename) :
 void LabelImage::save(const std::string& filename) const {
     vigra::UInt8RGBImage labelImage(width, height);
 
-    for (int x = 0; x < width; ++x) {
-        for (int y = 0; y < height; ++y) {
-            auto color = decodeLabel(getLabel(x, y));
-            for (int c = 0; c < 3; c++) {
-                labelImage(x, y)[c] = color[c];
-            }
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const uint32_t color = decodePackedLabel(getLabel(x, y));
+            labelImage(x, y)[0] = (color >> 16) & 0xFF;
+            labelImage(x, y)[1] = (color >> 8) & 0xFF;
+            labelImage(x, y)[2] = color & 0xFF;
         }
     }
 
@@ -680,6 +1402,73 @@ void LabelImage::save(const std::string& filename) const {
             vigra::ImageExportInfo(filename.c_str()).setPixelType("UINT8"));
 }
 
+void LabelImage::downsample(int level) {
+
+    if (level < 0) {
+        throw std::runtime_error((boost::format("illegal pyramid level: %d") % level).str());
+    }
+
+    if (level == 0) {
+        return;
+    }
+
+    const int factor = 1 << level;
+    const int newWidth = width / factor;
+    const int newHeight = height / factor;
+
+    if (newWidth == 0 || newHeight == 0) {
+        throw std::runtime_error((boost::format("label image %s (%dx%d) is too small for pyramid level %d")
+                % filename % width % height % level).str());
+    }
+
+    cuv::ndarray<LabelType, cuv::host_memory_space> downsampled(newHeight, newWidth);
+
+    std::vector<int> counts(std::numeric_limits<LabelType>::max() + 1);
+    for (int y = 0; y < newHeight; y++) {
+        for (int x = 0; x < newWidth; x++) {
+            // ties go to the label that reaches the highest count first
+            LabelType bestLabel = getLabel(x * factor, y * factor);
+            int bestCount = 0;
+            for (int dy = 0; dy < factor; dy++) {
+                for (int dx = 0; dx < factor; dx++) {
+                    const LabelType label = getLabel(x * factor + dx, y * factor + dy);
+                    if (++counts[label] > bestCount) {
+                        bestCount = counts[label];
+                        bestLabel = label;
+                    }
+                }
+            }
+            for (int dy = 0; dy < factor; dy++) {
+                for (int dx = 0; dx < factor; dx++) {
+                    counts[getLabel(x * factor + dx, y * factor + dy)] = 0;
+                }
+            }
+            downsampled(y, x) = bestLabel;
+        }
+    }
+
+    width = newWidth;
+    height = newHeight;
+    image = downsampled;
+}
+
+LabelImage LabelImage::upsample(int level, int width, int height) const {
+
+    if (level < 0) {
+        throw std::runtime_error((boost::format("illegal pyramid level: %d") % level).str());
+    }
+
+    LabelImage upsampled(width, height);
+    for (int y = 0; y < height; y++) {
+        const int sourceY = std::min(y >> level, getHeight() - 1);
+        for (int x = 0; x < width; x++) {
+            const int sourceX = std::min(x >> level, getWidth() - 1);
+            upsampled.setLabel(x, y, getLabel(sourceX, sourceY));
+        }
+    }
+    return upsampled;
+}
+
 LabeledRGBDImage::LabeledRGBDImage(const boost::shared_ptr<RGBDImage>& rgbdImage,
         const boost::shared_ptr<LabelImage>& labelImage) :
         rgbdImage(rgbdImage), labelImage(labelImage) {
@@ -694,30 +1483,343 @@ LabeledRGBDImage::LabeledRGBDImage(const boost::shared_ptr<RGBDImage>& rgbdImage
     }
 }
 
+static const char IMAGE_CACHE_MAGIC[8] = { 'C', 'U', 'R', 'F', 'I', 'L', 'I', 'C' };
+static const uint32_t IMAGE_CACHE_VERSION = 2;
+
+// FNV-1a
+static const uint64_t HASH_OFFSET = 14695981039346656037lu;
+static const uint64_t HASH_PRIME = 1099511628211lu;
+
+static uint64_t hashBytes(const char* data, size_t size, uint64_t hash = HASH_OFFSET) {
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ static_cast<uint8_t>(data[i])) * HASH_PRIME;
+    }
+    return hash;
+}
+
+static uint64_t hashFile(const std::string& filename) {
+    std::ifstream file(filename.c_str(), std::ios::binary);
+    if (!file) {
+        throw std::runtime_error(std::string("failed to open ") + filename);
+    }
+    uint64_t hash = HASH_OFFSET;
+    std::vector<char> buffer(1 << 16);
+    while (file) {
+        file.read(buffer.data(), buffer.size());
+        hash = hashBytes(buffer.data(), file.gcount(), hash);
+    }
+    return hash;
+}
+
+// a source file of a cached image
+struct ImageCacheSource {
+    uint64_t size;
+    int64_t modificationTime;
+    uint64_t hash;
+};
+
+/**
+ * Header of an image cache file. It is followed by
+ *  - the absolute filename of the color image (filenameLength chars)
+ *  - the RGB colors of the labels 0 to numLabels - 1 as they were encoded when the cache file was written
+ *  - zero bytes up to the next multiple of eight bytes
+ *  - the color integral image (3 × height × width floats)
+ *  - the depth and valid-depth integral images (2 × height × width ints)
+ *  - the label image (height × width labels)
+ * in native byte order.
+ */
+struct ImageCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t labelSize;
+    int32_t width;
+    int32_t height;
+    int32_t pyramidLevel;
+    uint8_t useCIELab;
+    uint8_t useDepthFilling;
+    uint16_t numLabels;
+    uint32_t filenameLength;
+    // color, depth and label image
+    ImageCacheSource sources[3];
+};
+
+static size_t getImageCacheMetadataSize(const ImageCacheHeader& header) {
+    const size_t size = header.filenameLength + 3 * header.numLabels;
+    return (size + 7) / 8 * 8;
+}
+
+static ImageCacheSource describeImageCacheSource(const std::string& filename) {
+    ImageCacheSource source;
+    source.size = fs::file_size(filename);
+    source.modificationTime = fs::last_write_time(filename);
+    source.hash = hashFile(filename);
+    return source;
+}
+
+static bool isImageCacheSourceUnchanged(const std::string& filename, const ImageCacheSource& source) {
+    if (!fs::exists(filename) || fs::file_size(filename) != source.size) {
+        return false;
+    }
+    if (fs::last_write_time(filename) == source.modificationTime) {
+        return true;
+    }
+    // e.g. a copied or touched file
+    return (hashFile(filename) == source.hash);
+}
+
+std::string getImageCacheFilename(const std::string& cacheFolder, const std::string& filename) {
+    const std::string absoluteFilename = fs::absolute(filename).native();
+    return (boost::format("%s/%s_%016x.bin")
+            % cacheFolder
+            % fs::path(filename).stem().native()
+            % hashBytes(absoluteFilename.data(), absoluteFilename.size())).str();
+}
+
+static bool readImageCache(const std::string& cacheFilename, const std::string& filename,
+        const std::string& depthFilename, const std::string& labelFilename,
+        bool useCIELab, bool useDepthFilling, int pyramidLevel, bool mapImage, LabeledRGBDImage& image) {
+
+    if (!fs::exists(cacheFilename)) {
+        return false;
+    }
+
+    utils::Profile profile("readImageCache");
+
+    // copy-on-write. a mapped image can be modified without changing the cache file
+    boost::iostreams::mapped_file_params params(cacheFilename);
+    params.flags = boost::iostreams::mapped_file::priv;
+    const auto mappedFile = boost::make_shared<boost::iostreams::mapped_file>(params);
+    const boost::iostreams::mapped_file& file = *mappedFile;
+
+    ImageCacheHeader header;
+    if (file.size() < sizeof(header)) {
+        CURFIL_WARNING("ignoring truncated image cache file " << cacheFilename);
+        return false;
+    }
+    std::memcpy(&header, file.const_data(), sizeof(header));
+
+    if (std::memcmp(header.magic, IMAGE_CACHE_MAGIC, sizeof(IMAGE_CACHE_MAGIC)) != 0
+            || header.version != IMAGE_CACHE_VERSION
+            || header.headerSize != sizeof(header)
+            || header.labelSize != sizeof(LabelType)) {
+        CURFIL_DEBUG("ignoring image cache file " << cacheFilename << " of another version");
+        return false;
+    }
+
+    if (header.useCIELab != useCIELab || header.useDepthFilling != useDepthFilling
+            || header.pyramidLevel != pyramidLevel) {
+        CURFIL_DEBUG("ignoring image cache file " << cacheFilename << " with other preprocessing parameters");
+        return false;
+    }
+
+    const size_t numPixels = static_cast<size_t>(header.width) * header.height;
+    const size_t colorSize = 3 * numPixels * sizeof(float);
+    const size_t depthSize = 2 * numPixels * sizeof(int);
+    const size_t metadataSize = getImageCacheMetadataSize(header);
+    if (file.size() != sizeof(header) + metadataSize + colorSize + depthSize + numPixels * sizeof(LabelType)) {
+        CURFIL_WARNING("ignoring image cache file " << cacheFilename << " with unexpected size " << file.size());
+        return false;
+    }
+
+    const char* metadata = file.const_data() + sizeof(header);
+    if (std::string(metadata, header.filenameLength) != fs::absolute(filename).native()) {
+        CURFIL_WARNING("ignoring image cache file " << cacheFilename << " of another image");
+        return false;
+    }
+
+    const std::string sourceFilenames[] = { filename, depthFilename, labelFilename };
+    for (size_t i = 0; i < 3; i++) {
+        if (!isImageCacheSourceUnchanged(sourceFilenames[i], header.sources[i])) {
+            CURFIL_INFO("image " << sourceFilenames[i] << " changed. updating image cache");
+            return false;
+        }
+    }
+
+    // the label ids depend on the order in which the label colors are encoded
+    std::vector<LabelType> labels(header.numLabels);
+    const uint8_t* labelColors = reinterpret_cast<const uint8_t*>(metadata + header.filenameLength);
+    for (size_t label = 0; label < labels.size(); label++) {
+        labels[label] = encodeColor(packColor(labelColors[3 * label], labelColors[3 * label + 1],
+                labelColors[3 * label + 2]));
+    }
+
+    char* data = mappedFile->data() + sizeof(header) + metadataSize;
+    boost::shared_ptr<RGBDImage> rgbdImage;
+    if (mapImage) {
+        rgbdImage = boost::make_shared<RGBDImage>(filename, depthFilename, header.width, header.height, useCIELab,
+                reinterpret_cast<float*>(data), reinterpret_cast<int*>(data + colorSize), mappedFile);
+    } else {
+        rgbdImage = boost::make_shared<RGBDImage>(filename, depthFilename, header.width, header.height, useCIELab,
+                reinterpret_cast<const float*>(data), reinterpret_cast<const int*>(data + colorSize));
+    }
+
+    const LabelType* labelData = reinterpret_cast<const LabelType*>(data + colorSize + depthSize);
+    const auto labelImage = boost::make_shared<LabelImage>(header.width, header.height);
+    for (int y = 0; y < header.height; y++) {
+        for (int x = 0; x < header.width; x++) {
+            const LabelType label = labelData[y * header.width + x];
+            if (label >= labels.size()) {
+                throw std::runtime_error((boost::format("illegal label %d in image cache file %s")
+                        % static_cast<int>(label) % cacheFilename).str());
+            }
+            labelImage->setLabel(x, y, labels[label]);
+        }
+    }
+
+    image = LabeledRGBDImage(rgbdImage, labelImage);
+    return true;
+}
+
+static void writeImageCache(const std::string& cacheFilename, const std::string& filename,
+        const std::string& depthFilename, const std::string& labelFilename,
+        bool useCIELab, bool useDepthFilling, int pyramidLevel, const LabeledRGBDImage& image) {
+
+    utils::Profile profile("writeImageCache");
+
+    const RGBDImage& rgbdImage = image.getRGBDImage();
+    const LabelImage& labelImage = image.getLabelImage();
+
+    assert(rgbdImage.hasIntegratedColor() && rgbdImage.hasIntegratedDepth());
+    assert(rgbdImage.getPadding() == 0);
+
+    const std::string absoluteFilename = fs::absolute(filename).native();
+
+    std::vector<LabelType> labels(static_cast<size_t>(labelImage.getWidth()) * labelImage.getHeight());
+    size_t numLabels = 0;
+    for (int y = 0; y < labelImage.getHeight(); y++) {
+        for (int x = 0; x < labelImage.getWidth(); x++) {
+            const LabelType label = labelImage.getLabel(x, y);
+            labels[y * labelImage.getWidth() + x] = label;
+            numLabels = std::max(numLabels, label + 1lu);
+        }
+    }
+
+    ImageCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, IMAGE_CACHE_MAGIC, sizeof(IMAGE_CACHE_MAGIC));
+    header.version = IMAGE_CACHE_VERSION;
+    header.headerSize = sizeof(header);
+    header.labelSize = sizeof(LabelType);
+    header.width = rgbdImage.getWidth();
+    header.height = rgbdImage.getHeight();
+    header.pyramidLevel = pyramidLevel;
+    header.useCIELab = useCIELab;
+    header.useDepthFilling = useDepthFilling;
+    header.numLabels = numLabels;
+    header.filenameLength = absoluteFilename.size();
+    header.sources[0] = describeImageCacheSource(filename);
+    header.sources[1] = describeImageCacheSource(depthFilename);
+    header.sources[2] = describeImageCacheSource(labelFilename);
+
+    std::vector<char> metadata(getImageCacheMetadataSize(header), 0);
+    std::copy(absoluteFilename.begin(), absoluteFilename.end(), metadata.begin());
+    for (size_t label = 0; label < numLabels; label++) {
+        const RGBColor color = LabelImage::decodeLabel(label);
+        for (size_t c = 0; c < 3; c++) {
+            metadata[absoluteFilename.size() + 3 * label + c] = color[c];
+        }
+    }
+
+    fs::create_directories(fs::path(cacheFilename).parent_path());
+
+    // images can be loaded by concurrent processes. the complete file is renamed atomically
+    const std::string temporaryFilename = cacheFilename + fs::unique_path(".%%%%-%%%%-%%%%").native();
+    {
+        std::ofstream file(temporaryFilename.c_str(), std::ios::binary);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(metadata.data(), metadata.size());
+        file.write(reinterpret_cast<const char*>(rgbdImage.getColorImage().ptr()),
+                rgbdImage.getColorImage().size() * sizeof(float));
+        file.write(reinterpret_cast<const char*>(rgbdImage.getDepthImage().ptr()),
+                rgbdImage.getDepthImage().size() * sizeof(int));
+        file.write(reinterpret_cast<const char*>(labels.data()), labels.size() * sizeof(LabelType));
+        if (!file) {
+            fs::remove(temporaryFilename);
+            throw std::runtime_error(std::string("failed to write image cache file ") + cacheFilename);
+        }
+    }
+    fs::rename(temporaryFilename, cacheFilename);
+}
+
 LabeledRGBDImage loadImagePair(const std::string& filename, bool useCIELab, bool useDepthFilling,
-        bool calculateIntegralImages) {
-    auto pos = filename.find("_colors.png");
-    std::string labelFilename = filename;
-    std::string depthFilename = filename;
-    try {
-        labelFilename.replace(pos, labelFilename.length(), "_ground_truth.png");
-    } catch (const std::exception& e) {
-        throw std::runtime_error(std::string("illegal label image filename: ") + labelFilename);
+        bool calculateIntegralImages, int integralPadding, int pyramidLevel, const std::string& cacheFolder,
+        bool mapImages, bool interleaveColor, float compactRegionSize, const DatasetManifest& manifest) {
+
+    if (mapImages && (cacheFolder.empty() || !calculateIntegralImages)) {
+        throw std::runtime_error("mapped images require an image cache folder and integral images");
+    }
+    if (mapImages && (integralPadding > 0 || interleaveColor)) {
+        throw std::runtime_error("mapped images cannot be padded or interleaved");
+    }
+    if (interleaveColor && !calculateIntegralImages) {
+        throw std::runtime_error("interleaved color images require integral images");
+    }
+    // compact integral images are calculated from the pixels, which the cache does not store
+    const bool compact = compactRegionSize > 0;
+    if (compact && (!calculateIntegralImages || !cacheFolder.empty() || interleaveColor)) {
+        throw std::runtime_error(
+                "compact integral images require integral images and cannot be cached or interleaved");
     }
 
-    try {
-        depthFilename.replace(pos, depthFilename.length(), "_depth.png");
-    } catch (const std::exception& e) {
-        throw std::runtime_error(std::string("illegal depth image filename: ") + depthFilename);
+    const std::string depthFilename = manifest.getDepthFilename(filename);
+    const std::string labelFilename = manifest.getLabelFilename(filename);
+
+    const bool useCache = calculateIntegralImages && !cacheFolder.empty();
+    const std::string cacheFilename = useCache ? getImageCacheFilename(cacheFolder, filename) : "";
+
+    LabeledRGBDImage image;
+    if (!useCache || !readImageCache(cacheFilename, filename, depthFilename, labelFilename, useCIELab,
+            useDepthFilling, pyramidLevel, mapImages, image)) {
+
+        DecodedImage color;
+        DecodedImage depth;
+        DecodedImage label;
+        {
+            utils::Profile profile("decodeImage");
+            tbb::parallel_invoke(
+                    [&]() {color = decodeImage(filename, manifest.getColorFormat());},
+                    [&]() {depth = decodeImage(depthFilename, manifest.getDepthFormat());},
+                    [&]() {label = decodeImage(labelFilename, manifest.getLabelFormat());});
+        }
+
+        // the integral images are calculated after downsampling
+        const auto rgbdImage = boost::make_shared<RGBDImage>(filename, depthFilename, &color, depth, useCIELab,
+                useDepthFilling, calculateIntegralImages && pyramidLevel == 0 && !compact);
+        const auto labelImage = boost::make_shared<LabelImage>(labelFilename, label);
+        if (pyramidLevel > 0) {
+            rgbdImage->downsample(pyramidLevel);
+            labelImage->downsample(pyramidLevel);
+            if (calculateIntegralImages && !compact) {
+                rgbdImage->calculateIntegral();
+            }
+        }
+        if (compact) {
+            rgbdImage->calculateCompactIntegral(compactRegionSize);
+        }
+        image = LabeledRGBDImage(rgbdImage, labelImage);
+
+        if (useCache) {
+            writeImageCache(cacheFilename, filename, depthFilename, labelFilename, useCIELab, useDepthFilling,
+                    pyramidLevel, image);
+            // drop the decoded image in favor of the mapped cache file
+            if (mapImages && !readImageCache(cacheFilename, filename, depthFilename, labelFilename, useCIELab,
+                    useDepthFilling, pyramidLevel, true, image)) {
+                throw std::runtime_error(std::string("failed to map image cache file ") + cacheFilename);
+            }
+        }
     }
 
-    const auto rgbdImage = boost::make_shared<RGBDImage>(filename, depthFilename, useCIELab, useDepthFilling,
-            calculateIntegralImages);
-    const auto labelImage = boost::make_shared<LabelImage>(labelFilename);
-    return LabeledRGBDImage(rgbdImage, labelImage);
+    if (integralPadding > 0) {
+        image.rgbdImage->padIntegralImages(integralPadding);
+    }
+    if (interleaveColor) {
+        image.rgbdImage->interleaveColorImage();
+    }
+    return image;
 }
 
-std::vector<std::string> listImageFilenames(const std::string& path) {
+std::vector<std::string> listImageFilenames(const std::string& path, const DatasetManifest& manifest) {
 
     std::vector<std::string> filenames;
 
@@ -727,11 +1829,11 @@ std::vector<std::string> listImageFilenames(const std::string& path) {
         const fs::path p = *it;
         if (fs::is_regular_file(p)) {
             std::string filename = p.native();
-            if (filename.find("_colors.png") != std::string::npos) {
+            if (manifest.isColorFilename(filename)) {
                 filenames.push_back(filename);
             }
         } else if (fs::is_directory(p)) {
-            for (const auto& filename : listImageFilenames(p.native())) {
+            for (const auto& filename : listImageFilenames(p.native(), manifest)) {
                 filenames.push_back(filename);
             }
         } else {
@@ -744,10 +1846,33 @@ std::vector<std::string> listImageFilenames(const std::string& path) {
     return filenames;
 }
 
-std::vector<LabeledRGBDImage> loadImages(const std::string& folder, bool useCIELab, bool useDepthFilling) {
+static void logImageSizes(const std::vector<LabeledRGBDImage>& images) {
+    // images of different sizes need no padding. the GPU evaluates them in batches of one size
+    std::map<std::pair<int, int>, size_t> numImagesPerSize;
+    for (const LabeledRGBDImage& image : images) {
+        numImagesPerSize[std::make_pair(image.getWidth(), image.getHeight())]++;
+    }
+    if (numImagesPerSize.size() <= 1) {
+        return;
+    }
+    std::ostringstream o;
+    o << numImagesPerSize.size() << " different image sizes:";
+    for (const auto& size : numImagesPerSize) {
+        o << " " << size.first.first << "x" << size.first.second << " (" << size.second << " images)";
+    }
+    CURFIL_INFO(o.str());
+}
+
+std::vector<LabeledRGBDImage> loadImages(const std::string& folder, bool useCIELab, bool useDepthFilling,
+        int integralPadding, int pyramidLevel, const std::string& cacheFolder, bool mapImages,
+        bool interleaveColor, float compactRegionSize) {
 
-    std::vector<std::string> filenames = listImageFilenames(folder);
+    const DatasetManifest manifest = DatasetManifest::load(folder);
+    std::vector<std::string> filenames = listImageFilenames(folder, manifest);
     CURFIL_INFO("going to load " << filenames.size() << " images from " << folder);
+    if (!cacheFolder.empty()) {
+        CURFIL_INFO("using image cache in " << cacheFolder << (mapImages ? " (memory-mapped)" : ""));
+    }
 
     size_t totalSizeInMemory = 0;
 
@@ -761,7 +1886,8 @@ std::vector<LabeledRGBDImage> loadImages(const std::string& folder, bool useCIEL
                 for(size_t i = range.begin(); i != range.end(); i++) {
 
                     const auto& filename = filenames[i];
-                    images[i] = loadImagePair(filename, useCIELab, useDepthFilling);
+                    images[i] = loadImagePair(filename, useCIELab, useDepthFilling, true, integralPadding,
+                            pyramidLevel, cacheFolder, mapImages, interleaveColor, compactRegionSize, manifest);
                     {
                         tbb::mutex::scoped_lock lock(imageCounterMutex);
                         if (++numImages % 50 == 0) {
@@ -773,27 +1899,7 @@ std::vector<LabeledRGBDImage> loadImages(const std::string& folder, bool useCIEL
                 }
             });
 
-    if (!images.empty()) {
-        int imageWidth = images[0].getWidth();
-        int imageHeight = images[0].getHeight();
-        size_t imageSizeInMemory = images[0].getSizeInMemory();
-        for (const LabeledRGBDImage& image : images) {
-            if (image.getWidth() != imageWidth || image.getHeight() != imageHeight) {
-                std::ostringstream o;
-                o << "Image " << image.getRGBDImage().getFilename() << " has different size: ";
-                o << image.getWidth() << "x" << image.getHeight();
-                o << ". All images in the dataset must have the same size (" << imageWidth << "x" << imageHeight << ")";
-                throw std::runtime_error(o.str());
-            }
-            if (image.getSizeInMemory() != imageSizeInMemory) {
-                std::ostringstream o;
-                o << "Image " << image.getRGBDImage().getFilename() << " has different size in memory: ";
-                o << image.getSizeInMemory() << " (expected: " << imageSizeInMemory << ").";
-                o << " This must not happen.";
-                throw std::runtime_error(o.str());
-            }
-        }
-    }
+    logImageSizes(images);
 
     CURFIL_INFO("finished loading " << images.size() << " images. size in memory: "
             << (boost::format("%.2f MB") % (totalSizeInMemory / static_cast<double>(1024 * 1024))).str());
@@ -801,4 +1907,84 @@ std::vector<LabeledRGBDImage> loadImages(const std::string& folder, bool useCIEL
     return images;
 }
 
+std::vector<LabeledRGBDImage> loadLabelImages(const std::string& folder, bool useDepthFilling, int pyramidLevel) {
+
+    const DatasetManifest manifest = DatasetManifest::load(folder);
+    std::vector<std::string> filenames = listImageFilenames(folder, manifest);
+    CURFIL_INFO("going to load labels and depth of " << filenames.size() << " images from " << folder);
+
+    utils::Timer timer;
+
+    std::vector<LabeledRGBDImage> images(filenames.size());
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, images.size()),
+            [&](const tbb::blocked_range<size_t>& range) {
+                for(size_t i = range.begin(); i != range.end(); i++) {
+                    const std::string depthFilename = manifest.getDepthFilename(filenames[i]);
+                    const std::string labelFilename = manifest.getLabelFilename(filenames[i]);
+
+                    DecodedImage depth;
+                    DecodedImage label;
+                    tbb::parallel_invoke(
+                            [&]() {depth = decodeImage(depthFilename, manifest.getDepthFormat());},
+                            [&]() {label = decodeImage(labelFilename, manifest.getLabelFormat());});
+
+                    // the same depth preprocessing as in loadImagePair()
+                    const auto rgbdImage = boost::make_shared<RGBDImage>(filenames[i], depthFilename, nullptr,
+                            depth, false, useDepthFilling, pyramidLevel == 0);
+                    const auto labelImage = boost::make_shared<LabelImage>(labelFilename, label);
+                    if (pyramidLevel > 0) {
+                        rgbdImage->downsample(pyramidLevel);
+                        labelImage->downsample(pyramidLevel);
+                        rgbdImage->calculateIntegral();
+                    }
+                    images[i] = LabeledRGBDImage(rgbdImage, labelImage);
+                }
+            });
+
+    logImageSizes(images);
+
+    CURFIL_INFO("loaded labels and depth of " << images.size() << " images in " << timer.format(2));
+
+    return images;
+}
+
+void loadColorImages(std::vector<LabeledRGBDImage>& images, const std::vector<size_t>& imageNrs,
+        bool useCIELab, bool useDepthFilling, int integralPadding, int pyramidLevel,
+        const std::string& cacheFolder, bool mapImages, bool interleaveColor, float compactRegionSize,
+        const DatasetManifest& manifest) {
+
+    std::vector<size_t> missingImageNrs;
+    for (const size_t imageNr : imageNrs) {
+        if (!images.at(imageNr).getRGBDImage().hasColorImage()) {
+            missingImageNrs.push_back(imageNr);
+        }
+    }
+    // an image must not be loaded twice in parallel
+    std::sort(missingImageNrs.begin(), missingImageNrs.end());
+    missingImageNrs.erase(std::unique(missingImageNrs.begin(), missingImageNrs.end()), missingImageNrs.end());
+
+    CURFIL_INFO("going to load the color images of " << missingImageNrs.size() << " out of " << images.size()
+            << " images");
+
+    utils::Timer timer;
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, missingImageNrs.size()),
+            [&](const tbb::blocked_range<size_t>& range) {
+                for(size_t i = range.begin(); i != range.end(); i++) {
+                    RGBDImage& image = *images[missingImageNrs[i]].rgbdImage;
+                    LabeledRGBDImage loadedImage = loadImagePair(image.getFilename(), useCIELab, useDepthFilling,
+                            true, integralPadding, pyramidLevel, cacheFolder, mapImages, interleaveColor,
+                            compactRegionSize, manifest);
+                    if (loadedImage.getWidth() != image.getWidth() || loadedImage.getHeight() != image.getHeight()) {
+                        throw std::runtime_error((boost::format("size of image %s changed between the loading passes")
+                                % image.getFilename()).str());
+                    }
+                    image.swap(*loadedImage.rgbdImage);
+                }
+            });
+
+    CURFIL_INFO("loaded " << missingImageNrs.size() << " color images in " << timer.format(2));
+}
+
 }
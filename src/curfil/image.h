@@ -9,8 +9,10 @@
 #include <ostream>
 #include <stdint.h>
 #include <string>
+#include <type_traits>
 #include <vector>
 
+#include "image_codec.h"
 #include "utils.h"
 
 namespace curfil {
@@ -44,6 +46,21 @@ LabelType getOrAddColorId(const RGBColor& color, const LabelType& label);
 
 void addColorId(const RGBColor& color, const LabelType& label);
 
+/**
+ * Removes all label colors such that test cases do not depend on each other.
+ * Must not be called while label images are loaded or saved.
+ */
+void clearColorIds();
+
+/**
+ * Converts an 8-bit RGB image to CIELab in single precision (in parallel over the rows).
+ * The result equals the conversion with vigra::RGB2LabFunctor<double> up to an absolute error of 1e-3.
+ *
+ * @param rgb the interleaved RGB values of the image, row by row
+ * @param lab the L, a and b planes of the converted image (3 x height x width)
+ */
+void convertRGB2CIELab(const uint8_t* rgb, int width, int height, float* lab);
+
 class Depth
 {
 public:
@@ -101,6 +118,44 @@ private:
     int value;
 };
 
+/**
+ * Storage of the integral images of an RGBDImage. see RGBDImage::calculateCompactIntegral()
+ */
+enum IntegralStorage {
+    FLOAT_INTEGRALS = 0, // float color, int depth and int valid counts. the only storage the GPU can use
+    COMPACT_INTEGRALS = 1, // fixed-point uint32 color, uint32 depth and uint16 valid counts
+    WIDE_INTEGRALS = 2 // fixed-point uint64 color, uint64 depth and uint32 valid counts
+};
+
+/**
+ * Element types of the compact integral images.
+ *
+ * The color (in fixed point, see RGBDImage::COLOR_SCALE) and the depth in millimeters are integrated in 'Value',
+ * the valid depth values are counted in 'Count'. The integrals wrap around. The sum of a region, the difference of
+ * its four corner values in the same type, is still exact as long as it fits into the type.
+ */
+template<class ValueType, class CountType, IntegralStorage storage>
+struct CompactIntegralFormat {
+    typedef ValueType Value;
+    typedef CountType Count;
+    // color sums can be negative (CIELab)
+    typedef typename std::make_signed<ValueType>::type SignedValue;
+
+    static const IntegralStorage STORAGE = storage;
+
+    static Value regionSum(Value upperLeft, Value upperRight, Value lowerLeft, Value lowerRight) {
+        return static_cast<Value>((lowerRight - upperRight) + (upperLeft - lowerLeft));
+    }
+
+    static Count regionCount(Count upperLeft, Count upperRight, Count lowerLeft, Count lowerRight) {
+        return static_cast<Count>((lowerRight - upperRight) + (upperLeft - lowerLeft));
+    }
+};
+
+// exact if no feature region covers 2^16 pixels or more. see RGBDImage::calculateCompactIntegral()
+typedef CompactIntegralFormat<uint32_t, uint16_t, COMPACT_INTEGRALS> CompactFormat;
+typedef CompactIntegralFormat<uint64_t, uint32_t, WIDE_INTEGRALS> WideFormat;
+
 class RGBDImage {
 
 private:
@@ -112,14 +167,39 @@ private:
     cuv::ndarray<float, cuv::host_memory_space> colorImage;
     cuv::ndarray<int, cuv::host_memory_space> depthImage;
 
+    // the compact integral images replace colorImage and depthImage. the three color planes and the depth plane
+    // are stored in the value type of the format, the valid counts in its count type. see CompactIntegralFormat
+    std::vector<uint16_t> integrals16;
+    std::vector<uint32_t> integrals32;
+    std::vector<uint64_t> integrals64;
+
     bool inCIELab;
     bool integratedColor;
     bool integratedDepth;
+    // color stored per pixel ([y][x][channel]) instead of per channel ([channel][y][x])
+    bool interleavedColor;
+    IntegralStorage integralStorage;
+
+    // border of the padded integral images on each side
+    int padding;
+    // zero inside of the image and NaN in the border. indexed with x + padding and y + padding
+    std::vector<float> columnSentinels;
+    std::vector<float> rowSentinels;
+
+    // keeps the memory-mapped file alive if the integral images are views of it
+    boost::shared_ptr<void> mappedFile;
 
     static const unsigned int COLOR_CHANNELS = 3;
     static const unsigned int DEPTH_CHANNELS = 2;
+    // the interleaved color of a pixel is padded to 16 bytes
+    static const unsigned int INTERLEAVED_COLOR_CHANNELS = 4;
 
-    void loadDepthImage(const std::string& depthFilename);
+    void load(const DecodedImage* color, const DecodedImage& depth, bool convertToCIELab, bool useDepthFilling,
+            bool calculateIntegralImage);
+
+    void loadColorImage(const DecodedImage& image, bool convertToCIELab);
+
+    void loadDepthImage(const DecodedImage& image);
 
     void fillDepthFromRight();
     void fillDepthFromLeft();
@@ -129,17 +209,31 @@ private:
     template<class T>
     static void calculateDerivative(cuv::ndarray_view<T, cuv::host_memory_space>& data);
 
-    template<class T>
-    static void calculateIntegral(cuv::ndarray_view<T, cuv::host_memory_space>& data);
-
+    static void calculateIntegral(cuv::ndarray_view<int, cuv::host_memory_space>& data);
     static void calculateIntegral(cuv::ndarray_view<float, cuv::host_memory_space>& data);
     static void calculateDerivative(cuv::ndarray_view<float, cuv::host_memory_space>& data);
 
+    // sets the padding of the integral images and the sentinels of the border
+    void setPadding(int padding);
+
 public:
 
+    /**
+     * @param loadColor if false, only the depth image is loaded. The image then has no color image until it is
+     * replaced by a completely loaded image (see swap() and loadColorImages()).
+     */
     explicit RGBDImage(const std::string& filename, const std::string& depthFilename,
             bool convertToCIELab = true,
             bool useDepthFilling = false,
+            bool calculateIntegralImage = true,
+            bool loadColor = true);
+
+    /**
+     * Creates an image from the decoded color and depth files, e.g. decoded in parallel by loadImagePair().
+     * @param color the decoded color image or null if only the depth image is loaded
+     */
+    explicit RGBDImage(const std::string& filename, const std::string& depthFilename, const DecodedImage* color,
+            const DecodedImage& depth, bool convertToCIELab = true, bool useDepthFilling = false,
             bool calculateIntegralImage = true);
 
     // for the test case
@@ -148,15 +242,41 @@ public:
                     width(width), height(height),
                     colorImage(cuv::extents[COLOR_CHANNELS][height][width], boost::make_shared<cuv::cuda_allocator>()),
                     depthImage(cuv::extents[DEPTH_CHANNELS][height][width], boost::make_shared<cuv::cuda_allocator>()),
-                    inCIELab(false), integratedColor(false), integratedDepth(false) {
+                    integrals16(), integrals32(), integrals64(),
+                    inCIELab(false), integratedColor(false), integratedDepth(false), interleavedColor(false),
+                    integralStorage(FLOAT_INTEGRALS), padding(0), columnSentinels(), rowSentinels() {
         assert(width >= 0 && height >= 0);
         reset();
     }
 
+    /**
+     * Creates an integrated image from its integral images, e.g. from the binary image cache.
+     * The planes are copied. 'colorIntegral' holds three color channels and 'depthIntegral' the depth and
+     * valid-depth channels, each channel with height × width values.
+     */
+    explicit RGBDImage(const std::string& filename, const std::string& depthFilename, int width, int height,
+            bool inCIELab, const float* colorIntegral, const int* depthIntegral);
+
+    /**
+     * Creates an integrated image whose integral images are views of a memory-mapped file.
+     * The planes are not copied. The operating system pages them in on access and can evict them under memory
+     * pressure, such that datasets larger than the RAM can be used for training.
+     * 'mappedFile' is kept alive as long as the image uses the planes.
+     */
+    explicit RGBDImage(const std::string& filename, const std::string& depthFilename, int width, int height,
+            bool inCIELab, float* colorIntegral, int* depthIntegral, const boost::shared_ptr<void>& mappedFile);
+
     RGBDImage(const RGBDImage& other);
 
+    /**
+     * Exchanges the content of both images. Pointers to the images stay valid.
+     */
+    void swap(RGBDImage& other);
+
     size_t getSizeInMemory() const {
-        return colorImage.size() * sizeof(float) + depthImage.size() * sizeof(int);
+        return colorImage.size() * sizeof(float) + depthImage.size() * sizeof(int)
+                + integrals16.size() * sizeof(uint16_t) + integrals32.size() * sizeof(uint32_t)
+                + integrals64.size() * sizeof(uint64_t);
     }
 
     /**
@@ -167,6 +287,10 @@ public:
 
     void reset();
 
+    /**
+     * @return the color channels with the shape channels × (padded) height × (padded) width,
+     * or (padded) height × (padded) width × 4 if the color is interleaved
+     */
     const cuv::ndarray<float, cuv::host_memory_space>& getColorImage() const {
         return colorImage;
     }
@@ -179,6 +303,104 @@ public:
     void calculateDerivative();
     void calculateIntegral();
 
+    /**
+     * The color is stored in the compact integral images in fixed point with this many steps per color unit,
+     * i.e. 8 fractional bits. 8-bit RGB values are exact, CIELab values are rounded to 1/256.
+     */
+    static const int COLOR_SCALE = 256;
+
+    /**
+     * Calculates compact integral images instead of calculateIntegral() and releases the float color and
+     * int depth images.
+     *
+     * The format is chosen per image from the largest feature region it can be asked for. The region of a
+     * feature is normalized by the depth of the pixel, so the bound is 'maxRegionSize' divided by the smallest
+     * valid depth of the image (in meters), and a region never covers more pixels than the image.
+     * If such a region covers fewer than 2^16 pixels and its color and depth sums fit into 32 bits, the image
+     * uses CompactFormat, otherwise WideFormat. Both give exact region sums; the depth responses equal the
+     * ones of the float integral images, the color responses differ by the rounding to COLOR_SCALE.
+     * With 640x480 images and a regionSize of 16, every image whose closest pixel is farther than about
+     * 20 cm away is compact and takes 18 instead of 20 bytes per pixel.
+     *
+     * Compact images can be padded, but cannot be derived, interleaved, saved, cached or uploaded to the GPU.
+     *
+     * @param maxRegionSize the largest region size of a feature at a depth of one meter, i.e. the regionSize of
+     * the training configuration times the largest scale of the augmentation
+     */
+    void calculateCompactIntegral(float maxRegionSize);
+
+    IntegralStorage getIntegralStorage() const {
+        return integralStorage;
+    }
+
+    /**
+     * @return true if the image has compact integral images. see calculateCompactIntegral()
+     */
+    bool isCompact() const {
+        return integralStorage != FLOAT_INTEGRALS;
+    }
+
+    /**
+     * Adds a border of the given size on each side of the integral images.
+     *
+     * The color border is NaN such that regions that reach out of the image have a NaN color response.
+     * Out-of-image depth regions, and color regions of compact images, are detected with getBorderSentinel().
+     * With a padding of at least boxRadius + regionSize, the feature responses of pixels with a depth of at least one
+     * meter can be calculated without bounds checks. Closer pixels fall back to the bounds-checked calculation.
+     * A padded image can no longer be derived or filled.
+     */
+    void padIntegralImages(int padding);
+
+    /**
+     * Reduces the resolution of the (not yet integrated) image by a factor of 2^level in both dimensions.
+     *
+     * A pixel of the downsampled image is the mean color of its block of the original image
+     * and the mean of the valid depths of the block. It has invalid depth if no depth in the block is valid.
+     * Pixels in the last rows and columns that do not fill a complete block are dropped.
+     */
+    void downsample(int level);
+
+    /**
+     * Changes the layout of the color integral images from one plane per channel to one group of four floats
+     * per pixel ([y][x][channel], the fourth float is unused).
+     *
+     * A color feature reads the corners of two regions, often of different channels. In the planar layout these
+     * are up to eight cache lines in different planes; in the interleaved layout both channels of a corner share
+     * one cache line. The color takes 4/3 of the memory. The depth integral images keep their planar layout.
+     *
+     * Interleaving must be the last step of the preprocessing, i.e. after padding.
+     * Interleaved images cannot be integrated, derived, padded or uploaded to the GPU.
+     */
+    void interleaveColorImage();
+
+    /**
+     * @return true if the color integral images have the per-pixel layout. see interleaveColorImage()
+     */
+    bool isColorInterleaved() const {
+        return interleavedColor;
+    }
+
+    int getPadding() const {
+        return padding;
+    }
+
+    /**
+     * @return true if the integral images are views of a memory-mapped file
+     */
+    bool isMapped() const {
+        return static_cast<bool>(mappedFile);
+    }
+
+    /**
+     * @return zero if x and y are in the image, NaN if x or y is in the border of the padded image
+     */
+    float getBorderSentinel(int x, int y) const {
+        assert(padding > 0);
+        assert(x >= -padding && x < getWidth() + padding);
+        assert(y >= -padding && y < getHeight() + padding);
+        return columnSentinels[x + padding] + rowSentinels[y + padding];
+    }
+
     void dump(std::ostream& out) const;
     void dumpDepth(std::ostream& out) const;
     void dumpDepthValid(std::ostream& out) const;
@@ -207,6 +429,13 @@ public:
         return integratedColor;
     }
 
+    /**
+     * @return false if only the depth image was loaded
+     */
+    bool hasColorImage() const {
+        return isCompact() || (colorImage.ptr() != NULL && colorImage.size() > 0);
+    }
+
     bool inImage(int x, int y) const {
         if (x < 0 || x >= getWidth()) {
             return false;
@@ -219,32 +448,105 @@ public:
 
     void setDepth(int x, int y, const Depth& depth) {
         assert(inImage(x, y));
+        assert(!isCompact());
 
         // invalid depth is set to zero which is necessary for integrating
-        depthImage(0, y, x) = depth.isValid() ? depth.getIntValue() : 0;
-        depthImage(1, y, x) = depth.isValid();
+        depthImage(0, y + padding, x + padding) = depth.isValid() ? depth.getIntValue() : 0;
+        depthImage(1, y + padding, x + padding) = depth.isValid();
     }
 
     Depth getDepth(int x, int y) const {
-        return Depth(static_cast<int>(depthImage(0, y, x)));
+        assert(!isCompact());
+        return Depth(static_cast<int>(depthImage(0, y + padding, x + padding)));
+    }
+
+    /**
+     * @return the integral of the depth in millimeters, modulo 2^32.
+     * The depth integral of large images (e.g. 4K frames) exceeds the range of int. The depth sum of a region,
+     * the difference of four integral values in unsigned arithmetic, is exact as long as it is below 2^31.
+     */
+    uint32_t getDepthIntegral(int x, int y) const {
+        assert(integratedDepth);
+        assert(!isCompact());
+        return static_cast<uint32_t>(depthImage(0, y + padding, x + padding));
     }
 
     int getDepthValid(int x, int y) const {
-        return depthImage(1, y, x);
+        assert(!isCompact());
+        return depthImage(1, y + padding, x + padding);
     }
 
     void setColor(int x, int y, unsigned int channel, float color) {
-        // colorImage(channel, y, x) = color;
-        colorImage.ptr()[channel * getWidth() * getHeight() + y * getWidth() + x] = color;
+        assert(!isCompact());
+        // colorImage(channel, y + padding, x + padding) = color;
+        colorImage.ptr()[pixelIndex(x, y, channel)] = color;
     }
 
     float getColor(int x, int y, unsigned int channel) const {
-        // return colorImage(channel, y, x);
-        return colorImage.ptr()[channel * getWidth() * getHeight() + y * getWidth() + x];
+        assert(!isCompact());
+        // return colorImage(channel, y + padding, x + padding);
+        return colorImage.ptr()[pixelIndex(x, y, channel)];
+    }
+
+    // the compact integral of the color channel in fixed point. see calculateCompactIntegral()
+    template<class Format>
+    typename Format::Value getCompactColor(int x, int y, unsigned int channel) const {
+        assert(integralStorage == Format::STORAGE);
+        assert(channel < COLOR_CHANNELS);
+        return getCompactPlanes<typename Format::Value>()[compactIndex(x, y, channel)];
+    }
+
+    // the compact integral of the depth in millimeters
+    template<class Format>
+    typename Format::Value getCompactDepth(int x, int y) const {
+        assert(integralStorage == Format::STORAGE);
+        return getCompactPlanes<typename Format::Value>()[compactIndex(x, y, COLOR_CHANNELS)];
+    }
+
+    // the compact integral of the number of valid depth values
+    template<class Format>
+    typename Format::Count getCompactValid(int x, int y) const {
+        assert(integralStorage == Format::STORAGE);
+        return getCompactPlanes<typename Format::Count>()[compactIndex(x, y, 0)];
+    }
+
+private:
+
+    template<class T>
+    const std::vector<T>& getCompactPlanes() const;
+
+    size_t compactIndex(int x, int y, unsigned int plane) const {
+        const size_t paddedWidth = getWidth() + 2 * padding;
+        const size_t paddedHeight = getHeight() + 2 * padding;
+        return (plane * paddedHeight + y + padding) * paddedWidth + x + padding;
+    }
+
+    size_t pixelIndex(int x, int y, unsigned int channel) const {
+        const size_t paddedWidth = getWidth() + 2 * padding;
+        if (interleavedColor) {
+            return ((y + padding) * paddedWidth + x + padding) * INTERLEAVED_COLOR_CHANNELS + channel;
+        }
+        const size_t paddedHeight = getHeight() + 2 * padding;
+        return (channel * paddedHeight + y + padding) * paddedWidth + x + padding;
     }
 
 };
 
+template<>
+inline const std::vector<uint16_t>& RGBDImage::getCompactPlanes<uint16_t>() const {
+    return integrals16;
+}
+
+template<>
+inline const std::vector<uint32_t>& RGBDImage::getCompactPlanes<uint32_t>() const {
+    return integrals32;
+}
+
+template<>
+inline const std::vector<uint64_t>& RGBDImage::getCompactPlanes<uint64_t>() const {
+    return integrals64;
+}
+
 class LabelImage {
 
 private:
@@ -254,6 +556,8 @@ private:
     int height;
     cuv::ndarray<LabelType, cuv::host_memory_space> image;
 
+    void load(const DecodedImage& labelImage);
+
 public:
 
     LabelImage(int width, int height) :
@@ -269,6 +573,11 @@ public:
 
     LabelImage(const std::string& filename);
 
+    /**
+     * Creates the label image from the decoded file 'filename', which must have 8-bit RGB pixels.
+     */
+    LabelImage(const std::string& filename, const DecodedImage& labelImage);
+
     const std::string& getFilename() const {
         return filename;
     }
@@ -284,6 +593,19 @@ public:
 
     void save(const std::string& filename) const;
 
+    /**
+     * Reduces the resolution by a factor of 2^level in both dimensions.
+     * A pixel of the downsampled image takes the most frequent label of its block.
+     * see RGBDImage::downsample()
+     */
+    void downsample(int level);
+
+    /**
+     * @return the label image with the given size where every pixel takes the label of the pixel
+     * of this image that covers it at a resolution of 2^level times this image
+     */
+    LabelImage upsample(int level, int width, int height) const;
+
     static RGBColor decodeLabel(const LabelType& v);
 
     size_t getSizeInMemory() const {
@@ -348,12 +670,73 @@ public:
 
 };
 
+/**
+ * @param integralPadding if greater than zero, the integral images are padded with a border of this size.
+ * see RGBDImage::padIntegralImages()
+ * @param pyramidLevel if greater than zero, the images are downsampled by 2^pyramidLevel before the integral images
+ * are calculated. see RGBDImage::downsample()
+ * @param cacheFolder if not empty and the integral images are calculated, the preprocessed image is read from the
+ * binary image cache in this folder. Missing or outdated cache files are (re-)written.
+ * see getImageCacheFilename()
+ * @param mapImages if true, the integral images are not copied from the cache file but memory-mapped.
+ * requires a cache folder and cannot be combined with padding. see RGBDImage::isMapped()
+ * @param interleaveColor if true, the color integral images are stored per pixel for faster feature evaluation
+ * on CPU. requires integral images and cannot be combined with mapping. see RGBDImage::interleaveColorImage()
+ * @param compactRegionSize if greater than zero, compact integral images are calculated for features with regions
+ * up to this size at a depth of one meter. requires integral images and cannot be combined with the cache or
+ * interleaving. see RGBDImage::calculateCompactIntegral()
+ * @param manifest the naming and formats of the depth and label images of the color image 'filename'.
+ * The three files of the pair are decoded in parallel.
+ */
 LabeledRGBDImage loadImagePair(const std::string& filename, bool useCIELab, bool useDepthFilling,
-        bool calculateIntegralImages = true);
-
-std::vector<std::string> listImageFilenames(const std::string& path);
-
-std::vector<LabeledRGBDImage> loadImages(const std::string& folder, bool useCIELab, bool useDepthFilling);
+        bool calculateIntegralImages = true, int integralPadding = 0, int pyramidLevel = 0,
+        const std::string& cacheFolder = "", bool mapImages = false, bool interleaveColor = false,
+        float compactRegionSize = 0, const DatasetManifest& manifest = DatasetManifest());
+
+/**
+ * The binary image cache stores one file per image with the unpadded integral images, the labels and the
+ * preprocessing parameters (CIELab, depth filling, pyramid level).
+ * A cache file is memory-mapped and copied without any decoding. It is ignored and rewritten if the parameters
+ * differ or if a source image changed: the size must match, and the content hash must match if the
+ * modification time differs.
+ *
+ * @return the name of the cache file of the color image 'filename'
+ */
+std::string getImageCacheFilename(const std::string& cacheFolder, const std::string& filename);
+
+/**
+ * @return the sorted filenames of the color images in the folder and its subfolders
+ */
+std::vector<std::string> listImageFilenames(const std::string& path,
+        const DatasetManifest& manifest = DatasetManifest());
+
+/**
+ * Loads all image pairs in the folder with the naming and formats of its manifest. see DatasetManifest::load()
+ */
+std::vector<LabeledRGBDImage> loadImages(const std::string& folder, bool useCIELab, bool useDepthFilling,
+        int integralPadding = 0, int pyramidLevel = 0, const std::string& cacheFolder = "", bool mapImages = false,
+        bool interleaveColor = false, float compactRegionSize = 0);
+
+/**
+ * First pass of the two-pass loading of a training dataset.
+ * Loads the labels and the integrated depth of all images in the folder but not the color images,
+ * which is enough to build the dataset index and to draw the training samples.
+ * see loadColorImages()
+ */
+std::vector<LabeledRGBDImage> loadLabelImages(const std::string& folder, bool useDepthFilling,
+        int pyramidLevel = 0);
+
+/**
+ * Second pass of the two-pass loading: completely loads the images 'imageNrs' of loadLabelImages() in place.
+ * The RGBDImage objects are kept such that pointers to them, e.g. in training samples, stay valid.
+ * Images that already have a color image are skipped.
+ * The parameters are the ones of loadImages() and must match the first pass.
+ * 'manifest' is the manifest of the dataset folder. see DatasetManifest::load()
+ */
+void loadColorImages(std::vector<LabeledRGBDImage>& images, const std::vector<size_t>& imageNrs,
+        bool useCIELab, bool useDepthFilling, int integralPadding = 0, int pyramidLevel = 0,
+        const std::string& cacheFolder = "", bool mapImages = false, bool interleaveColor = false,
+        float compactRegionSize = 0, const DatasetManifest& manifest = DatasetManifest());
 
 }
 
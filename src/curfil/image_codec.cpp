@@ -0,0 +1,461 @@
+#include "image_codec.h"
+
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <cassert>
+#include <cctype>
+#include <map>
+#include <stdexcept>
+#include <tbb/mutex.h>
+#include <vigra/basicimageview.hxx>
+#include <vigra/impex.hxx>
+
+#include "utils.h"
+
+namespace fs = boost::filesystem;
+
+namespace curfil {
+
+DecodedImage::DecodedImage(int width, int height, int channels, int bytesPerSample, const uint8_t* data,
+        const boost::shared_ptr<const void>& storage, bool mapped) :
+        width(width), height(height), channels(channels), bytesPerSample(bytesPerSample),
+                data(data), storage(storage), mapped(mapped) {
+    assert(width >= 0 && height >= 0);
+    assert(bytesPerSample == 1 || bytesPerSample == 2);
+}
+
+DecodedImage::DecodedImage(int width, int height, int channels, int bytesPerSample,
+        const boost::shared_ptr<std::vector<uint8_t> >& buffer) :
+        width(width), height(height), channels(channels), bytesPerSample(bytesPerSample),
+                data(buffer->data()), storage(buffer), mapped(false) {
+    assert(width >= 0 && height >= 0);
+    assert(bytesPerSample == 1 || bytesPerSample == 2);
+    assert(buffer->size() == getNumSamples() * bytesPerSample);
+}
+
+std::string ImageFileFormat::getCodec(const std::string& filename) const {
+    if (!codec.empty()) {
+        return codec;
+    }
+    return getImageCodecName(filename);
+}
+
+void ImageFileFormat::setRawLayout(int width, int height, int channels, int bytesPerSample) {
+    if (width <= 0 || height <= 0 || channels <= 0 || (bytesPerSample != 1 && bytesPerSample != 2)) {
+        throw std::runtime_error((boost::format("illegal raw image layout: %dx%d, %d channels, %d bytes per sample")
+                % width % height % channels % bytesPerSample).str());
+    }
+    this->width = width;
+    this->height = height;
+    this->channels = channels;
+    this->bytesPerSample = bytesPerSample;
+}
+
+static bool isLittleEndian() {
+    const uint16_t one = 1;
+    return *reinterpret_cast<const uint8_t*>(&one) == 1;
+}
+
+static boost::shared_ptr<boost::iostreams::mapped_file_source> mapFile(const std::string& filename) {
+    if (fs::file_size(filename) == 0) {
+        throw std::runtime_error("empty file");
+    }
+    return boost::make_shared<boost::iostreams::mapped_file_source>(filename);
+}
+
+/**
+ * @return a view of the samples in the mapped file if they are in host byte order, a byte-swapped copy otherwise
+ */
+static DecodedImage mappedImage(const boost::shared_ptr<boost::iostreams::mapped_file_source>& file, size_t offset,
+        int width, int height, int channels, int bytesPerSample, bool littleEndian) {
+
+    const size_t numBytes = static_cast<size_t>(width) * height * channels * bytesPerSample;
+    if (file->size() < offset + numBytes) {
+        throw std::runtime_error((boost::format("truncated file: %d bytes, expected %d")
+                % file->size() % (offset + numBytes)).str());
+    }
+
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(file->data()) + offset;
+    if (bytesPerSample == 1 || littleEndian == isLittleEndian()) {
+        return DecodedImage(width, height, channels, bytesPerSample, data, file, true);
+    }
+
+    const auto buffer = boost::make_shared<std::vector<uint8_t> >(numBytes);
+    for (size_t i = 0; i < numBytes; i += 2) {
+        (*buffer)[i] = data[i + 1];
+        (*buffer)[i + 1] = data[i];
+    }
+    return DecodedImage(width, height, channels, bytesPerSample, buffer);
+}
+
+static_assert(sizeof(vigra::RGBValue<vigra::UInt8>) == 3, "RGB pixels are not packed");
+static_assert(sizeof(vigra::RGBValue<vigra::UInt16>) == 6, "RGB pixels are not packed");
+
+class VigraCodec: public ImageCodec {
+
+public:
+
+    virtual DecodedImage decode(const std::string& filename, const ImageFileFormat&) const {
+        vigra::ImageImportInfo info(filename.c_str());
+
+        const int width = info.width();
+        const int height = info.height();
+        const int channels = info.numBands();
+        // other pixel types than UINT8 are imported as 16-bit samples
+        const int bytesPerSample = (std::string(info.getPixelType()) == "UINT8") ? 1 : 2;
+
+        const auto buffer = boost::make_shared<std::vector<uint8_t> >(
+                static_cast<size_t>(width) * height * channels * bytesPerSample);
+
+        if (channels == 1 && bytesPerSample == 1) {
+            importImage<vigra::UInt8>(info, buffer->data());
+        } else if (channels == 1) {
+            importImage<vigra::UInt16>(info, buffer->data());
+        } else if (channels == 3 && bytesPerSample == 1) {
+            importImage<vigra::RGBValue<vigra::UInt8> >(info, buffer->data());
+        } else if (channels == 3) {
+            importImage<vigra::RGBValue<vigra::UInt16> >(info, buffer->data());
+        } else {
+            throw std::runtime_error((boost::format("unsupported number of bands: %d") % channels).str());
+        }
+
+        return DecodedImage(width, height, channels, bytesPerSample, buffer);
+    }
+
+private:
+
+    template<class PixelType>
+    static void importImage(const vigra::ImageImportInfo& info, uint8_t* data) {
+        vigra::BasicImageView<PixelType> view(reinterpret_cast<PixelType*>(data), info.width(), info.height());
+        vigra::importImage(info, vigra::destImage(view));
+    }
+
+};
+
+class PnmCodec: public ImageCodec {
+
+public:
+
+    virtual DecodedImage decode(const std::string& filename, const ImageFileFormat&) const {
+        const auto file = mapFile(filename);
+        const char* data = file->data();
+        const size_t size = file->size();
+
+        if (size < 2 || data[0] != 'P' || (data[1] != '5' && data[1] != '6')) {
+            throw std::runtime_error("not a binary PGM (P5) or PPM (P6) file");
+        }
+        const int channels = (data[1] == '5') ? 1 : 3;
+
+        size_t pos = 2;
+        const int width = readNumber(data, size, pos);
+        const int height = readNumber(data, size, pos);
+        const int maxValue = readNumber(data, size, pos);
+        if (maxValue <= 0 || maxValue > 0xFFFF) {
+            throw std::runtime_error((boost::format("illegal maximum value: %d") % maxValue).str());
+        }
+        // a single whitespace separates the header from the pixels
+        pos++;
+
+        // 16-bit samples are big-endian
+        return mappedImage(file, pos, width, height, channels, (maxValue < 0x100) ? 1 : 2, false);
+    }
+
+private:
+
+    static int readNumber(const char* data, size_t size, size_t& pos) {
+        while (pos < size && (std::isspace(static_cast<unsigned char>(data[pos])) || data[pos] == '#')) {
+            if (data[pos] == '#') {
+                while (pos < size && data[pos] != '\n') {
+                    pos++;
+                }
+            } else {
+                pos++;
+            }
+        }
+
+        if (pos >= size || !std::isdigit(static_cast<unsigned char>(data[pos]))) {
+            throw std::runtime_error("malformed header");
+        }
+
+        int number = 0;
+        while (pos < size && std::isdigit(static_cast<unsigned char>(data[pos]))) {
+            number = 10 * number + (data[pos++] - '0');
+            if (number > 0xFFFFFF) {
+                throw std::runtime_error("malformed header");
+            }
+        }
+        return number;
+    }
+
+};
+
+class NpyCodec: public ImageCodec {
+
+public:
+
+    virtual DecodedImage decode(const std::string& filename, const ImageFileFormat&) const {
+        const auto file = mapFile(filename);
+        const char* data = file->data();
+        const size_t size = file->size();
+
+        static const char MAGIC[] = "\x93NUMPY";
+        if (size < 10 || std::memcmp(data, MAGIC, 6) != 0) {
+            throw std::runtime_error("not a NumPy array file");
+        }
+
+        // version 1 has a 2-byte header length, versions 2 and 3 have a 4-byte header length
+        const uint8_t majorVersion = data[6];
+        size_t headerLength = static_cast<uint8_t>(data[8]) | (static_cast<uint8_t>(data[9]) << 8);
+        size_t offset = 10;
+        if (majorVersion >= 2) {
+            if (size < 12) {
+                throw std::runtime_error("truncated header");
+            }
+            headerLength |= (static_cast<size_t>(static_cast<uint8_t>(data[10])) << 16)
+                    | (static_cast<size_t>(static_cast<uint8_t>(data[11])) << 24);
+            offset = 12;
+        }
+        if (size < offset + headerLength) {
+            throw std::runtime_error("truncated header");
+        }
+        const std::string header(data + offset, headerLength);
+        offset += headerLength;
+
+        const std::string descr = getValue(header, "descr");
+        int bytesPerSample;
+        bool littleEndian = true;
+        if (descr == "'|u1'" || descr == "'<u1'" || descr == "'>u1'") {
+            bytesPerSample = 1;
+        } else if (descr == "'<u2'" || descr == "'>u2'") {
+            bytesPerSample = 2;
+            littleEndian = (descr[1] == '<');
+        } else {
+            throw std::runtime_error(std::string("unsupported data type: ") + descr + ". expected uint8 or uint16");
+        }
+
+        if (getValue(header, "fortran_order") != "False") {
+            throw std::runtime_error("arrays in Fortran order are not supported");
+        }
+
+        // e.g. "(480, 640)" or "(480, 640, 3)"
+        std::string shapeString = getValue(header, "shape");
+        boost::trim_if(shapeString, boost::is_any_of("() "));
+        std::vector<std::string> dimensions;
+        boost::split(dimensions, shapeString, boost::is_any_of(","), boost::token_compress_on);
+        dimensions.erase(std::remove(dimensions.begin(), dimensions.end(), ""), dimensions.end());
+        if (dimensions.size() != 2 && dimensions.size() != 3) {
+            throw std::runtime_error(std::string("unsupported shape: ") + getValue(header, "shape"));
+        }
+
+        std::vector<int> shape;
+        for (std::string dimension : dimensions) {
+            boost::trim(dimension);
+            shape.push_back(boost::lexical_cast<int>(dimension));
+        }
+        const int channels = (shape.size() == 3) ? shape[2] : 1;
+
+        return mappedImage(file, offset, shape[1], shape[0], channels, bytesPerSample, littleEndian);
+    }
+
+private:
+
+    // the value of the key in the header, a python dict literal such as
+    // {'descr': '<u2', 'fortran_order': False, 'shape': (480, 640), }
+    static std::string getValue(const std::string& header, const std::string& key) {
+        const std::string quotedKey = "'" + key + "':";
+        size_t begin = header.find(quotedKey);
+        if (begin == std::string::npos) {
+            throw std::runtime_error(std::string("header without ") + key);
+        }
+        begin = header.find_first_not_of(' ', begin + quotedKey.length());
+        if (begin == std::string::npos) {
+            throw std::runtime_error("malformed header");
+        }
+
+        // tuples contain commas
+        size_t end = (header[begin] == '(') ? header.find(')', begin) : header.find_first_of(",}", begin);
+        if (end == std::string::npos) {
+            throw std::runtime_error("malformed header");
+        }
+        if (header[begin] == '(') {
+            end++;
+        }
+        return boost::trim_copy(header.substr(begin, end - begin));
+    }
+
+};
+
+class RawCodec: public ImageCodec {
+
+public:
+
+    virtual DecodedImage decode(const std::string& filename, const ImageFileFormat& format) const {
+        if (format.getWidth() <= 0) {
+            throw std::runtime_error("the layout of raw images is not specified");
+        }
+
+        const auto file = mapFile(filename);
+        const size_t expectedSize = static_cast<size_t>(format.getWidth()) * format.getHeight()
+                * format.getChannels() * format.getBytesPerSample();
+        if (file->size() != expectedSize) {
+            throw std::runtime_error((boost::format("file size %d does not match the layout %dx%dx%d (%d bytes)")
+                    % file->size() % format.getWidth() % format.getHeight() % format.getChannels()
+                    % expectedSize).str());
+        }
+
+        return mappedImage(file, 0, format.getWidth(), format.getHeight(), format.getChannels(),
+                format.getBytesPerSample(), true);
+    }
+
+};
+
+typedef std::map<std::string, boost::shared_ptr<ImageCodec> > ImageCodecMap;
+
+static tbb::mutex imageCodecsMutex;
+
+static ImageCodecMap& imageCodecs() {
+    static ImageCodecMap codecs = [] {
+        ImageCodecMap c;
+        c["vigra"] = boost::make_shared<VigraCodec>();
+        c["pnm"] = boost::make_shared<PnmCodec>();
+        c["npy"] = boost::make_shared<NpyCodec>();
+        c["raw"] = boost::make_shared<RawCodec>();
+        return c;
+    }();
+    return codecs;
+}
+
+void registerImageCodec(const std::string& name, const boost::shared_ptr<ImageCodec>& codec) {
+    if (name.empty() || !codec) {
+        throw std::runtime_error("illegal image codec");
+    }
+    tbb::mutex::scoped_lock lock(imageCodecsMutex);
+    imageCodecs()[name] = codec;
+}
+
+std::string getImageCodecName(const std::string& filename) {
+    const std::string extension = boost::to_lower_copy(fs::extension(filename));
+    if (extension == ".pgm" || extension == ".ppm" || extension == ".pnm") {
+        return "pnm";
+    }
+    if (extension == ".npy") {
+        return "npy";
+    }
+    if (extension == ".raw") {
+        return "raw";
+    }
+    return "vigra";
+}
+
+DecodedImage decodeImage(const std::string& filename, const ImageFileFormat& format) {
+
+    const std::string name = format.getCodec(filename);
+
+    boost::shared_ptr<ImageCodec> codec;
+    {
+        tbb::mutex::scoped_lock lock(imageCodecsMutex);
+        const auto it = imageCodecs().find(name);
+        if (it == imageCodecs().end()) {
+            throw std::runtime_error((boost::format("unknown image codec '%s' for '%s'") % name % filename).str());
+        }
+        codec = it->second;
+    }
+
+    try {
+        return codec->decode(filename, format);
+    } catch (const std::exception& e) {
+        throw std::runtime_error((boost::format("failed to decode '%s' (codec '%s'): %s")
+                % filename % name % e.what()).str());
+    }
+}
+
+const std::string DatasetManifest::FILENAME = "dataset.json";
+
+DatasetManifest::DatasetManifest() :
+        colorFormat("_colors.png"), depthFormat("_depth.png"), labelFormat("_ground_truth.png") {
+}
+
+DatasetManifest::DatasetManifest(const ImageFileFormat& colorFormat, const ImageFileFormat& depthFormat,
+        const ImageFileFormat& labelFormat) :
+        colorFormat(colorFormat), depthFormat(depthFormat), labelFormat(labelFormat) {
+    if (colorFormat.getSuffix().empty() || depthFormat.getSuffix().empty() || labelFormat.getSuffix().empty()) {
+        throw std::runtime_error("the filename suffixes of a dataset must not be empty");
+    }
+    if (colorFormat.getSuffix() == depthFormat.getSuffix() || colorFormat.getSuffix() == labelFormat.getSuffix()
+            || depthFormat.getSuffix() == labelFormat.getSuffix()) {
+        throw std::runtime_error("the filename suffixes of a dataset must differ");
+    }
+}
+
+static ImageFileFormat readImageFileFormat(const boost::property_tree::ptree& pt, const std::string& key,
+        const ImageFileFormat& defaultFormat, int defaultChannels, int defaultBytesPerSample) {
+
+    const auto child = pt.get_child_optional(key);
+    if (!child) {
+        return defaultFormat;
+    }
+
+    ImageFileFormat format(child->get<std::string>("suffix", defaultFormat.getSuffix()),
+            child->get<std::string>("codec", ""));
+    if (format.getCodec(format.getSuffix()) == "raw") {
+        format.setRawLayout(child->get<int>("width"), child->get<int>("height"),
+                child->get<int>("channels", defaultChannels),
+                child->get<int>("bytesPerSample", defaultBytesPerSample));
+    }
+    return format;
+}
+
+DatasetManifest DatasetManifest::load(const std::string& folder) {
+
+    const fs::path filename = fs::path(folder) / FILENAME;
+    if (!fs::exists(filename)) {
+        return DatasetManifest();
+    }
+
+    try {
+        boost::property_tree::ptree pt;
+        boost::property_tree::read_json(filename.native(), pt);
+
+        const DatasetManifest defaultManifest;
+        const DatasetManifest manifest(
+                readImageFileFormat(pt, "color", defaultManifest.colorFormat, 3, 1),
+                readImageFileFormat(pt, "depth", defaultManifest.depthFormat, 1, 2),
+                readImageFileFormat(pt, "label", defaultManifest.labelFormat, 3, 1));
+
+        CURFIL_INFO("dataset manifest " << filename.native() << ": " << manifest.colorFormat.getSuffix() << ", "
+                << manifest.depthFormat.getSuffix() << ", " << manifest.labelFormat.getSuffix());
+        return manifest;
+    } catch (const std::exception& e) {
+        throw std::runtime_error((boost::format("failed to read dataset manifest '%s': %s")
+                % filename.native() % e.what()).str());
+    }
+}
+
+bool DatasetManifest::isColorFilename(const std::string& filename) const {
+    return boost::algorithm::ends_with(filename, colorFormat.getSuffix());
+}
+
+static std::string replaceSuffix(const std::string& filename, const std::string& suffix,
+        const std::string& newSuffix) {
+    if (!boost::algorithm::ends_with(filename, suffix)) {
+        throw std::runtime_error((boost::format("illegal color image filename: %s (expected suffix: %s)")
+                % filename % suffix).str());
+    }
+    return filename.substr(0, filename.length() - suffix.length()) + newSuffix;
+}
+
+std::string DatasetManifest::getDepthFilename(const std::string& colorFilename) const {
+    return replaceSuffix(colorFilename, colorFormat.getSuffix(), depthFormat.getSuffix());
+}
+
+std::string DatasetManifest::getLabelFilename(const std::string& colorFilename) const {
+    return replaceSuffix(colorFilename, colorFormat.getSuffix(), labelFormat.getSuffix());
+}
+
+}
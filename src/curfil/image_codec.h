@@ -0,0 +1,247 @@
+#ifndef CURFIL_IMAGE_CODEC_H
+#define CURFIL_IMAGE_CODEC_H
+
+#include <boost/shared_ptr.hpp>
+#include <cstring>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace curfil {
+
+/**
+ * The pixels of a decoded image file, interleaved row by row ([y][x][channel]).
+ * A sample has one or two bytes in host byte order.
+ *
+ * The pixels are either a view of the memory-mapped image file (zero-copy) or a buffer of the decoder.
+ * Copies of a decoded image share the pixels, which are kept alive as long as one copy exists.
+ */
+class DecodedImage {
+
+public:
+
+    DecodedImage() :
+            width(0), height(0), channels(0), bytesPerSample(0), data(0), storage(), mapped(false) {
+    }
+
+    /**
+     * @param data the first pixel, a view of 'storage'
+     * @param storage keeps the pixels alive, e.g. the memory-mapped file
+     * @param mapped true if the pixels are a view of the memory-mapped file
+     */
+    DecodedImage(int width, int height, int channels, int bytesPerSample, const uint8_t* data,
+            const boost::shared_ptr<const void>& storage, bool mapped);
+
+    /**
+     * Creates a decoded image whose pixels are the given buffer.
+     */
+    DecodedImage(int width, int height, int channels, int bytesPerSample,
+            const boost::shared_ptr<std::vector<uint8_t> >& buffer);
+
+    int getWidth() const {
+        return width;
+    }
+
+    int getHeight() const {
+        return height;
+    }
+
+    int getChannels() const {
+        return channels;
+    }
+
+    int getBytesPerSample() const {
+        return bytesPerSample;
+    }
+
+    size_t getNumSamples() const {
+        return static_cast<size_t>(width) * height * channels;
+    }
+
+    const uint8_t* getData() const {
+        return data;
+    }
+
+    /**
+     * @return true if the pixels are a view of the memory-mapped image file
+     */
+    bool isMapped() const {
+        return mapped;
+    }
+
+    /**
+     * @return the sample with the given index, e.g. (y * width + x) * channels + channel
+     */
+    uint16_t getSample(size_t index) const {
+        if (bytesPerSample == 1) {
+            return data[index];
+        }
+        // the samples of a mapped file are not necessarily aligned
+        uint16_t sample;
+        std::memcpy(&sample, data + 2 * index, sizeof(sample));
+        return sample;
+    }
+
+private:
+    int width;
+    int height;
+    int channels;
+    int bytesPerSample;
+    const uint8_t* data;
+    boost::shared_ptr<const void> storage;
+    bool mapped;
+};
+
+/**
+ * Name and encoding of one kind of files (color, depth or label images) of a dataset.
+ */
+class ImageFileFormat {
+
+public:
+
+    /**
+     * @param suffix the end of the filenames, e.g. "_depth.png". the image pairs are identified by their prefix
+     * @param codec the name of the codec. if empty, the codec is chosen by the extension of the filename.
+     * see getImageCodecName()
+     */
+    explicit ImageFileFormat(const std::string& suffix = "", const std::string& codec = "") :
+            suffix(suffix), codec(codec), width(0), height(0), channels(0), bytesPerSample(0) {
+    }
+
+    const std::string& getSuffix() const {
+        return suffix;
+    }
+
+    /**
+     * @return the name of the codec of the given file
+     */
+    std::string getCodec(const std::string& filename) const;
+
+    /**
+     * Sets the layout of headerless raw files. The samples are little-endian.
+     */
+    void setRawLayout(int width, int height, int channels, int bytesPerSample);
+
+    int getWidth() const {
+        return width;
+    }
+
+    int getHeight() const {
+        return height;
+    }
+
+    int getChannels() const {
+        return channels;
+    }
+
+    int getBytesPerSample() const {
+        return bytesPerSample;
+    }
+
+private:
+    std::string suffix;
+    std::string codec;
+
+    // layout of raw files
+    int width;
+    int height;
+    int channels;
+    int bytesPerSample;
+};
+
+/**
+ * Decodes image files of one format. Implementations must be thread-safe.
+ */
+class ImageCodec {
+
+public:
+
+    virtual ~ImageCodec() {
+    }
+
+    virtual DecodedImage decode(const std::string& filename, const ImageFileFormat& format) const = 0;
+
+};
+
+/**
+ * Registers a codec under the given name or replaces the codec of that name.
+ *
+ * The built-in codecs are
+ * - "vigra": PNG and all other formats that vigra imports. the pixels are decoded into a buffer
+ * - "pnm": binary PGM (P5) and PPM (P6). 8-bit pixels are mapped without copying
+ * - "npy": NumPy arrays of uint8 or little-endian uint16 with the shape (height, width) or (height, width, channels),
+ *   in C order. the pixels are mapped without copying
+ * - "raw": headerless little-endian pixels with the layout of the ImageFileFormat. mapped without copying
+ */
+void registerImageCodec(const std::string& name, const boost::shared_ptr<ImageCodec>& codec);
+
+/**
+ * @return the name of the codec for the extension of the filename: "pnm" for .pgm, .ppm and .pnm,
+ * "npy" for .npy, "raw" for .raw and "vigra" otherwise
+ */
+std::string getImageCodecName(const std::string& filename);
+
+/**
+ * Decodes the image file with the codec of the format.
+ */
+DecodedImage decodeImage(const std::string& filename, const ImageFileFormat& format = ImageFileFormat());
+
+/**
+ * Naming and formats of the color, depth and label images of a dataset.
+ *
+ * The manifest is the optional JSON file 'dataset.json' in the dataset folder, e.g.
+ *
+ *     {
+ *         "color": { "suffix": "_colors.ppm" },
+ *         "depth": { "suffix": "_depth.raw", "codec": "raw", "width": 640, "height": 480, "bytesPerSample": 2 },
+ *         "label": { "suffix": "_ground_truth.png" }
+ *     }
+ *
+ * Missing entries keep the default naming "<name>_colors.png", "<name>_depth.png" and "<name>_ground_truth.png".
+ */
+class DatasetManifest {
+
+public:
+
+    static const std::string FILENAME;
+
+    DatasetManifest();
+
+    DatasetManifest(const ImageFileFormat& colorFormat, const ImageFileFormat& depthFormat,
+            const ImageFileFormat& labelFormat);
+
+    /**
+     * @return the manifest in the given folder or the default manifest if the folder has none
+     */
+    static DatasetManifest load(const std::string& folder);
+
+    const ImageFileFormat& getColorFormat() const {
+        return colorFormat;
+    }
+
+    const ImageFileFormat& getDepthFormat() const {
+        return depthFormat;
+    }
+
+    const ImageFileFormat& getLabelFormat() const {
+        return labelFormat;
+    }
+
+    /**
+     * @return true if the file is the color image of an image pair
+     */
+    bool isColorFilename(const std::string& filename) const;
+
+    std::string getDepthFilename(const std::string& colorFilename) const;
+
+    std::string getLabelFilename(const std::string& colorFilename) const;
+
+private:
+    ImageFileFormat colorFormat;
+    ImageFileFormat depthFormat;
+    ImageFileFormat labelFormat;
+};
+
+}
+
+#endif
@@ -201,6 +201,51 @@ TrainingConfiguration RandomTreeImport::readJSON(const std::string& filename,
         subsamplingType = subsamplingTypeValue.get();
     }
 
+    // the tile size only affects the training speed and is not stored in the model
+    const uint16_t sortTileSize = 16;
+
+    bool useFloatResponses = false;
+    const boost::optional<bool> useFloatResponsesValue = pt.get_optional<bool>("useFloatResponses");
+    if (useFloatResponsesValue) {
+        useFloatResponses = useFloatResponsesValue.get();
+    }
+
+    bool useFlipAugmentation = false;
+    const boost::optional<bool> useFlipAugmentationValue = pt.get_optional<bool>("useFlipAugmentation");
+    if (useFlipAugmentationValue) {
+        useFlipAugmentation = useFlipAugmentationValue.get();
+    }
+
+    float scaleJitter = 0.0f;
+    const boost::optional<float> scaleJitterValue = pt.get_optional<float>("scaleJitter");
+    if (scaleJitterValue) {
+        scaleJitter = scaleJitterValue.get();
+    }
+
+    int pyramidLevel = 0;
+    const boost::optional<int> pyramidLevelValue = pt.get_optional<int>("pyramidLevel");
+    if (pyramidLevelValue) {
+        pyramidLevel = pyramidLevelValue.get();
+    }
+
+    float depthFeatureCost = 0.0f;
+    const boost::optional<float> depthFeatureCostValue = pt.get_optional<float>("depthFeatureCost");
+    if (depthFeatureCostValue) {
+        depthFeatureCost = depthFeatureCostValue.get();
+    }
+
+    float colorFeatureCost = 0.0f;
+    const boost::optional<float> colorFeatureCostValue = pt.get_optional<float>("colorFeatureCost");
+    if (colorFeatureCostValue) {
+        colorFeatureCost = colorFeatureCostValue.get();
+    }
+
+    float nanResponseCost = 0.0f;
+    const boost::optional<float> nanResponseCostValue = pt.get_optional<float>("nanResponseCost");
+    if (nanResponseCostValue) {
+        nanResponseCost = nanResponseCostValue.get();
+    }
+
     unsigned int maxSamplesPerBatch = pt.get<unsigned int>("maxSamplesPerBatch");
     const std::string accelerationModeString = pt.get<std::string>("accelerationMode");
 
@@ -216,7 +261,8 @@ TrainingConfiguration RandomTreeImport::readJSON(const std::string& filename,
     TrainingConfiguration configuration(randomSeed, samplesPerImage, featureCount, minSampleCount, maxDepth, boxRadius,
             regionSize, thresholds, numThreads, maxImages, imageCacheSize, maxSamplesPerBatch,
             TrainingConfiguration::parseAccelerationModeString(accelerationModeString), useCIELab, useDepthFilling,
-            deviceIds, subsamplingType, ignoredColors);
+            deviceIds, subsamplingType, ignoredColors, sortTileSize, useFloatResponses,
+            useFlipAugmentation, scaleJitter, pyramidLevel, depthFeatureCost, colorFeatureCost, nanResponseCost);
 
     boost::shared_ptr<RandomTree<PixelInstance, ImageFeatureFunction> > randomTree = readTree(pt.get_child("tree"));
     assert(randomTree->isRoot());
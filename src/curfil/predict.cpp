@@ -66,6 +66,27 @@ double ConfusionMatrix::averageClassAccuracy(bool includeVoid) const {
     return averageClassAccuracy.getAverage();
 }
 
+double ConfusionMatrix::pixelAccuracy(bool includeVoid) const {
+
+    if (normalized) {
+        throw std::runtime_error("confusion matrix is already normalized");
+    }
+
+    double correct = 0.0;
+    double total = 0.0;
+    for (unsigned int label = (includeVoid ? 0 : 1); label < getNumClasses(); label++) {
+        for (unsigned int prediction = 0; prediction < getNumClasses(); prediction++) {
+            total += data(label, prediction);
+        }
+        correct += data(label, label);
+    }
+
+    if (total == 0.0) {
+        return 0.0;
+    }
+    return correct / total;
+}
+
 void ConfusionMatrix::normalize() {
 
     if (normalized) {
@@ -163,9 +184,11 @@ double calculatePixelAccuracy(const LabelImage& prediction, const LabelImage& gr
 
 void test(RandomForestImage& randomForest, const std::string& folderTesting,
         const std::string& folderPrediction, const bool useDepthFilling,
-        const bool writeProbabilityImages) {
+        const bool writeProbabilityImages, const int pyramidLevel, const std::string& cacheFolder,
+        const bool interleaveColor, const bool compactIntegrals) {
 
-    auto filenames = listImageFilenames(folderTesting);
+    const DatasetManifest manifest = DatasetManifest::load(folderTesting);
+    auto filenames = listImageFilenames(folderTesting, manifest);
     if (filenames.empty()) {
         throw std::runtime_error(std::string("found no files in ") + folderTesting);
     }
@@ -194,11 +217,31 @@ void test(RandomForestImage& randomForest, const std::string& folderTesting,
 
     bool onGPU = randomForest.getConfiguration().getAccelerationMode() == GPU_ONLY;
 
+    if (onGPU && pyramidLevel > 0) {
+        throw std::runtime_error("prediction on a pyramid level is only supported in CPU mode");
+    }
+    if (onGPU && interleaveColor) {
+        throw std::runtime_error("prediction on interleaved color images is only supported in CPU mode");
+    }
+    if (onGPU && compactIntegrals) {
+        throw std::runtime_error("prediction on compact integral images is only supported in CPU mode");
+    }
+    if (compactIntegrals && interleaveColor) {
+        throw std::runtime_error("compact integral images cannot be interleaved");
+    }
+    CURFIL_INFO("pyramid level: " << pyramidLevel);
+
     size_t grainSize = 1;
     if (!onGPU) {
         grainSize = filenames.size();
     }
 
+    // the CPU evaluates the features without bounds checks on padded integral images
+    int integralPadding = 0;
+    if (!onGPU) {
+        integralPadding = randomForest.getConfiguration().getBoxRadius() + randomForest.getConfiguration().getRegionSize();
+    }
+
     bool writeImages = true;
     if (folderPrediction.empty()) {
         CURFIL_WARNING("no prediction folder given. will not write images");
@@ -209,9 +252,32 @@ void test(RandomForestImage& randomForest, const std::string& folderTesting,
             [&](const tbb::blocked_range<size_t>& range) {
                 for(size_t fileNr = range.begin(); fileNr != range.end(); fileNr++) {
                     const std::string& filename = filenames[fileNr];
-                    const auto imageLabelPair = loadImagePair(filename, useCIELab, useDepthFilling);
+                    // on a pyramid level, the ground truth and the saved images keep the full resolution.
+                    // only the downsampled copy is integrated. the same holds for compact integral images,
+                    // which cannot be saved
+                    const bool integrateTestImage = (pyramidLevel == 0 && !compactIntegrals);
+                    const auto imageLabelPair = loadImagePair(filename, useCIELab, useDepthFilling,
+                            integrateTestImage, integrateTestImage ? integralPadding : 0, 0, cacheFolder, false,
+                            integrateTestImage && interleaveColor, 0, manifest);
                     const RGBDImage& testImage = imageLabelPair.getRGBDImage();
                     const LabelImage& groundTruth = imageLabelPair.getLabelImage();
+
+                    boost::shared_ptr<RGBDImage> downsampledImage;
+                    if (!integrateTestImage) {
+                        downsampledImage = boost::make_shared<RGBDImage>(testImage);
+                        downsampledImage->downsample(pyramidLevel);
+                        if (compactIntegrals) {
+                            // the prediction does not augment the pixels
+                            downsampledImage->calculateCompactIntegral(randomForest.getConfiguration().getRegionSize());
+                        } else {
+                            downsampledImage->calculateIntegral();
+                        }
+                        downsampledImage->padIntegralImages(integralPadding);
+                        if (interleaveColor) {
+                            downsampledImage->interleaveColorImage();
+                        }
+                    }
+                    const RGBDImage& predictionImage = downsampledImage ? *downsampledImage : testImage;
                     LabelImage prediction(testImage.getWidth(), testImage.getHeight());
 
                     for(int y = 0; y < groundTruth.getHeight(); y++) {
@@ -237,7 +303,12 @@ void test(RandomForestImage& randomForest, const std::string& folderTesting,
 
                     cuv::ndarray<float, cuv::host_memory_space> probabilities;
 
-                    prediction = randomForest.predict(testImage, &probabilities, onGPU);
+                    if (fullResolution) {
+                        prediction = randomForest.predict(testImage, &probabilities, onGPU);
+                    } else {
+                        prediction = randomForest.predict(predictionImage, &probabilities, onGPU, pyramidLevel)
+                                .upsample(pyramidLevel, testImage.getWidth(), testImage.getHeight());
+                    }
 
 #ifndef NDEBUG
             for(LabelType label = 0; label < randomForest.getNumClasses(); label++) {
@@ -257,7 +328,7 @@ void test(RandomForestImage& randomForest, const std::string& folderTesting,
 
             if (writeImages && writeProbabilityImages) {
                 utils::Profile profile("writeProbabilityImages");
-                RGBDImage probabilityImage(testImage.getWidth(), testImage.getHeight());
+                RGBDImage probabilityImage(predictionImage.getWidth(), predictionImage.getHeight());
                 for(LabelType label = 0; label< randomForest.getNumClasses(); label++) {
 
                     if (randomForest.shouldIgnoreLabel(label)) {
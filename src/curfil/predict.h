@@ -74,6 +74,12 @@ public:
 
     double averageClassAccuracy(bool includeVoid = true) const;
 
+    /**
+     * Fraction of correctly predicted pixels. Requires an unnormalized confusion matrix.
+     * Pixels of class 'void' (label 0) are not counted if 'includeVoid' is false.
+     */
+    double pixelAccuracy(bool includeVoid = true) const;
+
 }
 ;
 
@@ -85,9 +91,18 @@ public:
 double calculatePixelAccuracy(const LabelImage& prediction, const LabelImage& groundTruth,
         const bool includeVoid = true, ConfusionMatrix* confusionMatrix = 0);
 
+/**
+ * Predicts all images of 'folderTesting' and logs the pixel accuracies.
+ * With a pyramidLevel greater than zero, the images are predicted at a resolution reduced by 2^pyramidLevel (on CPU)
+ * and the labels are upsampled to the resolution of the ground truth.
+ * Full-resolution images are read from the binary image cache in 'cacheFolder' if it is not empty.
+ * With interleaveColor, the CPU predicts on images with interleaved color. see RGBDImage::interleaveColorImage()
+ * With compactIntegrals, the CPU predicts on compact integral images. see RGBDImage::calculateCompactIntegral()
+ */
 void test(RandomForestImage& randomForest, const std::string& folderTesting,
         const std::string& folderPrediction, const bool useDepthFilling,
-        const bool writeProbabilityImages);
+        const bool writeProbabilityImages, const int pyramidLevel = 0, const std::string& cacheFolder = "",
+        const bool interleaveColor = false, const bool compactIntegrals = false);
 
 }
 
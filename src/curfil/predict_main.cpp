@@ -41,6 +41,10 @@ int main(int argc, char **argv) {
     int deviceId = 0;
     bool useDepthFillingOption = false;
     bool writeProbabilityImages = false;
+    int pyramidLevel = 0;
+    std::string cacheFolder = "";
+    bool interleaveColor = false;
+    bool compactIntegrals = false;
 
     // Declare the supported options.
     po::options_description options("options");
@@ -63,6 +67,14 @@ int main(int argc, char **argv) {
     ("writeProbabilityImages",
             po::value<bool>(&writeProbabilityImages)->implicit_value(true)->default_value(writeProbabilityImages),
             "whether to write probability PNGs of the prediction")
+    ("pyramidLevel", po::value<int>(&pyramidLevel)->default_value(pyramidLevel),
+            "predict on the images downsampled by 2^pyramidLevel and upsample the labels (CPU mode only)")
+    ("cacheFolder", po::value<std::string>(&cacheFolder)->default_value(cacheFolder),
+            "folder of the binary cache of preprocessed images. leave it empty to disable the cache")
+    ("interleaveColor", po::value<bool>(&interleaveColor)->implicit_value(true)->default_value(interleaveColor),
+            "store the color integral images per pixel instead of per channel for fewer cache misses (CPU mode only)")
+    ("compactIntegrals", po::value<bool>(&compactIntegrals)->implicit_value(true)->default_value(compactIntegrals),
+            "store the integral images in fixed point with 16 bit valid counts where the region size allows (CPU mode only)")
             ;
 
     po::positional_options_description pod;
@@ -128,7 +140,8 @@ int main(int argc, char **argv) {
         useDepthFilling = useDepthFillingOption;
     }
 
-    test(randomForest, folderTesting, folderPrediction, useDepthFilling, writeProbabilityImages);
+    test(randomForest, folderTesting, folderPrediction, useDepthFilling, writeProbabilityImages, pyramidLevel,
+            cacheFolder, interleaveColor, compactIntegrals);
 
     CURFIL_INFO("finished");
     return EXIT_SUCCESS;
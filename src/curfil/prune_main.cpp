@@ -0,0 +1,57 @@
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+
+#include "image.h"
+#include "random_tree_image.h"
+#include "tree_tool.h"
+#include "utils.h"
+
+namespace po = boost::program_options;
+
+using namespace curfil;
+
+int main(int argc, char **argv) {
+
+    double tolerance = 0.0;
+    double histogramBias = 0.0;
+    std::string cacheFolder = "";
+
+    TreeTool tool("folderValidation", "folder with held-out labeled images used for pruning",
+            "folder to output the pruned trees");
+    tool.addOptions()
+    ("tolerance", po::value<double>(&tolerance)->default_value(tolerance),
+            "maximum allowed loss of validation pixel accuracy per collapsed node")
+    ("histogramBias", po::value<double>(&histogramBias)->default_value(histogramBias), "histogram bias")
+    ("cacheFolder", po::value<std::string>(&cacheFolder)->default_value(cacheFolder),
+            "folder of the binary cache of preprocessed images. leave it empty to disable the cache")
+            ;
+
+    if (!tool.parseCommandLine(argc, argv)) {
+        return EXIT_FAILURE;
+    }
+
+    if (histogramBias < 0.0 || histogramBias >= 1.0) {
+        throw std::runtime_error(boost::str(boost::format("illegal histogram bias: %lf") % histogramBias));
+    }
+
+    CURFIL_INFO("tolerance: " << tolerance);
+    CURFIL_INFO("histogramBias: " << histogramBias);
+
+    tool.readTrees();
+
+    const std::string& folderValidation = tool.getFolder();
+    std::vector<LabeledRGBDImage> validationImages = loadImages(folderValidation, tool.isUseCIELab(),
+            tool.isUseDepthFilling(), 0, 0, cacheFolder);
+    if (validationImages.empty()) {
+        throw std::runtime_error(std::string("found no files in ") + folderValidation);
+    }
+
+    for (const auto& tree : tool.getTrees()) {
+        tree->prune(validationImages, tolerance, histogramBias);
+    }
+
+    tool.writeTrees();
+
+    CURFIL_INFO("finished");
+    return EXIT_SUCCESS;
+}
@@ -1,13 +1,24 @@
 #include "random_forest_image.h"
 
+#include <algorithm>
 #include <boost/shared_ptr.hpp>
 #include <cassert>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <set>
+#include <tbb/mutex.h>
+#include <tbb/parallel_for.h>
 #include <tbb/parallel_for_each.h>
+#include <tbb/task_arena.h>
 #include <tbb/task_scheduler_init.h>
 #include <vector>
 
+#include "dataset_index.h"
 #include "image.h"
 #include "import.h"
+#include "ndarray_ops.h"
+#include "predict.h"
 #include "random_tree_image_gpu.h"
 #include "utils.h"
 
@@ -101,8 +112,72 @@ RandomForestImage::RandomForestImage(const std::vector<boost::shared_ptr<RandomT
 }
 
 // Usage identical to RandomTreeImage class
+// the out-of-bag pixels are drawn from a random stream that is not used by any tree
+static const uint64_t OUT_OF_BAG_STREAM = std::numeric_limits<uint64_t>::max();
+
+// image and position of a pixel
+typedef std::pair<const RGBDImage*, uint32_t> PixelKey;
+
+static PixelKey getPixelKey(const PixelInstance& pixel) {
+    return std::make_pair(pixel.getRGBDImage(), (static_cast<uint32_t>(pixel.getY()) << 16)
+            | static_cast<uint32_t>(pixel.getX()));
+}
+
+// N×C matrix of 64-bit counts. the counts of a full dataset can exceed the range of WeightType
+class CountMatrix {
+public:
+    CountMatrix(size_t rows, size_t cols) :
+            cols(cols), counts(rows * cols, 0) {
+    }
+
+    uint64_t& operator()(size_t row, size_t col) {
+        assert(col < cols);
+        return counts[row * cols + col];
+    }
+
+    uint64_t operator()(size_t row, size_t col) const {
+        assert(col < cols);
+        return counts[row * cols + col];
+    }
+
+    CountMatrix& operator+=(const CountMatrix& other) {
+        assert(counts.size() == other.counts.size());
+        for (size_t i = 0; i < counts.size(); i++) {
+            counts[i] += other.counts[i];
+        }
+        return *this;
+    }
+
+    // converts to double precision, which is exact for counts below 2^53
+    cuv::ndarray<double, cuv::host_memory_space> toNdarray() const {
+        const size_t rows = counts.size() / cols;
+        cuv::ndarray<double, cuv::host_memory_space> result(rows, cols);
+        for (size_t i = 0; i < counts.size(); i++) {
+            result[i] = static_cast<double>(counts[i]);
+        }
+        return result;
+    }
+
+private:
+    size_t cols;
+    std::vector<uint64_t> counts;
+};
+
+// leaf histograms normalized without bias, indexed by node id
+typedef std::map<size_t, cuv::ndarray<double, cuv::host_memory_space> > LeafHistograms;
+
+static void normalizeLeafHistograms(const RandomTree<PixelInstance, ImageFeatureFunction>& node,
+        const cuv::ndarray<WeightType, cuv::host_memory_space>& priorDistribution, LeafHistograms& leafHistograms) {
+    if (node.isLeaf()) {
+        leafHistograms[node.getNodeId()] = detail::normalizeHistogram(node.getHistogram(), priorDistribution, 0.0);
+        return;
+    }
+    normalizeLeafHistograms(*node.getLeft(), priorDistribution, leafHistograms);
+    normalizeLeafHistograms(*node.getRight(), priorDistribution, leafHistograms);
+}
+
 void RandomForestImage::train(const std::vector<LabeledRGBDImage>& trainLabelImages,
-        bool trainTreesSequentially) {
+        bool trainTreesSequentially, ConfusionMatrix* outOfBagConfusionMatrix, const ImageLoader& imageLoader) {
 
     if (trainLabelImages.empty()) {
         throw std::runtime_error("no training images");
@@ -111,50 +186,277 @@ void RandomForestImage::train(const std::vector<LabeledRGBDImage>& trainLabelIma
     const size_t treeCount = ensemble.size();
 
     const int numThreads = configuration.getNumThreads();
-    tbb::task_scheduler_init init(numThreads);
+
+    // trees, nodes and sample chunks share the threads of one arena. idle threads steal work across trees
+    tbb::task_arena arena(numThreads);
 
     CURFIL_INFO("learning image tree ensemble. " << treeCount << " trees with " << numThreads << " threads");
 
     for (size_t treeNr = 0; treeNr < treeCount; ++treeNr) {
-        ensemble[treeNr] = boost::make_shared<RandomTreeImage>(treeNr, configuration);
+        if (!ensemble[treeNr]) {
+            ensemble[treeNr] = boost::make_shared<RandomTreeImage>(treeNr, configuration);
+            continue;
+        }
+
+        // warm start: continue training of an existing tree with the current configuration
+        const TrainingConfiguration& treeConfiguration = ensemble[treeNr]->getConfiguration();
+        if (treeConfiguration.isUseCIELab() != configuration.isUseCIELab()
+                || treeConfiguration.isUseDepthFilling() != configuration.isUseDepthFilling()
+                || treeConfiguration.getSubsamplingType() != configuration.getSubsamplingType()
+                || treeConfiguration.getIgnoredColors() != configuration.getIgnoredColors()
+                || treeConfiguration.isUseFloatResponses() != configuration.isUseFloatResponses()
+                || treeConfiguration.isUseFlipAugmentation() != configuration.isUseFlipAugmentation()
+                || treeConfiguration.getScaleJitter() != configuration.getScaleJitter()
+                || treeConfiguration.getPyramidLevel() != configuration.getPyramidLevel()) {
+            CURFIL_ERROR("configuration of tree " << treeNr << ": " << treeConfiguration);
+            CURFIL_ERROR("training configuration: " << configuration);
+            throw std::runtime_error("cannot continue training of a tree with a different image configuration");
+        }
+        if (treeConfiguration.getMaxDepth() >= configuration.getMaxDepth()) {
+            CURFIL_WARNING("tree " << treeNr << " was trained up to depth " << treeConfiguration.getMaxDepth()
+                    << ". maxDepth " << configuration.getMaxDepth() << " will not grow the tree");
+        }
+
+        ensemble[treeNr] = boost::make_shared<RandomTreeImage>(ensemble[treeNr]->getTree(), configuration,
+                ensemble[treeNr]->getClassLabelPriorDistribution());
     }
 
-    RandomSource randomSource(configuration.getRandomSeed());
-    const int SEED = randomSource.uniformSampler(0xFFFF).getNext();
+    // memory-mapped datasets do not fit into memory. neither do the coordinates of all their valid pixels
+    bool storeCoordinates = true;
+    for (const LabeledRGBDImage& image : trainLabelImages) {
+        if (image.getRGBDImage().isMapped()) {
+            storeCoordinates = false;
+            break;
+        }
+    }
 
-    auto train =
-            [&](boost::shared_ptr<RandomTreeImage>& tree) {
-                utils::Timer timer;
-                auto seed = SEED + tree->getId();
-                RandomSource randomSource(seed);
+    // shared by all trees. the index is built in parallel and therefore within the arena
+    boost::shared_ptr<const DatasetIndex> datasetIndex;
+    arena.execute([&]() {
+        datasetIndex = boost::make_shared<const DatasetIndex>(trainLabelImages, storeCoordinates);
+    });
+    const DatasetIndex& index = *datasetIndex;
+
+    // the random streams of a tree only depend on the random seed and the tree id
+    const RandomSource forestRandomSource(configuration.getRandomSeed());
 
-                std::vector<LabeledRGBDImage> sampledTrainLabelImages = trainLabelImages;
+    // in-bag pixels per tree for the out-of-bag estimate
+    std::vector<std::vector<PixelInstance> > trainingSamples(outOfBagConfusionMatrix ? treeCount : 0);
+
+    auto selectImages =
+            [&](const RandomTreeImage& tree, const RandomSource& randomSource) {
+                std::vector<size_t> imageNrs(trainLabelImages.size());
+                for (size_t imageNr = 0; imageNr < imageNrs.size(); imageNr++) {
+                    imageNrs[imageNr] = imageNr;
+                }
 
                 if (configuration.getMaxImages() > 0 && static_cast<int>(trainLabelImages.size()) > configuration.getMaxImages()) {
-                    ReservoirSampler<LabeledRGBDImage> reservoirSampler(configuration.getMaxImages());
-                    Sampler sampler = randomSource.uniformSampler(0, 10 * trainLabelImages.size());
-                    for (auto& image : trainLabelImages) {
-                        reservoirSampler.sample(sampler, image);
+                    ReservoirSampler<size_t> reservoirSampler(configuration.getMaxImages());
+                    Sampler sampler = randomSource.split(IMAGE_SELECTION_STREAM).uniformSampler(0,
+                            10 * trainLabelImages.size());
+                    for (size_t imageNr = 0; imageNr < trainLabelImages.size(); imageNr++) {
+                        reservoirSampler.sample(sampler, imageNr);
                     }
 
-                    CURFIL_INFO("tree " << tree->getId() << ": sampled " << reservoirSampler.getReservoir().size()
+                    CURFIL_INFO("tree " << tree.getId() << ": sampled " << reservoirSampler.getReservoir().size()
                             << " out of " << trainLabelImages.size() << " images");
-                    sampledTrainLabelImages = reservoirSampler.getReservoir();
+                    imageNrs = reservoirSampler.getReservoir();
                 }
+                return imageNrs;
+            };
+
+    const size_t subsampleCount = configuration.getSamplesPerImage() / treeCount;
 
-                tree->train(sampledTrainLabelImages, randomSource, configuration.getSamplesPerImage() / treeCount);
-                CURFIL_INFO("finished tree " << tree->getId() << " with random seed " << seed << " in " << timer.format(3));
+    // two-pass loading: the pixels of all trees are drawn before the trees are grown
+    std::vector<std::vector<PixelInstance> > subsamples(imageLoader ? treeCount : 0);
+
+    auto train =
+            [&](boost::shared_ptr<RandomTreeImage>& tree) {
+                utils::Timer timer;
+                RandomSource randomSource = forestRandomSource.split(tree->getId());
+
+                std::vector<PixelInstance>* treeTrainingSamples = 0;
+                if (outOfBagConfusionMatrix) {
+                    assert(tree->getId() < trainingSamples.size());
+                    treeTrainingSamples = &trainingSamples[tree->getId()];
+                }
+
+                if (imageLoader) {
+                    assert(tree->getId() < subsamples.size());
+                    tree->train(subsamples[tree->getId()], randomSource, treeTrainingSamples);
+                    std::vector<PixelInstance>().swap(subsamples[tree->getId()]);
+                } else {
+                    tree->train(index, selectImages(*tree, randomSource), randomSource, subsampleCount,
+                            treeTrainingSamples);
+                }
+                CURFIL_INFO("finished tree " << tree->getId() << " with random seed " << configuration.getRandomSeed()
+                        << " in " << timer.format(3));
             };
 
-    if (!trainTreesSequentially && numThreads > 1) {
-        tbb::parallel_for_each(ensemble.begin(), ensemble.end(), train);
-    } else {
-        std::for_each(ensemble.begin(), ensemble.end(), train);
+    if (imageLoader) {
+        arena.execute([&]() {
+            tbb::parallel_for_each(ensemble.begin(), ensemble.end(), [&](boost::shared_ptr<RandomTreeImage>& tree) {
+                RandomSource randomSource = forestRandomSource.split(tree->getId());
+                subsamples[tree->getId()] = tree->subsample(index, selectImages(*tree, randomSource), randomSource,
+                        subsampleCount);
+            });
+        });
+
+        std::map<const RGBDImage*, size_t> imageNrs;
+        for (size_t imageNr = 0; imageNr < trainLabelImages.size(); imageNr++) {
+            imageNrs[&trainLabelImages[imageNr].getRGBDImage()] = imageNr;
+        }
+
+        std::set<size_t> sampledImageNrs;
+        for (const auto& treeSubsamples : subsamples) {
+            for (const PixelInstance& sample : treeSubsamples) {
+                sampledImageNrs.insert(imageNrs[sample.getRGBDImage()]);
+            }
+        }
+
+        CURFIL_INFO("the trees sampled pixels from " << sampledImageNrs.size() << " out of "
+                << trainLabelImages.size() << " images");
+        imageLoader(std::vector<size_t>(sampledImageNrs.begin(), sampledImageNrs.end()));
+    }
+
+    arena.execute([&]() {
+        if (!trainTreesSequentially && numThreads > 1) {
+            tbb::parallel_for_each(ensemble.begin(), ensemble.end(), train);
+        } else {
+            std::for_each(ensemble.begin(), ensemble.end(), train);
+        }
+    });
+
+    if (outOfBagConfusionMatrix) {
+        arena.execute([&]() {
+            estimateOutOfBagAccuracy(index, trainingSamples, forestRandomSource, imageLoader,
+                    *outOfBagConfusionMatrix);
+        });
+    }
+}
+
+void RandomForestImage::estimateOutOfBagAccuracy(const DatasetIndex& index,
+        const std::vector<std::vector<PixelInstance> >& trainingSamples,
+        const RandomSource& randomSource, const ImageLoader& imageLoader, ConfusionMatrix& confusionMatrix) {
+
+    assert(trainingSamples.size() == ensemble.size());
+
+    utils::Timer timer;
+
+    // the estimate uses unbiased histograms but must not change the normalization of the forest
+    std::vector<LeafHistograms> leafHistograms(ensemble.size());
+    for (size_t treeNr = 0; treeNr < ensemble.size(); treeNr++) {
+        normalizeLeafHistograms(*ensemble[treeNr]->getTree(), ensemble[treeNr]->getClassLabelPriorDistribution(),
+                leafHistograms[treeNr]);
+    }
+
+    std::vector<std::vector<PixelKey> > inBagPixels(ensemble.size());
+    for (size_t treeNr = 0; treeNr < ensemble.size(); treeNr++) {
+        std::vector<PixelKey>& keys = inBagPixels[treeNr];
+        keys.reserve(trainingSamples[treeNr].size());
+        for (const PixelInstance& sample : trainingSamples[treeNr]) {
+            keys.push_back(getPixelKey(sample));
+        }
+        std::sort(keys.begin(), keys.end());
+    }
+
+    std::vector<size_t> imageNrs(index.getNumImages());
+    for (size_t imageNr = 0; imageNr < imageNrs.size(); imageNr++) {
+        imageNrs[imageNr] = imageNr;
+    }
+
+    // as many pixels as were subsampled for training the forest
+    const int seed = randomSource.split(OUT_OF_BAG_STREAM).uniformSampler(0xFFFFFF).getNext();
+    const std::vector<PixelInstance> pixels = index.samplePixels(imageNrs, std::vector<bool>(),
+            configuration.getSamplesPerImage() * imageNrs.size(), seed);
+
+    if (imageLoader) {
+        std::map<const RGBDImage*, size_t> imageNrOfImage;
+        for (size_t imageNr = 0; imageNr < index.getNumImages(); imageNr++) {
+            imageNrOfImage[&index.getImage(imageNr).getRGBDImage()] = imageNr;
+        }
+        std::set<size_t> sampledImageNrs;
+        for (const PixelInstance& pixel : pixels) {
+            sampledImageNrs.insert(imageNrOfImage[pixel.getRGBDImage()]);
+        }
+        imageLoader(std::vector<size_t>(sampledImageNrs.begin(), sampledImageNrs.end()));
+    }
+
+    const LabelType numClasses = getNumClasses();
+    const float pyramidScale = 1.0f / (1 << configuration.getPyramidLevel());
+
+    // -1 if all trees were trained on the pixel
+    std::vector<int> predictions(pixels.size(), -1);
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, pixels.size()),
+            [&](const tbb::blocked_range<size_t>& range) {
+                std::vector<double> probabilities(numClasses);
+                for (size_t i = range.begin(); i != range.end(); i++) {
+                    PixelInstance pixel = pixels[i];
+                    if (configuration.getPyramidLevel() > 0) {
+                        pixel.setTransform(false, pyramidScale);
+                    }
+                    const PixelKey key = getPixelKey(pixel);
+
+                    std::fill(probabilities.begin(), probabilities.end(), 0.0);
+                    bool outOfBag = false;
+                    for (size_t treeNr = 0; treeNr < ensemble.size(); treeNr++) {
+                        if (std::binary_search(inBagPixels[treeNr].begin(), inBagPixels[treeNr].end(), key)) {
+                            continue;
+                        }
+                        const auto& tree = ensemble[treeNr]->getTree();
+                        typedef RandomTree<PixelInstance, ImageFeatureFunction> Tree;
+                        const size_t leafId = configuration.isUseFloatResponses() ?
+                                Tree::findLeaf<float>(tree, pixel)->getNodeId() :
+                                Tree::findLeaf(tree, pixel)->getNodeId();
+                        const auto& histogram = leafHistograms[treeNr].at(leafId);
+                        assert(histogram.size() == numClasses);
+                        for (LabelType label = 0; label < numClasses; label++) {
+                            probabilities[label] += histogram[label];
+                        }
+                        outOfBag = true;
+                    }
+
+                    if (outOfBag) {
+                        predictions[i] = std::max_element(probabilities.begin(), probabilities.end())
+                                - probabilities.begin();
+                    }
+                }
+            });
+
+    confusionMatrix.resize(std::max(static_cast<size_t>(numClasses), index.getNumClasses(imageNrs)));
+
+    size_t numOutOfBagPixels = 0;
+    for (size_t i = 0; i < pixels.size(); i++) {
+        if (predictions[i] >= 0) {
+            confusionMatrix.increment(pixels[i].getLabel(), predictions[i]);
+            numOutOfBagPixels++;
+        }
+    }
+
+    if (numOutOfBagPixels == 0) {
+        CURFIL_WARNING("no out-of-bag pixels. all trees were trained on the sampled pixels");
+        return;
     }
+
+    CURFIL_INFO((boost::format("out-of-bag estimate on %d of %d pixels: pixel accuracy %.4f (without void %.4f), "
+            "class accuracy %.4f (without void %.4f). took %s")
+            % numOutOfBagPixels % pixels.size()
+            % confusionMatrix.pixelAccuracy(true) % confusionMatrix.pixelAccuracy(false)
+            % confusionMatrix.averageClassAccuracy(true) % confusionMatrix.averageClassAccuracy(false)
+            % timer.format(2)).str());
 }
 
 LabelImage RandomForestImage::predict(const RGBDImage& image,
-         cuv::ndarray<float, cuv::host_memory_space>* probabilities, const bool onGPU) const {
+         cuv::ndarray<float, cuv::host_memory_space>* probabilities, const bool onGPU, const int pyramidLevel) const {
+
+    if (pyramidLevel < 0 || pyramidLevel > TrainingConfiguration::MAX_PYRAMID_LEVEL) {
+        throw std::runtime_error((boost::format("illegal pyramid level: %d") % pyramidLevel).str());
+    }
+
+    if (onGPU && pyramidLevel > 0) {
+        throw std::runtime_error("prediction on a pyramid level is only supported on CPU");
+    }
 
     LabelImage prediction(image.getWidth(), image.getHeight());
 
@@ -205,6 +507,10 @@ LabelImage RandomForestImage::predict(const RGBDImage& image,
     } else {
         utils::Profile profile("classifyImagesCPU");
 
+        const float pyramidScale = 1.0f / (1 << pyramidLevel);
+        // the trees route in the precision that they were trained in
+        const bool useFloatResponses = configuration.isUseFloatResponses();
+
         tbb::parallel_for(tbb::blocked_range<size_t>(0, image.getHeight()),
                 [&](const tbb::blocked_range<size_t>& range) {
                     for(size_t y = range.begin(); y != range.end(); y++) {
@@ -217,7 +523,11 @@ LabelImage RandomForestImage::predict(const RGBDImage& image,
                             for (const auto& tree : ensemble) {
                                 const auto& t = tree->getTree();
                                 PixelInstance pixel(&image, 0, x, y);
-                                const auto& hist = t->classifySoft(pixel);
+                                if (pyramidLevel > 0) {
+                                    pixel.setTransform(false, pyramidScale);
+                                }
+                                const auto& hist = useFloatResponses ?
+                                        t->classifySoft<float>(pixel) : t->classifySoft(pixel);
                                 assert(hist.size() == numClasses);
                                 for(LabelType label = 0; label<hist.size(); label++) {
                                     hostProbabilities(label, y, x) += hist[label];
@@ -273,6 +583,139 @@ void RandomForestImage::normalizeHistograms(const double histogramBias) {
     }
 }
 
+void RandomForestImage::prune(const std::vector<LabeledRGBDImage>& validationImages, const double tolerance,
+        const double histogramBias) {
+
+    CURFIL_INFO("pruning " << ensemble.size() << " trees with " << validationImages.size()
+            << " validation images. tolerance: " << tolerance);
+
+    size_t removedNodes = 0;
+    for (size_t treeNr = 0; treeNr < ensemble.size(); treeNr++) {
+        removedNodes += ensemble[treeNr]->prune(validationImages, tolerance, histogramBias);
+    }
+
+    CURFIL_INFO("removed " << removedNodes << " nodes");
+
+    normalizeHistograms(histogramBias);
+}
+
+void RandomForestImage::refitHistograms(const std::vector<std::string>& imageFilenames, bool useCIELab,
+        bool useDepthFilling, const double blend, const double histogramBias, const DatasetManifest& manifest) {
+
+    if (imageFilenames.empty()) {
+        throw std::runtime_error("got no images to refit the histograms");
+    }
+
+    if (blend < 0.0 || blend > 1.0) {
+        throw std::runtime_error(boost::str(boost::format("illegal histogram blend: %lf") % blend));
+    }
+
+    utils::Timer refitTimer;
+
+    const size_t treeCount = ensemble.size();
+    const size_t numClasses = getNumClasses();
+
+    std::vector<size_t> rootNodeIds(treeCount);
+    std::vector<size_t> numNodeIds(treeCount);
+    for (size_t treeNr = 0; treeNr < treeCount; treeNr++) {
+        rootNodeIds[treeNr] = ensemble[treeNr]->getTree()->getNodeId();
+        numNodeIds[treeNr] = ensemble[treeNr]->getTree()->getMaxNodeId() - rootNodeIds[treeNr] + 1;
+    }
+
+    std::vector<bool> ignoredLabels(numClasses);
+    for (LabelType label = 0; label < numClasses; label++) {
+        ignoredLabels[label] = shouldIgnoreLabel(label);
+    }
+
+    CURFIL_INFO("refitting histograms of " << treeCount << " trees with " << imageFilenames.size() << " images."
+            << " blend: " << blend);
+
+    // per range: node histograms of all trees, followed by the pixels per class that were pushed through the trees
+    tbb::concurrent_vector<std::vector<CountMatrix> > countsPerRange;
+
+    const int numThreads = std::max(1, configuration.getNumThreads());
+    const int grainSize = ceil(imageFilenames.size() / static_cast<double>(numThreads));
+
+    tbb::mutex imageCounterMutex;
+    size_t numImages = 0;
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, imageFilenames.size(), grainSize),
+            [&](const tbb::blocked_range<size_t>& range) {
+
+                std::vector<CountMatrix> counts;
+                for (size_t treeNr = 0; treeNr < treeCount; treeNr++) {
+                    counts.push_back(CountMatrix(numNodeIds[treeNr], numClasses));
+                }
+                counts.push_back(CountMatrix(1, numClasses));
+
+                CountMatrix& labelCounts = counts[treeCount];
+
+                for(size_t imageNr = range.begin(); imageNr != range.end(); imageNr++) {
+                    // the image is released at the end of the iteration
+                    const LabeledRGBDImage image = loadImagePair(imageFilenames[imageNr], useCIELab, useDepthFilling,
+                            true, 0, 0, "", false, false, 0, manifest);
+                    const LabelImage& labelImage = image.getLabelImage();
+
+                    for (int y = 0; y < labelImage.getHeight(); y++) {
+                        for (int x = 0; x < labelImage.getWidth(); x++) {
+                            const LabelType label = labelImage.getLabel(x, y);
+                            if (label >= numClasses) {
+                                throw std::runtime_error((boost::format(
+                                        "illegal label in image '%s' at pixel (%d,%d): %d (numClasses: %d)")
+                                        % labelImage.getFilename() % x % y
+                                        % static_cast<int>(label) % numClasses).str());
+                            }
+                            // only the pixels that training samples from
+                            if (ignoredLabels[label]) {
+                                continue;
+                            }
+                            PixelInstance pixel(&image.getRGBDImage(), label, x, y);
+                            if (!pixel.getDepth().isValid()) {
+                                continue;
+                            }
+                            labelCounts(0, label)++;
+                            for (size_t treeNr = 0; treeNr < treeCount; treeNr++) {
+                                const auto& tree = ensemble[treeNr]->getTree();
+                                if (configuration.isUseFloatResponses()) {
+                                    tree->addSampleToHistograms<float>(pixel, counts[treeNr], rootNodeIds[treeNr]);
+                                } else {
+                                    tree->addSampleToHistograms(pixel, counts[treeNr], rootNodeIds[treeNr]);
+                                }
+                            }
+                        }
+                    }
+
+                    {
+                        tbb::mutex::scoped_lock lock(imageCounterMutex);
+                        if (++numImages % 50 == 0) {
+                            CURFIL_INFO("refitted with " << numImages << "/" << imageFilenames.size() << " images");
+                        }
+                    }
+                }
+
+                countsPerRange.push_back(counts);
+            });
+
+    std::vector<CountMatrix> counts = countsPerRange[0];
+    for (size_t range = 1; range < countsPerRange.size(); range++) {
+        for (size_t i = 0; i < counts.size(); i++) {
+            counts[i] += countsPerRange[range][i];
+        }
+    }
+
+    cuv::ndarray<double, cuv::host_memory_space> labelCounts(numClasses);
+    for (size_t label = 0; label < numClasses; label++) {
+        labelCounts[label] = static_cast<double>(counts[treeCount](0, label));
+    }
+    for (size_t treeNr = 0; treeNr < treeCount; treeNr++) {
+        ensemble[treeNr]->refitHistograms(counts[treeNr].toNdarray(), labelCounts, blend);
+    }
+
+    CURFIL_INFO("refitted histograms in " << refitTimer.format(2));
+
+    normalizeHistograms(histogramBias);
+}
+
 std::map<LabelType, RGBColor> RandomForestImage::getLabelColorMap() const {
     std::map<LabelType, RGBColor> labelColorMap;
 
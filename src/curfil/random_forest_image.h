@@ -2,17 +2,24 @@
 #define CURFIL_RANDOM_FOREST_IMAGE_H
 
 #include <boost/shared_ptr.hpp>
+#include <functional>
 #include <vector>
 
 #include "random_tree_image.h"
 
 namespace curfil {
 
+class ConfusionMatrix;
 class TreeNodes;
 
 class RandomForestImage {
 public:
 
+    /**
+     * Completely loads the training images with the given numbers
+     */
+    typedef std::function<void(const std::vector<size_t>& imageNrs)> ImageLoader;
+
     explicit RandomForestImage(const std::vector<std::string>& treeFiles,
             const std::vector<int>& deviceIds = std::vector<int>(1, 0),
             const AccelerationMode accelerationMode = GPU_ONLY,
@@ -24,16 +31,33 @@ public:
     explicit RandomForestImage(const std::vector<boost::shared_ptr<RandomTreeImage> >& ensemble,
             const TrainingConfiguration& configuration);
 
-    void train(const std::vector<LabeledRGBDImage>& trainLabelImages, bool trainTreesSequentially = false);
+    /**
+     * Trains all trees of the ensemble.
+     * Trees that already exist (forest constructed from an ensemble) are not re-created: their training continues
+     * at the current leaves up to the maxDepth of the configuration (warm start).
+     *
+     * If 'outOfBagConfusionMatrix' is not null, it is filled with the out-of-bag estimate of the forest accuracy:
+     * pixels with valid depth are drawn from all training images and every pixel is classified by the trees that
+     * were not trained on it, i.e. trees that did not subsample the pixel or did not select its image.
+     * The histograms are normalized without bias for this estimate.
+     * The estimate is optimistic for warm-started trees since their earlier training pixels are unknown.
+     *
+     * If 'imageLoader' is set, the images need to provide only labels and depth (see loadLabelImages()).
+     * The pixels of all trees are drawn first and the loader is called with the numbers of the sampled images, which
+     * must be completely loaded in place (see loadColorImages()) before the trees are grown.
+     */
+    void train(const std::vector<LabeledRGBDImage>& trainLabelImages, bool trainTreesSequentially = false,
+            ConfusionMatrix* outOfBagConfusionMatrix = 0, const ImageLoader& imageLoader = ImageLoader());
 
     /**
      * @param image the image which should be classified
      * @param if not null, probabilities per class in a C×H×W matrix for C classes and an image of size W×H
+     * @param pyramidLevel the image was downsampled by 2^pyramidLevel. the features are scaled accordingly (CPU only)
      * @return prediction image which has the same size as 'image'
      */
     LabelImage predict(const RGBDImage& image,
             cuv::ndarray<float, cuv::host_memory_space>* prediction = 0,
-            const bool onGPU = true) const;
+            const bool onGPU = true, const int pyramidLevel = 0) const;
 
     std::map<std::string, size_t> countFeatures() const;
 
@@ -61,8 +85,31 @@ public:
 
     void normalizeHistograms(const double histogramBias);
 
+    /**
+     * Prunes all trees of the forest with held-out labeled images and normalizes the histograms again.
+     * See RandomTreeImage::prune.
+     */
+    void prune(const std::vector<LabeledRGBDImage>& validationImages, const double tolerance,
+            const double histogramBias);
+
+    /**
+     * Refits the histograms of all trees with every pixel of the given images that training could sample
+     * (valid depth, no ignored label) and normalizes them again. The counts are accumulated in 64 bits.
+     * The images are streamed: each image is loaded, pushed through all trees and released.
+     * The tree structure is not changed. See RandomTreeImage::refitHistograms.
+     *
+     * @param blend weight of the original histograms and prior distributions in [0, 1]. 0 replaces them.
+     * @param manifest the naming and formats of the depth and label images of the color images 'imageFilenames'
+     */
+    void refitHistograms(const std::vector<std::string>& imageFilenames, bool useCIELab, bool useDepthFilling,
+            const double blend, const double histogramBias, const DatasetManifest& manifest = DatasetManifest());
+
 private:
 
+    void estimateOutOfBagAccuracy(const DatasetIndex& index,
+            const std::vector<std::vector<PixelInstance> >& trainingSamples,
+            const RandomSource& randomSource, const ImageLoader& imageLoader, ConfusionMatrix& confusionMatrix);
+
     TrainingConfiguration configuration;
 
     std::vector<boost::shared_ptr<RandomTreeImage> > ensemble;
@@ -73,13 +73,34 @@ cuv::ndarray<double, cuv::host_memory_space> normalizeHistogram(
 }
 }
 
+uint64_t Sampler::nextBounded(uint64_t range) {
+    assert(range > 0 && range <= (1ull << 32));
+    // Lemire's nearly divisionless method for unbiased integers in [0, range)
+    uint64_t product = static_cast<uint64_t>(nextRandom()) * range;
+    uint32_t low = static_cast<uint32_t>(product);
+    if (low < range) {
+        const uint32_t threshold = static_cast<uint32_t>(((1ull << 32) - range) % range);
+        while (low < threshold) {
+            product = static_cast<uint64_t>(nextRandom()) * range;
+            low = static_cast<uint32_t>(product);
+        }
+    }
+    return product >> 32;
+}
+
 int Sampler::getNext() {
-    int value = distribution(rng);
+    int value = static_cast<int>(lower + static_cast<int64_t>(nextBounded(range)));
     assert(value >= lower);
     assert(value <= upper);
     return value;
 }
 
+size_t Sampler::getNextBelow(size_t bound) {
+    size_t value = static_cast<size_t>(nextBounded(bound));
+    assert(value < bound);
+    return value;
+}
+
 AccelerationMode TrainingConfiguration::parseAccelerationModeString(const std::string& modeString) {
     if (modeString == "cpu") {
         return AccelerationMode::CPU_ONLY;
@@ -128,6 +149,14 @@ TrainingConfiguration& TrainingConfiguration::operator=(const TrainingConfigurat
     deviceIds = other.deviceIds;
     subsamplingType = other.subsamplingType;
     ignoredColors = other.ignoredColors;
+    sortTileSize = other.sortTileSize;
+    useFloatResponses = other.useFloatResponses;
+    useFlipAugmentation = other.useFlipAugmentation;
+    scaleJitter = other.scaleJitter;
+    pyramidLevel = other.pyramidLevel;
+    depthFeatureCost = other.depthFeatureCost;
+    colorFeatureCost = other.colorFeatureCost;
+    nanResponseCost = other.nanResponseCost;
     assert(*this == other);
     return *this;
 }
@@ -172,6 +201,20 @@ bool TrainingConfiguration::equals(const TrainingConfiguration& other,
         return false;
     if (useDepthFilling != other.useDepthFilling)
         return false;
+    if (useFloatResponses != other.useFloatResponses)
+        return false;
+    if (useFlipAugmentation != other.useFlipAugmentation)
+        return false;
+    if (scaleJitter != other.scaleJitter)
+        return false;
+    if (pyramidLevel != other.pyramidLevel)
+        return false;
+    if (depthFeatureCost != other.depthFeatureCost)
+        return false;
+    if (colorFeatureCost != other.colorFeatureCost)
+        return false;
+    if (nanResponseCost != other.nanResponseCost)
+        return false;
 
     return true;
 }
@@ -206,5 +249,13 @@ std::ostream& operator<<(std::ostream& os, const curfil::TrainingConfiguration&
     os << "useDepthFilling: " << configuration.isUseDepthFilling() << std::endl;
     os << "deviceIds: " << joinToString(configuration.getDeviceIds()) << std::endl;
     os << "ignoredColors: " << joinToString(configuration.getIgnoredColors()) << std::endl;
+    os << "sortTileSize: " << configuration.getSortTileSize() << std::endl;
+    os << "useFloatResponses: " << configuration.isUseFloatResponses() << std::endl;
+    os << "useFlipAugmentation: " << configuration.isUseFlipAugmentation() << std::endl;
+    os << "scaleJitter: " << configuration.getScaleJitter() << std::endl;
+    os << "pyramidLevel: " << configuration.getPyramidLevel() << std::endl;
+    os << "depthFeatureCost: " << configuration.getDepthFeatureCost() << std::endl;
+    os << "colorFeatureCost: " << configuration.getColorFeatureCost() << std::endl;
+    os << "nanResponseCost: " << configuration.getNaNResponseCost() << std::endl;
     return os;
 }
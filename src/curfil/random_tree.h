@@ -37,6 +37,15 @@ cuv::ndarray<double, cuv::host_memory_space> normalizeHistogram(
         const cuv::ndarray<WeightType, cuv::host_memory_space>& priorDistribution,
         const double histogramBias);
 
+static const uint64_t GOLDEN_GAMMA = 0x9E3779B97F4A7C15ull;
+
+// finalizer of SplitMix64
+inline uint64_t mixBits(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
 }
 
 // Test/training-time classes
@@ -76,8 +85,11 @@ public:
     }
 
     // Return left or right branch for a given instance and feature function.
+    // Instances must be routed in the precision that the split was scored in.
+    // See TrainingConfiguration::isUseFloatResponses()
+    template<class ResponseType = FeatureResponseType>
     SplitBranch split(const Instance& instance) const {
-        return (feature.calculateFeatureResponse(instance) <= getThreshold() ? LEFT : RIGHT);
+        return (feature.template calculateFeatureResponse<ResponseType>(instance) <= getThreshold() ? LEFT : RIGHT);
     }
 
     // Return the underlying feature used
@@ -128,7 +140,15 @@ public:
                     useDepthFilling(0),
                     deviceIds(),
                     subsamplingType(),
-                    ignoredColors() {
+                    ignoredColors(),
+                    sortTileSize(0),
+                    useFloatResponses(false),
+                    useFlipAugmentation(false),
+                    scaleJitter(0),
+                    pyramidLevel(0),
+                    depthFeatureCost(0),
+                    colorFeatureCost(0),
+                    nanResponseCost(0) {
     }
 
     TrainingConfiguration(const TrainingConfiguration& other);
@@ -150,7 +170,15 @@ public:
             bool useDepthFilling = false,
             const std::vector<int> deviceIds = std::vector<int>(1, 0),
             const std::string subsamplingType = "classUniform",
-            const std::vector<std::string>& ignoredColors = std::vector<std::string>()) :
+            const std::vector<std::string>& ignoredColors = std::vector<std::string>(),
+            uint16_t sortTileSize = 16,
+            bool useFloatResponses = false,
+            bool useFlipAugmentation = false,
+            float scaleJitter = 0.0f,
+            int pyramidLevel = 0,
+            float depthFeatureCost = 0.0f,
+            float colorFeatureCost = 0.0f,
+            float nanResponseCost = 0.0f) :
             randomSeed(randomSeed),
                     samplesPerImage(samplesPerImage),
                     featureCount(featureCount),
@@ -168,13 +196,46 @@ public:
                     useDepthFilling(useDepthFilling),
                     deviceIds(deviceIds),
                     subsamplingType(subsamplingType),
-                    ignoredColors(ignoredColors)
+                    ignoredColors(ignoredColors),
+                    sortTileSize(sortTileSize),
+                    useFloatResponses(useFloatResponses),
+                    useFlipAugmentation(useFlipAugmentation),
+                    scaleJitter(scaleJitter),
+                    pyramidLevel(pyramidLevel),
+                    depthFeatureCost(depthFeatureCost),
+                    colorFeatureCost(colorFeatureCost),
+                    nanResponseCost(nanResponseCost)
     {
         for (size_t c = 0; c < ignoredColors.size(); c++) {
             if (ignoredColors[c].empty()) {
                 throw std::runtime_error(std::string("illegal color: '") + ignoredColors[c] + "'");
             }
         }
+        if (sortTileSize == 0) {
+            throw std::runtime_error("illegal configuration: sortTileSize must be larger than zero");
+        }
+        if (useFloatResponses && accelerationMode != CPU_ONLY) {
+            throw std::runtime_error("illegal configuration: float feature responses are only supported in CPU mode");
+        }
+        if (scaleJitter < 0 || scaleJitter >= 1) {
+            throw std::runtime_error(
+                    (boost::format("illegal configuration: scaleJitter (%f) must be in [0, 1)") % scaleJitter).str());
+        }
+        if ((useFlipAugmentation || scaleJitter > 0) && accelerationMode != CPU_ONLY) {
+            throw std::runtime_error("illegal configuration: data augmentation is only supported in CPU mode");
+        }
+        if (pyramidLevel < 0 || pyramidLevel > MAX_PYRAMID_LEVEL) {
+            throw std::runtime_error((boost::format("illegal configuration: pyramidLevel (%d) must be in [0, %d]")
+                    % pyramidLevel % static_cast<int>(MAX_PYRAMID_LEVEL)).str());
+        }
+        if (pyramidLevel > 0 && accelerationMode != CPU_ONLY) {
+            throw std::runtime_error("illegal configuration: training on a pyramid level is only supported in CPU mode");
+        }
+        if (depthFeatureCost < 0 || colorFeatureCost < 0 || nanResponseCost < 0) {
+            throw std::runtime_error(
+                    (boost::format("illegal configuration: feature costs (%f, %f, %f) must not be negative")
+                            % depthFeatureCost % colorFeatureCost % nanResponseCost).str());
+        }
         if (maxImages > 0 && maxImages < imageCacheSize) {
             throw std::runtime_error(
                     (boost::format("illegal configuration: maxImages (%d) must not be lower than imageCacheSize (%d)")
@@ -270,6 +331,61 @@ public:
         return ignoredColors;
     }
 
+    // edge length in pixels of the spatial tiles by which the training samples are sorted
+    uint16_t getSortTileSize() const {
+        return sortTileSize;
+    }
+
+    // whether feature responses are calculated in single instead of double precision during CPU training
+    bool isUseFloatResponses() const {
+        return useFloatResponses;
+    }
+
+    // whether the training samples are randomly mirrored horizontally
+    bool isUseFlipAugmentation() const {
+        return useFlipAugmentation;
+    }
+
+    // the training samples are randomly scaled by a factor in [1 - scaleJitter, 1 + scaleJitter]
+    float getScaleJitter() const {
+        return scaleJitter;
+    }
+
+    bool isUseAugmentation() const {
+        return (useFlipAugmentation || scaleJitter > 0);
+    }
+
+    /**
+     * The training images are downsampled by 2^pyramidLevel.
+     * Feature offsets and regions are kept in full-resolution pixels such that the trees predict full-resolution images.
+     */
+    int getPyramidLevel() const {
+        return pyramidLevel;
+    }
+
+    static const int MAX_PYRAMID_LEVEL = 4;
+
+    /**
+     * Inference cost of depth and color features that is used to penalize the split scores.
+     * A depth feature reads eight integral values, a color feature reads four.
+     */
+    float getDepthFeatureCost() const {
+        return depthFeatureCost;
+    }
+
+    float getColorFeatureCost() const {
+        return colorFeatureCost;
+    }
+
+    // additional cost of a feature that is weighted by the estimated fraction of NaN responses
+    float getNaNResponseCost() const {
+        return nanResponseCost;
+    }
+
+    bool isUseFeatureCosts() const {
+        return (depthFeatureCost > 0 || colorFeatureCost > 0 || nanResponseCost > 0);
+    }
+
     TrainingConfiguration& operator=(const TrainingConfiguration& other);
 
     bool equals(const TrainingConfiguration& other, bool strict = false) const;
@@ -303,6 +419,14 @@ private:
     std::vector<int> deviceIds;
     std::string subsamplingType;
     std::vector<std::string> ignoredColors;
+    uint16_t sortTileSize;
+    bool useFloatResponses;
+    bool useFlipAugmentation;
+    float scaleJitter;
+    int pyramidLevel;
+    float depthFeatureCost;
+    float colorFeatureCost;
+    float nanResponseCost;
 };
 
 template<class Instance, class FeatureFunction>
@@ -387,14 +511,28 @@ public:
         node->collectNodeIndices(instance, nodeSet, includeRoot);
     }
 
+    // Returns the leaf node an instance traverses to, starting at the given node
+    template<class ResponseType = FeatureResponseType>
+    static boost::shared_ptr<RandomTree<Instance, FeatureFunction> > findLeaf(
+            boost::shared_ptr<RandomTree<Instance, FeatureFunction> > node, const Instance& instance) {
+        assert(node);
+        while (!node->isLeaf()) {
+            node = (node->split.template split<ResponseType>(instance) == LEFT) ? node->left : node->right;
+            assert(node);
+        }
+        return node;
+    }
+
     // Classify an instance by traversing the tree and returning the tree leaf
     // nodes leaf class.
+    template<class ResponseType = FeatureResponseType>
     LabelType classify(const Instance& instance) const {
-        return traverseToLeaf(instance)->getDominantClass();
+        return traverseToLeaf<ResponseType>(instance)->getDominantClass();
     }
 
+    template<class ResponseType = FeatureResponseType>
     const cuv::ndarray<double, cuv::host_memory_space>& classifySoft(const Instance& instance) const {
-        return (traverseToLeaf(instance)->getNormalizedHistogram());
+        return (traverseToLeaf<ResponseType>(instance)->getNormalizedHistogram());
     }
 
     size_t getNumTrainSamples() const {
@@ -478,6 +616,87 @@ public:
         return (1 + std::max(left->getTreeDepth(), right->getTreeDepth()));
     }
 
+    size_t getMaxNodeId() const {
+        if (isLeaf())
+            return nodeId;
+        return std::max(nodeId, std::max(left->getMaxNodeId(), right->getMaxNodeId()));
+    }
+
+    // Adds the instance to the histograms of all nodes it traverses through (used for pruning and refitting).
+    // histograms is a N×C matrix, accessed by histograms(row, label), where row (nodeId - rootNodeId) belongs to
+    // the node.
+    template<class ResponseType = FeatureResponseType, class Histograms>
+    void addSampleToHistograms(const Instance& instance, Histograms& histograms, const size_t rootNodeId) const {
+        const RandomTree<Instance, FeatureFunction>* node = this;
+        while (true) {
+            assert(node->getNodeId() >= rootNodeId);
+            histograms(node->getNodeId() - rootNodeId, instance.getLabel()) += instance.getWeight();
+            if (node->isLeaf()) {
+                break;
+            }
+            node = (node->split.template split<ResponseType>(instance) == LEFT) ? node->left.get() : node->right.get();
+            assert(node);
+        }
+    }
+
+    /**
+     * Replaces the histograms of all nodes by the rows (nodeId - rootNodeId) of the given N×C matrix.
+     *
+     * With blend > 0, the original histograms are kept with weight 'blend'. They are scaled such that
+     * the original root histogram has the same number of samples as the new root histogram.
+     */
+    void refitHistograms(const cuv::ndarray<double, cuv::host_memory_space>& histograms, const size_t rootNodeId,
+            const double blend) {
+        assert(isRoot());
+        assert(blend >= 0.0 && blend <= 1.0);
+
+        double newSamples = 0;
+        double originalSamples = 0;
+        for (size_t label = 0; label < numClasses; label++) {
+            newSamples += histograms(nodeId - rootNodeId, label);
+            originalSamples += histogram[label];
+        }
+
+        const double scale = (originalSamples > 0) ? newSamples / originalSamples : 0.0;
+        doRefitHistograms(histograms, rootNodeId, blend, scale);
+    }
+    /**
+     * Reduced-error pruning.
+     *
+     * Collapses the subtree below a node if the node—as a leaf—misclassifies at most
+     * tolerance × (validation samples at the node) more validation samples than its (already pruned) subtree.
+     * Nodes are visited bottom-up. Collapsed nodes keep their histograms.
+     * Histograms must be normalized as the prediction of a node is the maximum of its normalized histogram.
+     *
+     * @return the number of misclassified validation samples of the pruned subtree
+     */
+    double prune(const cuv::ndarray<WeightType, cuv::host_memory_space>& validationHistograms,
+            const size_t rootNodeId, const double tolerance) {
+
+        assert(nodeId >= rootNodeId);
+        const size_t row = nodeId - rootNodeId;
+
+        double numSamples = 0;
+        for (size_t label = 0; label < numClasses; label++) {
+            numSamples += validationHistograms(row, label);
+        }
+        const double leafErrors = numSamples - validationHistograms(row, getPredictedClass());
+
+        if (isLeaf()) {
+            return leafErrors;
+        }
+
+        const double subtreeErrors = left->prune(validationHistograms, rootNodeId, tolerance)
+                + right->prune(validationHistograms, rootNodeId, tolerance);
+
+        if (leafErrors <= subtreeErrors + tolerance * numSamples) {
+            collapse();
+            return leafErrors;
+        }
+
+        return subtreeErrors;
+    }
+
     // Links the given left/right subtrees as children to this one.
     // Assigns unique labels to the children nodes.
     // Makes the current node a non-leaf node.
@@ -508,6 +727,49 @@ public:
         leaf = false;
     }
 
+    // Replaces the train samples and the histogram of a leaf node.
+    // Used to continue training of an already trained tree.
+    void resetTrainSamples(const std::vector<const Instance*>& samples) {
+        assert(isLeaf());
+
+        for (size_t label = 0; label < numClasses; label++) {
+            histogram[label] = 0;
+        }
+
+        trainSamples.clear();
+        for (size_t i = 0; i < samples.size(); i++) {
+            histogram[samples[i]->getLabel()] += samples[i]->getWeight();
+            trainSamples.push_back(*samples[i]);
+        }
+    }
+
+    // Assigns contiguous node ids in breadth-first order, starting with the id of this (root) node.
+    // Required after pruning since the GPU tree representation indexes nodes by their id.
+    void renumberNodes() {
+        assert(isRoot());
+        size_t nextNodeId = nodeId + 1;
+        std::vector<RandomTree<Instance, FeatureFunction>*> nodes(1, this);
+        for (size_t i = 0; i < nodes.size(); i++) {
+            RandomTree<Instance, FeatureFunction>* node = nodes[i];
+            if (node->isLeaf()) {
+                continue;
+            }
+            node->left->nodeId = nextNodeId++;
+            node->right->nodeId = nextNodeId++;
+            nodes.push_back(node->left.get());
+            nodes.push_back(node->right.get());
+        }
+    }
+
+    // Releases both subtrees and turns this node into a leaf.
+    // The node keeps its histogram and normalized histogram.
+    void collapse() {
+        assert(!isLeaf());
+        left.reset();
+        right.reset();
+        leaf = true;
+    }
+
     bool isLeaf() const {
         return leaf;
     }
@@ -573,7 +835,7 @@ public:
 
 private:
     // A unique node identifier within this tree
-    const size_t nodeId;
+    size_t nodeId;
     const int level;
 
     /*
@@ -619,6 +881,37 @@ private:
         return maxClass;
     }
 
+    void doRefitHistograms(const cuv::ndarray<double, cuv::host_memory_space>& histograms, const size_t rootNodeId,
+            const double blend, const double scale) {
+        assert(nodeId >= rootNodeId);
+        for (size_t label = 0; label < numClasses; label++) {
+            const double value = (1.0 - blend) * histograms(nodeId - rootNodeId, label)
+                    + blend * scale * histogram[label];
+            if (value + 0.5 > std::numeric_limits<WeightType>::max()) {
+                throw std::runtime_error((boost::format("histogram count of node %d overflows: %.0f")
+                        % nodeId % value).str());
+            }
+            histogram[label] = static_cast<WeightType>(value + 0.5);
+        }
+        if (!isLeaf()) {
+            left->doRefitHistograms(histograms, rootNodeId, blend, scale);
+            right->doRefitHistograms(histograms, rootNodeId, blend, scale);
+        }
+    }
+
+    // the class with the highest probability in the normalized histogram
+    LabelType getPredictedClass() const {
+        const cuv::ndarray<double, cuv::host_memory_space>& probabilities = getNormalizedHistogram();
+        LabelType maxClass = 0;
+        for (LabelType classNr = 1; classNr < probabilities.size(); classNr++) {
+            if (probabilities[classNr] > probabilities[maxClass]) {
+                maxClass = classNr;
+            }
+        }
+        return maxClass;
+    }
+
+    template<class ResponseType>
     const RandomTree<Instance, FeatureFunction>* traverseToLeaf(const Instance& instance) const {
         if (isLeaf())
             return this;
@@ -626,30 +919,42 @@ private:
         assert(left.get());
         assert(right.get());
 
-        if (split.split(instance) == LEFT) {
-            return left->traverseToLeaf(instance);
+        if (split.template split<ResponseType>(instance) == LEFT) {
+            return left->template traverseToLeaf<ResponseType>(instance);
         } else {
-            return right->traverseToLeaf(instance);
+            return right->template traverseToLeaf<ResponseType>(instance);
         }
     }
 
 };
 
+/**
+ * Draws uniformly distributed integers from the closed interval [lower, upper].
+ *
+ * The generator is counter-based (SplitMix64): the n-th number is a hash of the key and n.
+ * A copy of a sampler starts again with the first number of the stream.
+ */
 class Sampler {
 public:
-    Sampler(int seed, int lower, int upper) :
-            seed(seed), lower(lower), upper(upper), rng(seed), distribution(lower, upper) {
+    Sampler(uint64_t key, int lower, int upper) :
+            key(key), counter(0), lower(lower), upper(upper),
+                    range(static_cast<uint64_t>(static_cast<int64_t>(upper) - lower) + 1) {
         assert(upper >= lower);
     }
 
     Sampler(const Sampler& other) :
-            seed(other.seed), lower(other.lower), upper(other.upper), rng(seed), distribution(lower, upper) {
+            key(other.key), counter(0), lower(other.lower), upper(other.upper), range(other.range) {
     }
 
     int getNext();
 
-    int getSeed() const {
-        return seed;
+    /**
+     * @return an unbiased random number from the interval [0, bound) that is drawn from the stream of this sampler
+     */
+    size_t getNextBelow(size_t bound);
+
+    uint64_t getSeed() const {
+        return key;
     }
 
     int getLower() const {
@@ -664,12 +969,17 @@ private:
     Sampler& operator=(const Sampler&);
     Sampler();
 
-    int seed;
+    uint32_t nextRandom() {
+        return static_cast<uint32_t>(detail::mixBits(key + (++counter) * detail::GOLDEN_GAMMA) >> 32);
+    }
+
+    uint64_t nextBounded(uint64_t range);
+
+    uint64_t key;
+    uint64_t counter;
     int lower;
     int upper;
-
-    boost::mt19937 rng;
-    boost::uniform_int<> distribution;
+    uint64_t range;
 };
 
 template<class T>
@@ -699,7 +1009,7 @@ public:
         } else {
             assert(count >= samples);
             // draw a random number from the interval (0, count) including count!
-            size_t rand = sampler.getNext() % (count + 1);
+            size_t rand = sampler.getNextBelow(count + 1);
             if (rand < samples) {
                 reservoir[rand] = sample;
             }
@@ -719,14 +1029,40 @@ private:
 };
 
 // Training-time classes
+/**
+ * Identifiers of the independent random streams that are used to train a tree
+ */
+enum RandomStream {
+    IMAGE_SELECTION_STREAM = 1,
+    SUBSAMPLING_STREAM,
+    FEATURE_GENERATION_STREAM,
+    AUGMENTATION_STREAM,
+    IMAGE_SIZE_STREAM
+};
+
+/**
+ * A splittable source of random samplers.
+ *
+ * split() derives an independent source that only depends on the key of this source and the given id,
+ * but not on the samplers that were drawn before. Randomness that is keyed by tree, level or purpose
+ * therefore does not depend on the order in which trees and nodes are trained or on the number of threads.
+ */
 class RandomSource {
 
 private:
-    int seed;
+    uint64_t key;
+    uint64_t counter;
+
+    struct Key {
+    };
+
+    RandomSource(uint64_t key, Key) :
+            key(key), counter(0) {
+    }
 
 public:
     RandomSource(int seed) :
-            seed(seed) {
+            key(detail::mixBits(static_cast<uint64_t>(static_cast<int64_t>(seed)))), counter(0) {
     }
 
     Sampler uniformSampler(int val) {
@@ -734,7 +1070,11 @@ public:
     }
 
     Sampler uniformSampler(int lower, int upper) {
-        return Sampler(seed++, lower, upper);
+        return Sampler(detail::mixBits(key + (++counter) * detail::GOLDEN_GAMMA), lower, upper);
+    }
+
+    RandomSource split(uint64_t id) const {
+        return RandomSource(detail::mixBits(key ^ detail::mixBits(id + detail::GOLDEN_GAMMA)), Key());
     }
 };
 
@@ -765,6 +1105,10 @@ private:
         if (node->getNumTrainSamples() < configuration.getMinSampleCount()) {
             return false;
         }
+        // nodes of a warm-started tree can be on different levels
+        if (node->getLevel() >= configuration.getMaxDepth()) {
+            return false;
+        }
 
         return true;
     }
@@ -828,8 +1172,11 @@ public:
 
         std::vector<std::pair<RandomTreePointer, Samples> > samplesPerNodeNextLevel;
 
+        // every training round draws from its own stream. the nodes of a warm-started tree can be on different
+        // levels, but the rounds of one training are unique
+        RandomSource roundRandomSource = randomSource.split(currentLevel);
         std::vector<SplitFunction<Instance, FeatureFunction> > bestSplits = featureEvaluation.evaluateBestSplits(
-                randomSource, samplesPerNode);
+                roundRandomSource, samplesPerNode);
 
         assert(bestSplits.size() == samplesPerNode.size());
 
@@ -850,9 +1197,13 @@ public:
             std::vector<const Instance*> samplesLeft;
             std::vector<const Instance*> samplesRight;
 
+            // routes in the precision the split was scored in
+            const bool useFloatResponses = configuration.isUseFloatResponses();
             for (size_t sample = 0; sample < samples.size(); sample++) {
                 assert(samples[sample] != NULL);
-                if (bestSplit.split(*samples[sample]) == LEFT) {
+                const SplitBranch branch = useFloatResponses ?
+                        bestSplit.template split<float>(*samples[sample]) : bestSplit.split(*samples[sample]);
+                if (branch == LEFT) {
                     samplesLeft.push_back(samples[sample]);
                 } else {
                     samplesRight.push_back(samples[sample]);
@@ -908,6 +1259,81 @@ public:
         }
     }
 
+    /* Continue training of an already trained tree (warm start).
+     * The samples are routed down the existing splits to the current leaves.
+     * The histograms of all existing nodes are replaced by the histograms of the routed samples, such that
+     * the histogram of every node stays the sum of the histograms of its children (see RandomTree::prune).
+     * Leaves that should continue growing are re-initialized with their samples and trained breadth-first.
+     * New nodes get ids above the largest node id of the tree.
+     */
+    void trainFromLeaves(FeatureEvaluation& featureEvaluation,
+            RandomSource& randomSource,
+            const RandomTreePointer& tree,
+            const Samples& samples) const {
+
+        assert(tree->isRoot());
+
+        const bool useFloatResponses = configuration.isUseFloatResponses();
+        const size_t rootNodeId = tree->getNodeId();
+        const size_t numNodeIds = tree->getMaxNodeId() - rootNodeId + 1;
+        cuv::ndarray<WeightType, cuv::host_memory_space> histograms(numNodeIds, numClasses);
+        for (size_t i = 0; i < histograms.size(); i++) {
+            histograms[i] = 0;
+        }
+
+        // ordered by node id to be deterministic
+        std::map<size_t, std::pair<RandomTreePointer, Samples> > samplesPerLeaf;
+        for (size_t sample = 0; sample < samples.size(); sample++) {
+            assert(samples[sample] != NULL);
+            RandomTreePointer leaf;
+            if (useFloatResponses) {
+                leaf = RandomTree<Instance, FeatureFunction>::template findLeaf<float>(tree, *samples[sample]);
+                tree->template addSampleToHistograms<float>(*samples[sample], histograms, rootNodeId);
+            } else {
+                leaf = RandomTree<Instance, FeatureFunction>::findLeaf(tree, *samples[sample]);
+                tree->addSampleToHistograms(*samples[sample], histograms, rootNodeId);
+            }
+            std::pair<RandomTreePointer, Samples>& leafSamples = samplesPerLeaf[leaf->getNodeId()];
+            leafSamples.first = leaf;
+            leafSamples.second.push_back(samples[sample]);
+        }
+
+        cuv::ndarray<double, cuv::host_memory_space> nodeHistograms(numNodeIds, numClasses);
+        for (size_t i = 0; i < histograms.size(); i++) {
+            nodeHistograms[i] = histograms[i];
+        }
+        const double blend = 0.0;
+        tree->refitHistograms(nodeHistograms, rootNodeId, blend);
+
+        std::vector<std::pair<RandomTreePointer, Samples> > samplesPerNode;
+        int currentLevel = configuration.getMaxDepth();
+
+        typename std::map<size_t, std::pair<RandomTreePointer, Samples> >::const_iterator it;
+        for (it = samplesPerLeaf.begin(); it != samplesPerLeaf.end(); it++) {
+            const RandomTreePointer& leaf = it->second.first;
+            const Samples& leafSamples = it->second.second;
+
+            RandomTreePointer candidate = boost::make_shared<RandomTree<Instance, FeatureFunction> >(
+                    leaf->getNodeId(), leaf->getLevel(), leafSamples, numClasses);
+            if (!shouldContinueGrowing(candidate)) {
+                continue;
+            }
+
+            leaf->resetTrainSamples(leafSamples);
+            samplesPerNode.push_back(std::make_pair(leaf, leafSamples));
+            currentLevel = std::min(currentLevel, leaf->getLevel());
+        }
+
+        CURFIL_INFO("continuing training of " << samplesPerNode.size() << " out of " << tree->countLeafNodes()
+                << " leaves with " << samples.size() << " samples");
+
+        if (samplesPerNode.empty()) {
+            return;
+        }
+
+        train(featureEvaluation, randomSource, samplesPerNode, tree->getMaxNodeId(), currentLevel);
+    }
+
 private:
 
     template<class T>
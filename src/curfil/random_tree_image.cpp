@@ -1,14 +1,16 @@
 #include "random_tree_image.h"
 
 #include <boost/format.hpp>
+#include <limits>
 #include <map>
 #include <math.h>
 #include <set>
 #include <tbb/mutex.h>
+#include <tbb/parallel_for.h>
 #include <tbb/parallel_for_each.h>
-#include <thrust/gather.h>
-#include <thrust/sort.h>
+#include <tbb/parallel_sort.h>
 
+#include "dataset_index.h"
 #include "ndarray_ops.h"
 #include "random_tree_image_gpu.h"
 #include "random_tree.h"
@@ -19,6 +21,109 @@ namespace curfil {
 // for statistics
 extern ImageCache imageCache;
 
+/**
+ * Chooses the block sizes of the CPU feature evaluation: the number of samples of one image and the number of features
+ * that are evaluated as one block.
+ *
+ * Every candidate is used for a few nodes with enough work. Each evaluation task reports the CPU time of its thread,
+ * which, unlike the wall-clock time of a node, does not include the time spent waiting for other tasks or for other
+ * trees in the same arena. The fastest candidate is used afterwards.
+ * The block sizes do not change the results, only the cache behaviour.
+ */
+class BlockSizeTuner {
+
+public:
+
+    struct BlockSize {
+        size_t numSamples;
+        size_t numFeatures;
+    };
+
+    BlockSizeTuner() :
+            mutex(), bestCandidate(DEFAULT_CANDIDATE), tuned(false),
+                    numMeasurements(NUM_CANDIDATES, 0),
+                    secondsPerEvaluation(NUM_CANDIDATES, std::numeric_limits<double>::infinity()) {
+    }
+
+    BlockSize getBlockSize(size_t numEvaluations) {
+        tbb::mutex::scoped_lock lock(mutex);
+        if (tuned || numEvaluations < MIN_EVALUATIONS) {
+            return CANDIDATES[bestCandidate];
+        }
+        for (size_t i = 0; i < NUM_CANDIDATES; i++) {
+            if (numMeasurements[i] < MEASUREMENTS_PER_CANDIDATE) {
+                return CANDIDATES[i];
+            }
+        }
+        return CANDIDATES[bestCandidate];
+    }
+
+    void report(const BlockSize& blockSize, size_t numEvaluations, double cpuSeconds) {
+        if (numEvaluations < MIN_EVALUATIONS_PER_TASK) {
+            return;
+        }
+
+        tbb::mutex::scoped_lock lock(mutex);
+        if (tuned) {
+            return;
+        }
+
+        size_t best = 0;
+        bool complete = true;
+        for (size_t i = 0; i < NUM_CANDIDATES; i++) {
+            if (CANDIDATES[i].numSamples == blockSize.numSamples
+                    && CANDIDATES[i].numFeatures == blockSize.numFeatures) {
+                numMeasurements[i]++;
+                secondsPerEvaluation[i] = std::min(secondsPerEvaluation[i], cpuSeconds / numEvaluations);
+            }
+            if (numMeasurements[i] < MEASUREMENTS_PER_CANDIDATE) {
+                complete = false;
+            }
+            if (secondsPerEvaluation[i] < secondsPerEvaluation[best]) {
+                best = i;
+            }
+        }
+
+        if (complete) {
+            tuned = true;
+            bestCandidate = best;
+            CURFIL_INFO("CPU feature evaluation: using blocks of " << CANDIDATES[best].numSamples << " samples and "
+                    << CANDIDATES[best].numFeatures << " features (" << secondsPerEvaluation[best] * 1e9
+                    << " ns per feature response)");
+        }
+    }
+
+private:
+
+    static const size_t NUM_CANDIDATES = 12;
+    static const BlockSize CANDIDATES[NUM_CANDIDATES];
+    // 64 samples and 64 features
+    static const size_t DEFAULT_CANDIDATE = 7;
+    // the minimum of a few tasks is robust against preemption and other noise
+    static const size_t MEASUREMENTS_PER_CANDIDATE = 8;
+    // nodes with less feature responses do not take part in the tuning
+    static const size_t MIN_EVALUATIONS = 1000000;
+    // tasks with less feature responses are too short to be timed
+    static const size_t MIN_EVALUATIONS_PER_TASK = 100000;
+
+    tbb::mutex mutex;
+    size_t bestCandidate;
+    bool tuned;
+    std::vector<size_t> numMeasurements;
+    std::vector<double> secondsPerEvaluation;
+};
+
+const BlockSizeTuner::BlockSize BlockSizeTuner::CANDIDATES[NUM_CANDIDATES] = {
+        { 16, 16 }, { 16, 64 }, { 16, 256 },
+        { 32, 16 }, { 32, 64 }, { 32, 256 },
+        { 64, 16 }, { 64, 64 }, { 64, 256 },
+        { 256, 16 }, { 256, 64 }, { 256, 256 } };
+
+// the best block sizes depend on the machine, not on the tree
+static BlockSizeTuner blockSizeTuner;
+
+// the responses are calculated and compared to the (float) thresholds in the given precision
+template<class ResponseType>
 class FeatureEvaluationCPU {
 
 public:
@@ -26,20 +131,28 @@ public:
     FeatureEvaluationCPU(size_t numClasses,
             size_t numFeatures,
             size_t numThresholds,
+            const BlockSizeTuner::BlockSize& blockSize,
             const std::vector<const PixelInstance*>& samples,
             const ImageFeaturesAndThresholds<cuv::host_memory_space>& features,
-            tbb::concurrent_vector<cuv::ndarray<WeightType, cuv::host_memory_space>>& perClassHistograms) :
+            tbb::concurrent_vector<cuv::ndarray<WeightType, cuv::host_memory_space>>& perClassHistograms,
+            tbb::concurrent_vector<cuv::ndarray<WeightType, cuv::host_memory_space>>& nanCounters) :
             numClasses(numClasses),
                     numFeatures(numFeatures),
                     numThresholds(numThresholds),
-                    samples(samples), features(features), perClassHistograms(perClassHistograms) {
+                    blockSize(blockSize),
+                    samples(samples), features(features), perClassHistograms(perClassHistograms),
+                    nanCounters(nanCounters) {
 
         assert(!samples.empty());
+        assert(blockSize.numSamples > 0);
+        assert(blockSize.numFeatures > 0);
     }
 
     // must be a const-method for TBB
     void operator()(const tbb::blocked_range<size_t>& range) const {
 
+        const double cpuSecondsStart = utils::getThreadCPUSeconds();
+
         cuv::ndarray<WeightType, cuv::host_memory_space> perClassHistogram(
                 cuv::extents[numClasses][numFeatures][numThresholds][2]);
 
@@ -47,19 +160,25 @@ public:
             perClassHistogram[i] = 0;
         }
 
+        // the weight of the samples with a NaN response per feature
+        cuv::ndarray<WeightType, cuv::host_memory_space> nanCounter(numFeatures);
+        for (size_t i = 0; i < nanCounter.size(); i++) {
+            nanCounter[i] = 0;
+        }
+
+        // the features are sorted by their sort key (type, channels, offset1).
+        // consecutive features of a block therefore access nearby memory of the integral images
         std::vector<ImageFeatureFunction> featureFunctions(numFeatures);
         for (size_t featureNr = 0; featureNr < numFeatures; ++featureNr) {
             featureFunctions[featureNr] = features.getFeatureFunction(featureNr);
         }
 
         // transpose the thresholds
-        std::vector<std::vector<float> > thresholds;
+        std::vector<float> thresholds(numFeatures * numThresholds);
         for (size_t featureNr = 0; featureNr < numFeatures; ++featureNr) {
-            std::vector<float> thresholdsPerFeature;
             for (size_t threshNr = 0; threshNr < numThresholds; ++threshNr) {
-                thresholdsPerFeature.push_back(features.getThreshold(threshNr, featureNr));
+                thresholds[featureNr * numThresholds + threshNr] = features.getThreshold(threshNr, featureNr);
             }
-            thresholds.push_back(thresholdsPerFeature);
         }
 
         assert(perClassHistogram.ndim() == 4);
@@ -67,48 +186,78 @@ public:
         const unsigned int featureStride = perClassHistogram.stride(1);
         const unsigned int thresholdsStride = perClassHistogram.stride(2);
 
-        for (size_t s = range.begin(); s != range.end(); s++) {
-            const PixelInstance* sample = samples[s];
-            assert(sample);
-            const LabelType label = sample->getLabel();
-            const WeightType weight = sample->getWeight();
+        // offset stride must be 1
+        assert(perClassHistogram.stride(3) == 1);
 
-            const unsigned int labelOffset = label * labelStride;
+        size_t sampleBlockBegin = range.begin();
+        while (sampleBlockBegin != range.end()) {
 
-            for (size_t featureNr = 0; featureNr < numFeatures; ++featureNr) {
-                double value = featureFunctions[featureNr].calculateFeatureResponse(*sample);
-                const std::vector<float>& thresholdsPerFeature = thresholds[featureNr];
+            // the samples are sorted by image and location. a block contains samples of one image only
+            const RGBDImage* image = samples[sampleBlockBegin]->getRGBDImage();
+            size_t sampleBlockEnd = sampleBlockBegin + 1;
+            while (sampleBlockEnd != range.end() && sampleBlockEnd - sampleBlockBegin < blockSize.numSamples
+                    && samples[sampleBlockEnd]->getRGBDImage() == image) {
+                sampleBlockEnd++;
+            }
 
-                const unsigned int featureOffset = labelOffset + featureNr * featureStride;
+            for (size_t featureBlockBegin = 0; featureBlockBegin < numFeatures;
+                    featureBlockBegin += blockSize.numFeatures) {
+                const size_t featureBlockEnd = std::min(numFeatures, featureBlockBegin + blockSize.numFeatures);
 
-                for (size_t threshNr = 0; threshNr < numThresholds; ++threshNr) {
-                    const float threshold = thresholdsPerFeature[threshNr];
-                    assert(!isnan(threshold));
+                for (size_t s = sampleBlockBegin; s != sampleBlockEnd; s++) {
+                    const PixelInstance* sample = samples[s];
+                    assert(sample);
+                    const LabelType label = sample->getLabel();
+                    const WeightType weight = sample->getWeight();
 
-                    // avoid the if () else () branch here by casting the compare into 0 or 1
-                    // important: (!(x<=y)) is not the same as (x>y) because of NaNs!
-                    int offset = static_cast<int>(!(value <= threshold));
-                    assert(offset == ((value <= threshold) ? 0 : 1));
+                    const unsigned int labelOffset = label * labelStride;
 
-                    // offset stride must be 1
-                    assert(perClassHistogram.stride(3) == 1);
-                    unsigned int idx = featureOffset + threshNr * thresholdsStride + offset;
-                    perClassHistogram.ptr()[idx] += weight;
-                    assert(perClassHistogram(label, featureNr, threshNr, offset) == perClassHistogram.ptr()[idx]);
+                    for (size_t featureNr = featureBlockBegin; featureNr < featureBlockEnd; ++featureNr) {
+                        const ResponseType value =
+                                featureFunctions[featureNr].calculateFeatureResponse<ResponseType>(*sample);
+                        if (isnan(value)) {
+                            nanCounter[featureNr] += weight;
+                        }
+                        const float* thresholdsPerFeature = &thresholds[featureNr * numThresholds];
+
+                        const unsigned int featureOffset = labelOffset + featureNr * featureStride;
+
+                        for (size_t threshNr = 0; threshNr < numThresholds; ++threshNr) {
+                            const float threshold = thresholdsPerFeature[threshNr];
+                            assert(!isnan(threshold));
+
+                            // avoid the if () else () branch here by casting the compare into 0 or 1
+                            // important: (!(x<=y)) is not the same as (x>y) because of NaNs!
+                            int offset = static_cast<int>(!(value <= threshold));
+                            assert(offset == ((value <= threshold) ? 0 : 1));
+
+                            unsigned int idx = featureOffset + threshNr * thresholdsStride + offset;
+                            perClassHistogram.ptr()[idx] += weight;
+                            assert(perClassHistogram(label, featureNr, threshNr, offset) == perClassHistogram.ptr()[idx]);
+                        }
+                    }
                 }
             }
+
+            sampleBlockBegin = sampleBlockEnd;
         }
 
+        blockSizeTuner.report(blockSize, range.size() * numFeatures,
+                utils::getThreadCPUSeconds() - cpuSecondsStart);
+
         perClassHistograms.push_back(perClassHistogram);
+        nanCounters.push_back(nanCounter);
     }
 
 private:
     const size_t numClasses;
     const size_t numFeatures;
     const size_t numThresholds;
+    const BlockSizeTuner::BlockSize blockSize;
     const std::vector<const PixelInstance*>& samples;
     const ImageFeaturesAndThresholds<cuv::host_memory_space>& features;
     tbb::concurrent_vector<cuv::ndarray<WeightType, cuv::host_memory_space> >& perClassHistograms;
+    tbb::concurrent_vector<cuv::ndarray<WeightType, cuv::host_memory_space> >& nanCounters;
 };
 
 bool ImageFeatureFunction::operator==(const ImageFeatureFunction& other) const {
@@ -182,6 +331,43 @@ cuv::ndarray<ScoreType, cuv::host_memory_space> ImageFeatureEvaluation::calculat
     return scores;
 }
 
+ScoreType ImageFeatureEvaluation::calculateFeatureCost(int8_t featureType, double nanRate) const {
+    assert(nanRate >= 0.0 && nanRate <= 1.0);
+    ScoreType cost = configuration.getNaNResponseCost() * nanRate;
+    switch (featureType) {
+        case DEPTH:
+            cost += configuration.getDepthFeatureCost();
+            break;
+        case COLOR:
+            cost += configuration.getColorFeatureCost();
+            break;
+        default:
+            assert(false);
+            break;
+    }
+    return cost;
+}
+
+template<>
+std::vector<ScoreType> ImageFeatureEvaluation::calculateFeatureCosts(
+        const cuv::ndarray<WeightType, cuv::host_memory_space>& nanCounters,
+        WeightType total,
+        const ImageFeaturesAndThresholds<cuv::host_memory_space>& featuresAndThresholds) {
+
+    const unsigned int numFeatures = configuration.getFeatureCount();
+    assert(nanCounters.size() == numFeatures);
+
+    std::vector<ScoreType> costs(numFeatures);
+    for (size_t featureNr = 0; featureNr < numFeatures; featureNr++) {
+        assert(nanCounters[featureNr] <= total);
+        const double nanRate = (total == 0) ? 0.0 : nanCounters[featureNr] / static_cast<double>(total);
+        const ImageFeatureFunction feature = featuresAndThresholds.getFeatureFunction(featureNr);
+        costs[featureNr] = calculateFeatureCost(feature.getType(), nanRate);
+    }
+
+    return costs;
+}
+
 std::vector<SplitFunction<PixelInstance, ImageFeatureFunction> > ImageFeatureEvaluation::evaluateBestSplits(
         RandomSource& randomSource,
         const std::vector<std::pair<boost::shared_ptr<RandomTree<PixelInstance, ImageFeatureFunction> >,
@@ -202,6 +388,26 @@ std::vector<SplitFunction<PixelInstance, ImageFeatureFunction> > ImageFeatureEva
     utils::Timer generatingRandomFeaturesTimer;
 
     {
+        // the GPU evaluates the samples of one image size at once. the thresholds are drawn from the samples of a
+        // randomly chosen image size such that every size contributes in expectation
+        typedef std::pair<int, int> ImageSize;
+        std::vector<ImageSize> imageSizes;
+        if (accelerationMode == GPU_ONLY || accelerationMode == GPU_AND_CPU_COMPARE) {
+            std::set<ImageSize> distinctImageSizes;
+            for (size_t nodeId = 0; nodeId < samplesPerNode.size(); nodeId++) {
+                for (const PixelInstance* sample : samplesPerNode[nodeId].second) {
+                    distinctImageSizes.insert(std::make_pair(sample->width(), sample->height()));
+                }
+            }
+            imageSizes.assign(distinctImageSizes.begin(), distinctImageSizes.end());
+        }
+        ImageSize thresholdImageSize;
+        if (!imageSizes.empty()) {
+            const size_t sizeNr = (imageSizes.size() == 1) ? 0 :
+                    randomSource.split(IMAGE_SIZE_STREAM).uniformSampler(imageSizes.size()).getNext();
+            thresholdImageSize = imageSizes[sizeNr];
+        }
+
         std::set<const RGBDImage*> images;
         std::vector<const PixelInstance*> allSamples;
         unsigned int numSkipped = 0;
@@ -218,6 +424,12 @@ std::vector<SplitFunction<PixelInstance, ImageFeatureFunction> > ImageFeatureEva
                             continue;
                         }
                     }
+                    if (sample->width() != thresholdImageSize.first
+                            || sample->height() != thresholdImageSize.second) {
+                        // skip sample. the threshold kernel evaluates images of one size
+                        numSkipped++;
+                        continue;
+                    }
                 }
                 images.insert(sample->getRGBDImage());
                 allSamples.push_back(sample);
@@ -229,6 +441,7 @@ std::vector<SplitFunction<PixelInstance, ImageFeatureFunction> > ImageFeatureEva
             CURFIL_INFO("randomFeatureGeneration: skipped " << numSkipped << " samples");
         }
 
+        // the random source is keyed by the training round. see RandomTreeTrain::train()
         const int seed = randomSource.uniformSampler(0xFFFFFF).getNext();
 
         if (accelerationMode == CPU_ONLY || accelerationMode == GPU_AND_CPU_COMPARE) {
@@ -243,6 +456,26 @@ std::vector<SplitFunction<PixelInstance, ImageFeatureFunction> > ImageFeatureEva
 
     tbb::mutex cpuEvaluationMutex;
 
+    // nodes, sample chunks and (when trained in parallel) trees are tasks in the same task arena.
+    // the largest nodes are scheduled first such that the small nodes fill up the tail of the level
+    std::vector<size_t> nodeOrder(samplesPerNode.size());
+    size_t totalSamples = 0;
+    for (size_t nodeNr = 0; nodeNr < samplesPerNode.size(); nodeNr++) {
+        nodeOrder[nodeNr] = nodeNr;
+        totalSamples += samplesPerNode[nodeNr].second.size();
+    }
+    std::stable_sort(nodeOrder.begin(), nodeOrder.end(), [&](size_t a, size_t b) {
+        return (samplesPerNode[a].second.size() > samplesPerNode[b].second.size());
+    });
+
+    // a few sample chunks per thread and level. nodes in the tail of a level are evaluated as a single task.
+    // every chunk allocates its own histogram counters, hence the lower bound
+    static const size_t TASKS_PER_THREAD = 4;
+    static const size_t MIN_SAMPLES_PER_TASK = 100;
+    assert(configuration.getNumThreads() > 0);
+    const size_t samplesPerTask = std::max(MIN_SAMPLES_PER_TASK,
+            totalSamples / (TASKS_PER_THREAD * configuration.getNumThreads()));
+
     size_t grainSize = 1;
     if (accelerationMode != CPU_ONLY) {
         // GPU: use two threads
@@ -250,7 +483,9 @@ std::vector<SplitFunction<PixelInstance, ImageFeatureFunction> > ImageFeatureEva
     }
     tbb::parallel_for(tbb::blocked_range<size_t>(0, samplesPerNode.size(), grainSize),
             [&](const tbb::blocked_range<size_t>& range) {
-                for(size_t nodeNr = range.begin(); nodeNr != range.end(); nodeNr++) {
+                for(size_t i = range.begin(); i != range.end(); i++) {
+
+                    const size_t nodeNr = nodeOrder[i];
 
                     const std::pair<boost::shared_ptr<RandomTree<PixelInstance, ImageFeatureFunction> >,
                     std::vector<const PixelInstance*> >& nodeSamples = samplesPerNode[nodeNr];
@@ -269,6 +504,7 @@ std::vector<SplitFunction<PixelInstance, ImageFeatureFunction> > ImageFeatureEva
 
                     cuv::ndarray<ScoreType, cuv::host_memory_space> scoresCPU;
                     cuv::ndarray<ScoreType, cuv::host_memory_space> scoresGPU;
+                    std::vector<ScoreType> featureCosts;
 
                     size_t transferTimeStart = imageCache.getTotalTransferTimeMircoseconds();
 
@@ -280,13 +516,10 @@ std::vector<SplitFunction<PixelInstance, ImageFeatureFunction> > ImageFeatureEva
                                 cuv::host_memory_space());
 
                         tbb::concurrent_vector<cuv::ndarray<WeightType, cuv::host_memory_space> > perClassHistograms;
+                        tbb::concurrent_vector<cuv::ndarray<WeightType, cuv::host_memory_space> > perRangeNaNCounters;
                         utils::Timer timeEvaluate;
 
-                        int numThreads = configuration.getNumThreads();
-
-                        assert(numThreads > 0);
-
-                        size_t grainSize = std::max(100ul, samples.size() / numThreads);
+                        const size_t grainSize = std::min(samplesPerTask, samples.size());
 
                         CURFIL_DEBUG("start evaluation");
 
@@ -295,17 +528,33 @@ std::vector<SplitFunction<PixelInstance, ImageFeatureFunction> > ImageFeatureEva
                         for (size_t i = 0; i < countersCPU.size(); i++) {
                             countersCPU[i] = 0;
                         }
+                        cuv::ndarray<WeightType, cuv::host_memory_space> nanCountersCPU(configuration.getFeatureCount());
+                        for (size_t i = 0; i < nanCountersCPU.size(); i++) {
+                            nanCountersCPU[i] = 0;
+                        }
 
                         {
                             // tbb::mutex::scoped_lock cpuEvaluationLock(cpuEvaluationMutex);
 
                             utils::Profile profile("feature evaluation CPU");
 
-                            FeatureEvaluationCPU evaluation(numLabels, configuration.getFeatureCount(),
-                                    configuration.getThresholds(),
-                                    samples, featuresAndThresholdsCPU, perClassHistograms);
+                            const size_t numEvaluations = samples.size() * configuration.getFeatureCount();
+                            const BlockSizeTuner::BlockSize blockSize = blockSizeTuner.getBlockSize(numEvaluations);
+
+                            const tbb::blocked_range<size_t> sampleRange(0, samples.size(), grainSize);
+
+                            if (configuration.isUseFloatResponses()) {
+                                tbb::parallel_for(sampleRange, FeatureEvaluationCPU<float>(numLabels,
+                                        configuration.getFeatureCount(), configuration.getThresholds(),
+                                        blockSize, samples, featuresAndThresholdsCPU, perClassHistograms,
+                                        perRangeNaNCounters));
+                            } else {
+                                tbb::parallel_for(sampleRange, FeatureEvaluationCPU<FeatureResponseType>(numLabels,
+                                        configuration.getFeatureCount(), configuration.getThresholds(),
+                                        blockSize, samples, featuresAndThresholdsCPU, perClassHistograms,
+                                        perRangeNaNCounters));
+                            }
 
-                            tbb::parallel_for(tbb::blocked_range<size_t>(0, samples.size(), grainSize), evaluation);
                             currentNode.setTimerValue("featureEvaluation", profile.getSeconds());
 
                             assert(!perClassHistograms.empty());
@@ -313,6 +562,7 @@ std::vector<SplitFunction<PixelInstance, ImageFeatureFunction> > ImageFeatureEva
                             utils::Profile reaggregateHistograms("reaggregateHistograms");
                             for (size_t i = 0; i < perClassHistograms.size(); i++) {
                                 countersCPU += perClassHistograms[i];
+                                nanCountersCPU += perRangeNaNCounters[i];
                             }
                             currentNode.setTimerValue("reaggregateHistograms", reaggregateHistograms.getSeconds());
                         }
@@ -322,6 +572,14 @@ std::vector<SplitFunction<PixelInstance, ImageFeatureFunction> > ImageFeatureEva
                         {
                             utils::Profile profile("calculateScores");
                             scoresCPU = calculateScores(countersCPU, featuresAndThresholdsCPU, currentNode.getHistogram());
+                            if (configuration.isUseFeatureCosts()) {
+                                WeightType totalWeight = 0;
+                                for (const PixelInstance* sample : samples) {
+                                    totalWeight += sample->getWeight();
+                                }
+                                featureCosts = calculateFeatureCosts(nanCountersCPU, totalWeight,
+                                        featuresAndThresholdsCPU);
+                            }
                             currentNode.setTimerValue("calculateScores", profile.getSeconds());
                         }
 
@@ -339,8 +597,10 @@ std::vector<SplitFunction<PixelInstance, ImageFeatureFunction> > ImageFeatureEva
 
                         utils::Timer featureResponsesAndHistograms;
 
+                        cuv::ndarray<WeightType, cuv::dev_memory_space> nanCounters(configuration.getFeatureCount(),
+                                countersAllocator);
                         cuv::ndarray<WeightType, cuv::dev_memory_space> counters = calculateFeatureResponsesAndHistograms(
-                                currentNode, batches, featuresAndThresholdsGPU);
+                                currentNode, batches, featuresAndThresholdsGPU, 0, &nanCounters);
 
                         currentNode.setTimerValue("featureResponsesAndHistograms", featureResponsesAndHistograms);
 
@@ -348,6 +608,11 @@ std::vector<SplitFunction<PixelInstance, ImageFeatureFunction> > ImageFeatureEva
 
                         cuv::ndarray<WeightType, cuv::dev_memory_space> histogram = currentNode.getHistogram();
                         scoresGPU = calculateScores(counters, featuresAndThresholdsGPU, histogram);
+                        if (configuration.isUseFeatureCosts() && accelerationMode == GPU_ONLY) {
+                            // the GPU counts every sample once
+                            featureCosts = calculateFeatureCosts(nanCounters, static_cast<WeightType>(samples.size()),
+                                    featuresAndThresholdsGPU);
+                        }
 
                         currentNode.setTimerValue("calculateScores", calculateScoresTimer);
                     }
@@ -386,16 +651,27 @@ std::vector<SplitFunction<PixelInstance, ImageFeatureFunction> > ImageFeatureEva
                     assert(scores.ndim() == 2);
                     assert(scores.shape(0) == configuration.getThresholds());
                     assert(scores.shape(1) == configuration.getFeatureCount());
-                    ScoreType bestScore = -std::numeric_limits<ScoreType>::infinity();
+                    assert(featureCosts.empty() || featureCosts.size() == configuration.getFeatureCount());
+
+                    // with feature costs, the split with the highest score per cost is selected.
+                    // dividing keeps positive scores positive such that a useless split is never preferred
+                    ScoreType bestPenalizedScore = -std::numeric_limits<ScoreType>::infinity();
+                    ScoreType bestScore = bestPenalizedScore;
                     uint16_t bestThresh = 0;
                     unsigned int bestFeat = 0;
                     for (uint16_t thresh = 0; thresh < configuration.getThresholds(); thresh++) {
                         for (unsigned int feat = 0; feat < configuration.getFeatureCount(); feat++) {
                             const ScoreType score = scores(thresh, feat);
-                            if (isnan(bestScore) || detail::isScoreBetter(bestScore, score, feat)) {
+                            ScoreType penalizedScore = score;
+                            if (!featureCosts.empty()) {
+                                penalizedScore = score / (1 + featureCosts[feat]);
+                            }
+                            if (isnan(bestPenalizedScore)
+                                    || detail::isScoreBetter(bestPenalizedScore, penalizedScore, feat)) {
                                 bestFeat = feat;
                                 bestThresh = thresh;
                                 bestScore = score;
+                                bestPenalizedScore = penalizedScore;
                             }
                         }
                     }
@@ -415,7 +691,8 @@ std::vector<SplitFunction<PixelInstance, ImageFeatureFunction> > ImageFeatureEva
                     SplitFunction<PixelInstance, ImageFeatureFunction> bestFeature(bestFeat, feature, threshold, bestScore);
 
                     CURFIL_DEBUG("tree " << currentNode.getTreeId() << ", node " << currentNode.getNodeId() <<
-                            ", best score: " << bestScore << ", " << feature);
+                            ", best score: " << bestScore << ", penalized score: " << bestPenalizedScore <<
+                            ", " << feature);
 
                     bestSplits[nodeNr]= bestFeature;
                 }
@@ -446,7 +723,16 @@ void ImageFeatureEvaluation::sortFeatures(
     int* keys = keysIndices[cuv::indices[0][cuv::index_range()]].ptr();
     int* indices = keysIndices[cuv::indices[1][cuv::index_range()]].ptr();
 
-    thrust::sort_by_key(keys, keys + numFeatures, indices);
+    // ties are broken by the index such that the order is unique
+    std::vector<std::pair<int, int> > keyIndexPairs(numFeatures);
+    for (size_t feat = 0; feat < numFeatures; feat++) {
+        keyIndexPairs[feat] = std::make_pair(keys[feat], indices[feat]);
+    }
+    tbb::parallel_sort(keyIndexPairs.begin(), keyIndexPairs.end());
+    for (size_t feat = 0; feat < numFeatures; feat++) {
+        keys[feat] = keyIndexPairs[feat].first;
+        indices[feat] = keyIndexPairs[feat].second;
+    }
 
     cuv::ndarray<int8_t, cuv::host_memory_space> features = tmpFeaturesAndThresholds.features();
     cuv::ndarray<int8_t, cuv::host_memory_space> sortedFeatures = featuresAndThresholds.features();
@@ -455,13 +741,17 @@ void ImageFeatureEvaluation::sortFeatures(
 
     const size_t dim = features.shape(0);
     assert(dim == 11);
-    for (size_t d = 0; d < dim; d++) {
-        int8_t* ptr = features[cuv::indices[d][cuv::index_range()]].ptr();
-        int8_t* sortedPtr = sortedFeatures[cuv::indices[d][cuv::index_range()]].ptr();
-
-        assert(ptr != sortedPtr);
-        thrust::gather(indices, indices + numFeatures, ptr, sortedPtr);
-    }
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, dim), [&](const tbb::blocked_range<size_t>& range) {
+        for (size_t d = range.begin(); d != range.end(); d++) {
+            const int8_t* ptr = features[cuv::indices[d][cuv::index_range()]].ptr();
+            int8_t* sortedPtr = sortedFeatures[cuv::indices[d][cuv::index_range()]].ptr();
+
+            assert(ptr != sortedPtr);
+            for (size_t feat = 0; feat < numFeatures; feat++) {
+                sortedPtr[feat] = ptr[indices[feat]];
+            }
+        }
+    });
 
 #ifndef NDEBUG
     for (size_t feat = 0; feat < numFeatures; feat++) {
@@ -486,14 +776,19 @@ void ImageFeatureEvaluation::sortFeatures(
     assert(featuresAndThresholds.thresholds().shape(0) == configuration.getThresholds());
     assert(featuresAndThresholds.thresholds().shape(1) == numFeatures);
 
-    for (size_t thresh = 0; thresh < configuration.getThresholds(); thresh++) {
-        float* thresholdsPtr =
-                tmpFeaturesAndThresholds.m_thresholds[cuv::indices[thresh][cuv::index_range()]].ptr();
-        float* sortedThresholdsPtr =
-                featuresAndThresholds.m_thresholds[cuv::indices[thresh][cuv::index_range()]].ptr();
-
-        thrust::gather(indices, indices + numFeatures, thresholdsPtr, sortedThresholdsPtr);
-    }
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, configuration.getThresholds()),
+            [&](const tbb::blocked_range<size_t>& range) {
+                for (size_t thresh = range.begin(); thresh != range.end(); thresh++) {
+                    const float* thresholdsPtr =
+                            tmpFeaturesAndThresholds.m_thresholds[cuv::indices[thresh][cuv::index_range()]].ptr();
+                    float* sortedThresholdsPtr =
+                            featuresAndThresholds.m_thresholds[cuv::indices[thresh][cuv::index_range()]].ptr();
+
+                    for (size_t feat = 0; feat < numFeatures; feat++) {
+                        sortedThresholdsPtr[feat] = thresholdsPtr[indices[feat]];
+                    }
+                }
+            });
 
 }
 
@@ -513,62 +808,80 @@ ImageFeaturesAndThresholds<cuv::host_memory_space> ImageFeatureEvaluation::gener
 
     unsigned int numFeatures = configuration.getFeatureCount();
     unsigned int numThresholds = configuration.getThresholds();
+    // draw the thresholds in the precision in which they are evaluated
+    const bool useFloatResponses = configuration.isUseFloatResponses();
 
     ImageFeaturesAndThresholds<cuv::host_memory_space> featuresAndThresholds(numFeatures, numThresholds,
             featuresAllocator);
 
     assert(!samples.empty());
 
-    RandomSource randomSource(seed);
+    cuv::ndarray<int, cuv::host_memory_space> keysIndices(2, numFeatures, keysIndicesAllocator);
 
-    Sampler sampleGen = randomSource.uniformSampler(samples.size());
+    // every feature has its own random stream. the features do not depend on the number of threads
+    const RandomSource randomSource(seed);
 
-    size_t generatedFeatures = 0;
+    static const int MAX_TRIES_PER_FEATURE = 10;
+    static const int MAX_TRIES_PER_THRESHOLD = 10;
 
-    cuv::ndarray<int, cuv::host_memory_space> keysIndices(2, numFeatures, keysIndicesAllocator);
+    std::vector<char> generated(numFeatures, false);
 
-    int maxLoops = 3 * numFeatures;
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, numFeatures),
+            [&](const tbb::blocked_range<size_t>& range) {
+                std::vector<float> thresholds(numThresholds);
 
-    while (generatedFeatures < numFeatures) {
-        const ImageFeatureFunction feature = sampleFeature(randomSource, samples);
+                for (size_t feat = range.begin(); feat != range.end(); feat++) {
 
-        if (--maxLoops <= 0) {
-            throw std::runtime_error("failed to generate random features. max loops exceeded");
-        }
+                    RandomSource featureRandomSource = randomSource.split(feat);
+                    Sampler sampleGen = featureRandomSource.uniformSampler(samples.size());
 
-        if (!feature.isValid()) {
-            continue;
-        }
+                    for (int tries = 0; tries < MAX_TRIES_PER_FEATURE && !generated[feat]; tries++) {
+                        const ImageFeatureFunction feature = sampleFeature(featureRandomSource, samples);
 
-        bool isValid = true;
-        for (size_t thresh = 0; thresh < configuration.getThresholds(); thresh++) {
-            size_t maxTries = 10;
-            float threshold;
-            do {
-                const PixelInstance* sample = samples.at(sampleGen.getNext());
-                assert(sample);
-                threshold = feature.calculateFeatureResponse(*sample);
-            } while (isnan(threshold) && --maxTries > 0);
-
-            if (isnan(threshold)) {
-                isValid = false;
-                break;
-            }
+                        if (!feature.isValid()) {
+                            continue;
+                        }
 
-            featuresAndThresholds.thresholds()(thresh, generatedFeatures) = threshold;
-            assert(featuresAndThresholds.getThreshold(thresh, generatedFeatures) == threshold);
-        }
+                        // evaluate all thresholds at once. only the responses that are NaN are drawn again
+                        std::fill(thresholds.begin(), thresholds.end(), std::numeric_limits<float>::quiet_NaN());
+                        size_t numMissing = numThresholds;
+                        for (int round = 0; round < MAX_TRIES_PER_THRESHOLD && numMissing > 0; round++) {
+                            for (size_t thresh = 0; thresh < numThresholds; thresh++) {
+                                if (!isnan(thresholds[thresh])) {
+                                    continue;
+                                }
+                                const PixelInstance* sample = samples[sampleGen.getNext()];
+                                assert(sample);
+                                if (useFloatResponses) {
+                                    thresholds[thresh] = feature.calculateFeatureResponse<float>(*sample);
+                                } else {
+                                    thresholds[thresh] = feature.calculateFeatureResponse(*sample);
+                                }
+                                if (!isnan(thresholds[thresh])) {
+                                    numMissing--;
+                                }
+                            }
+                        }
 
-        if (!isValid) {
-            continue;
-        }
+                        if (numMissing > 0) {
+                            continue;
+                        }
 
-        featuresAndThresholds.setFeatureFunction(generatedFeatures, feature);
+                        for (size_t thresh = 0; thresh < numThresholds; thresh++) {
+                            featuresAndThresholds.thresholds()(thresh, feat) = thresholds[thresh];
+                        }
+                        featuresAndThresholds.setFeatureFunction(feat, feature);
 
-        keysIndices(0, generatedFeatures) = feature.getSortKey();
-        keysIndices(1, generatedFeatures) = generatedFeatures;
+                        keysIndices(0, feat) = feature.getSortKey();
+                        keysIndices(1, feat) = feat;
 
-        generatedFeatures++;
+                        generated[feat] = true;
+                    }
+                }
+            });
+
+    if (std::find(generated.begin(), generated.end(), false) != generated.end()) {
+        throw std::runtime_error("failed to generate random features. max loops exceeded");
     }
 
     if (sort)
@@ -653,6 +966,15 @@ void RandomTreeImage::doTrain(RandomSource& randomSource, size_t numClasses,
     RandomTreeTrain<PixelInstance, ImageFeatureEvaluation, ImageFeatureFunction> treeTrain(getId(), numClasses,
             configuration);
 
+    RandomSource featureRandomSource = randomSource.split(FEATURE_GENERATION_STREAM);
+
+    if (tree) {
+        // warm start: continue training at the current leaves of the tree
+        ImageFeatureEvaluation featureEvaluation(tree->getTreeId(), configuration);
+        treeTrain.trainFromLeaves(featureEvaluation, featureRandomSource, tree, subsamples);
+        return;
+    }
+
     tree = boost::make_shared<RandomTree<PixelInstance, ImageFeatureFunction> >(getId(), 1, subsamples, numClasses); // no parent
     assert(tree->isRoot());
 
@@ -662,13 +984,164 @@ void RandomTreeImage::doTrain(RandomSource& randomSource, size_t numClasses,
     samplesPerNode.push_back(std::make_pair(tree, subsamples));
 
     ImageFeatureEvaluation featureEvaluation(tree->getTreeId(), configuration);
-    treeTrain.train(featureEvaluation, randomSource, samplesPerNode, getId());
+    treeTrain.train(featureEvaluation, featureRandomSource, samplesPerNode, getId());
 }
 
 void RandomTreeImage::normalizeHistograms(const double histogramBias) {
     tree->normalizeHistograms(classLabelPriorDistribution, histogramBias);
 }
 
+size_t RandomTreeImage::prune(const std::vector<LabeledRGBDImage>& validationImages, const double tolerance,
+        const double histogramBias) {
+
+    assert(finishedTraining);
+    assert(tree);
+
+    if (validationImages.empty()) {
+        throw std::runtime_error("got no validation images");
+    }
+
+    if (tolerance < 0.0 || tolerance >= 1.0) {
+        throw std::runtime_error(boost::str(boost::format("illegal pruning tolerance: %lf") % tolerance));
+    }
+
+    utils::Timer pruneTimer;
+
+    normalizeHistograms(histogramBias);
+
+    const size_t numClasses = tree->getNumClasses();
+    const size_t rootNodeId = tree->getNodeId();
+    const size_t numNodeIds = tree->getMaxNodeId() - rootNodeId + 1;
+
+    std::vector<bool> ignoredLabels(numClasses);
+    for (LabelType label = 0; label < numClasses; label++) {
+        ignoredLabels[label] = shouldIgnoreLabel(label);
+    }
+
+    tbb::concurrent_vector<cuv::ndarray<WeightType, cuv::host_memory_space> > validationHistogramsPerRange;
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, validationImages.size()),
+            [&](const tbb::blocked_range<size_t>& range) {
+
+                cuv::ndarray<WeightType, cuv::host_memory_space> validationHistograms(numNodeIds, numClasses);
+                for (size_t i = 0; i < validationHistograms.size(); i++) {
+                    validationHistograms[i] = 0;
+                }
+
+                for(size_t imageNr = range.begin(); imageNr != range.end(); imageNr++) {
+                    const RGBDImage& image = validationImages[imageNr].getRGBDImage();
+                    const LabelImage& labelImage = validationImages[imageNr].getLabelImage();
+
+                    for (int y = 0; y < labelImage.getHeight(); y++) {
+                        for (int x = 0; x < labelImage.getWidth(); x++) {
+                            const LabelType label = labelImage.getLabel(x, y);
+                            if (label >= numClasses) {
+                                throw std::runtime_error((boost::format(
+                                        "illegal label in validation image '%s' at pixel (%d,%d): %d (numClasses: %d)")
+                                        % labelImage.getFilename() % x % y
+                                        % static_cast<int>(label) % numClasses).str());
+                            }
+                            if (ignoredLabels[label]) {
+                                continue;
+                            }
+                            PixelInstance pixel(&image, label, x, y);
+                            if (configuration.isUseFloatResponses()) {
+                                tree->addSampleToHistograms<float>(pixel, validationHistograms, rootNodeId);
+                            } else {
+                                tree->addSampleToHistograms(pixel, validationHistograms, rootNodeId);
+                            }
+                        }
+                    }
+                }
+
+                validationHistogramsPerRange.push_back(validationHistograms);
+            });
+
+    cuv::ndarray<WeightType, cuv::host_memory_space> validationHistograms(numNodeIds, numClasses);
+    for (size_t i = 0; i < validationHistograms.size(); i++) {
+        validationHistograms[i] = 0;
+    }
+    for (size_t i = 0; i < validationHistogramsPerRange.size(); i++) {
+        validationHistograms += validationHistogramsPerRange[i];
+    }
+
+    const size_t numNodesBefore = tree->countNodes();
+    const double errors = tree->prune(validationHistograms, rootNodeId, tolerance);
+    tree->renumberNodes();
+    const size_t numNodesAfter = tree->countNodes();
+
+    assert(numNodesAfter <= numNodesBefore);
+
+    CURFIL_INFO("pruned tree " << getId() << " from " << numNodesBefore << " to " << numNodesAfter << " nodes ("
+            << tree->getTreeDepth() << " levels). misclassified validation pixels: " << errors
+            << ". took " << pruneTimer.format(2));
+
+    return (numNodesBefore - numNodesAfter);
+}
+
+void RandomTreeImage::refitHistograms(const cuv::ndarray<double, cuv::host_memory_space>& nodeHistograms,
+        const cuv::ndarray<double, cuv::host_memory_space>& labelCounts,
+        const double blend) {
+
+    assert(finishedTraining);
+    assert(tree);
+    assert(blend >= 0.0 && blend <= 1.0);
+
+    const size_t numClasses = tree->getNumClasses();
+    assert(nodeHistograms.ndim() == 2);
+    assert(nodeHistograms.shape(0) == tree->getMaxNodeId() - tree->getNodeId() + 1);
+    assert(nodeHistograms.shape(1) == numClasses);
+    assert(labelCounts.size() == numClasses);
+    assert(classLabelPriorDistribution.size() == numClasses);
+
+    // the training histograms of class-uniform subsampling have (almost) the same number of samples per class
+    std::vector<double> labelWeights(numClasses, 1.0);
+    if (configuration.getSubsamplingType() == "classUniform") {
+        size_t numLabels = 0;
+        double totalCount = 0;
+        for (size_t label = 0; label < numClasses; label++) {
+            if (labelCounts[label] > 0) {
+                numLabels++;
+                totalCount += labelCounts[label];
+            }
+        }
+        for (size_t label = 0; label < numClasses; label++) {
+            if (labelCounts[label] > 0) {
+                labelWeights[label] = totalCount / (numLabels * static_cast<double>(labelCounts[label]));
+            }
+        }
+    }
+
+    cuv::ndarray<double, cuv::host_memory_space> histograms(nodeHistograms.shape(0), numClasses);
+    for (size_t node = 0; node < nodeHistograms.shape(0); node++) {
+        for (size_t label = 0; label < numClasses; label++) {
+            histograms(node, label) = labelWeights[label] * nodeHistograms(node, label);
+        }
+    }
+
+    tree->refitHistograms(histograms, tree->getNodeId(), blend);
+
+    double newPriorSum = 0;
+    double originalPriorSum = 0;
+    for (size_t label = 0; label < numClasses; label++) {
+        newPriorSum += labelCounts[label];
+        originalPriorSum += classLabelPriorDistribution[label];
+    }
+    const double scale = (originalPriorSum > 0) ? newPriorSum / originalPriorSum : 0.0;
+    for (size_t label = 0; label < numClasses; label++) {
+        const double value = (1.0 - blend) * labelCounts[label]
+                + blend * scale * classLabelPriorDistribution[label];
+        if (value + 0.5 > std::numeric_limits<WeightType>::max()) {
+            throw std::runtime_error((boost::format("prior count of class %d overflows: %.0f")
+                    % label % value).str());
+        }
+        classLabelPriorDistribution[label] = static_cast<WeightType>(value + 0.5);
+    }
+
+    CURFIL_INFO("refitted histograms of tree " << getId() << " (" << tree->countLeafNodes() << " leaves) with "
+            << newPriorSum << " pixels");
+}
+
 bool RandomTreeImage::shouldIgnoreLabel(const LabelType& label) const {
     const RGBColor color = LabelImage::decodeLabel(label);
     for (const std::string colorString : configuration.getIgnoredColors()) {
@@ -679,62 +1152,120 @@ bool RandomTreeImage::shouldIgnoreLabel(const LabelType& label) const {
     return false;
 }
 
-void RandomTreeImage::train(const std::vector<LabeledRGBDImage>& trainLabelImages,
+// spreads the lower 16 bits of the value to the even bits of the result
+static uint64_t interleaveBits(uint32_t value) {
+    value &= 0x0000FFFF;
+    value = (value | (value << 8)) & 0x00FF00FF;
+    value = (value | (value << 4)) & 0x0F0F0F0F;
+    value = (value | (value << 2)) & 0x33333333;
+    value = (value | (value << 1)) & 0x55555555;
+    return value;
+}
+
+void RandomTreeImage::train(const DatasetIndex& index, const std::vector<size_t>& imageNrs,
+        RandomSource& randomSource, size_t subsampleCount, std::vector<PixelInstance>* trainingSamples) {
+    std::vector<PixelInstance> subsamples = subsample(index, imageNrs, randomSource, subsampleCount);
+    train(subsamples, randomSource, trainingSamples);
+}
+
+std::vector<PixelInstance> RandomTreeImage::subsample(const DatasetIndex& index, const std::vector<size_t>& imageNrs,
         RandomSource& randomSource, size_t subsampleCount) {
 
     assert(subsampleCount > 0);
-    assert(finishedTraining == false);
-    assert(tree == NULL);
-    assert(!trainLabelImages.empty());
+    assert(!imageNrs.empty());
+
+    const bool warmStart = (tree != NULL);
+    assert(warmStart || finishedTraining == false);
+
+    if (warmStart) {
+        // the prior distribution of the loaded tree is kept. we only verify that the labels are consistent
+        const size_t numClasses = index.getNumClasses(imageNrs);
+        if (numClasses != tree->getNumClasses()) {
+            throw std::runtime_error((boost::format(
+                    "cannot continue training of tree %d: found %d classes in the training images, tree has %d")
+                    % getId() % numClasses % tree->getNumClasses()).str());
+        }
 
-    calculateLabelPriorDistribution(trainLabelImages);
+        CURFIL_INFO("continuing training of tree " << getId() << " with " << tree->countNodes() << " nodes ("
+                << tree->getTreeDepth() << " levels) up to depth " << configuration.getMaxDepth());
+    } else {
+        classLabelPriorDistribution = index.getClassLabelPriorDistribution(imageNrs);
+    }
 
     // Subsample training set
     std::vector<PixelInstance> subsamples;
 
+    RandomSource subsamplingRandomSource = randomSource.split(SUBSAMPLING_STREAM);
+
     if (configuration.getSubsamplingType() == "pixelUniform") {
-        subsamples = subsampleTrainingDataPixelUniform(trainLabelImages, randomSource, subsampleCount);
+        subsamples = subsampleTrainingDataPixelUniform(index, imageNrs, subsamplingRandomSource, subsampleCount);
     } else if (configuration.getSubsamplingType() == "classUniform") {
-        subsamples = subsampleTrainingDataClassUniform(trainLabelImages, randomSource, subsampleCount);
+        subsamples = subsampleTrainingDataClassUniform(index, imageNrs, subsamplingRandomSource, subsampleCount);
     } else {
         throw std::runtime_error(
                 boost::str(boost::format("unknown subsamplingType: %d") % configuration.getSubsamplingType()));
     }
 
+    return subsamples;
+}
+
+void RandomTreeImage::train(std::vector<PixelInstance>& subsamples, RandomSource& randomSource,
+        std::vector<PixelInstance>* trainingSamples) {
+
+    if (trainingSamples) {
+        *trainingSamples = subsamples;
+    }
+
+    if (configuration.isUseAugmentation() || configuration.getPyramidLevel() > 0) {
+        RandomSource augmentationRandomSource = randomSource.split(AUGMENTATION_STREAM);
+        transformSubsamples(subsamples, augmentationRandomSource);
+    }
+
     CURFIL_INFO("sorting " << subsamples.size() << " samples");
 
     utils::Timer sortTimer;
 
-    // interesting fact: sorting the concrete instances is faster than sorting with pointers!
-    // sort by imageid, class id (to improve CPU caching)
+    // sort by image, spatial tile (Morton order) and label to improve CPU caching.
+    // the key layout is: 24 bits image rank | 32 bits Morton code of the tile | 8 bits label
 
-    const int SORT_BLOCK_SIZE = 200000;
-    auto iterator = subsamples.begin();
-    auto end = std::min(subsamples.end(), iterator + SORT_BLOCK_SIZE);
-    while (iterator < end) {
-        std::sort(iterator, end, [](const PixelInstance& a, const PixelInstance& b) {
-            if (a.getRGBDImage() != b.getRGBDImage()) {
-                return(a.getRGBDImage() < b.getRGBDImage());
-            }
+    std::vector<const RGBDImage*> sampledImages;
+    sampledImages.reserve(subsamples.size());
+    for (const PixelInstance& sample : subsamples) {
+        sampledImages.push_back(sample.getRGBDImage());
+    }
+    std::sort(sampledImages.begin(), sampledImages.end());
+    sampledImages.erase(std::unique(sampledImages.begin(), sampledImages.end()), sampledImages.end());
 
-            if (a.getLabel() != b.getLabel()) {
-                return (a.getLabel() < b.getLabel());
-            }
+    if (sampledImages.size() >= (1lu << 24)) {
+        throw std::runtime_error(boost::str(boost::format("too many images to sort: %d") % sampledImages.size()));
+    }
 
-            // FIXME optimize magic value
-            const int quantisation = 10;
-            if (a.getY()/quantisation != b.getY()/quantisation) {
-                return (a.getY()/quantisation < b.getY()/quantisation);
-            }
-            if (a.getX()/quantisation != b.getX()/quantisation) {
-                return (a.getX()/quantisation < b.getX()/quantisation);
-            }
-            return false;
-        });
-        iterator += SORT_BLOCK_SIZE;
-        end += SORT_BLOCK_SIZE;
-        end = std::min(subsamples.end(), end);
+    const uint16_t tileSize = configuration.getSortTileSize();
+
+    std::vector<uint64_t> keys(subsamples.size());
+    std::vector<uint32_t> order(subsamples.size());
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, subsamples.size()),
+            [&](const tbb::blocked_range<size_t>& range) {
+                for (size_t i = range.begin(); i != range.end(); i++) {
+                    const PixelInstance& sample = subsamples[i];
+                    const uint64_t image = std::lower_bound(sampledImages.begin(), sampledImages.end(),
+                            sample.getRGBDImage()) - sampledImages.begin();
+                    const uint64_t morton = interleaveBits(sample.getX() / tileSize)
+                            | (interleaveBits(sample.getY() / tileSize) << 1);
+                    keys[i] = (image << 40) | (morton << 8) | sample.getLabel();
+                    order[i] = static_cast<uint32_t>(i);
+                }
+            });
+
+    utils::radixSort(keys, order);
+
+    std::vector<PixelInstance> sortedSubsamples;
+    sortedSubsamples.reserve(subsamples.size());
+    for (const uint32_t i : order) {
+        sortedSubsamples.push_back(subsamples[i]);
     }
+    subsamples.swap(sortedSubsamples);
 
     sortTimer.stop();
 
@@ -748,8 +1279,6 @@ void RandomTreeImage::train(const std::vector<LabeledRGBDImage>& trainLabelImage
 
     utils::Timer trainTimer;
 
-    assert(tree == NULL);
-
     const size_t numClasses = classLabelPriorDistribution.size();
 
     doTrain(randomSource, numClasses, subsamplePointers);
@@ -768,79 +1297,40 @@ void RandomTreeImage::test(const RGBDImage* image, LabelImage& prediction) const
     for (int y = 0; y < image->getHeight(); ++y) {
         for (int x = 0; x < image->getWidth(); ++x) {
             PixelInstance pixel(image, 0, x, y);
-            prediction.setLabel(x, y, tree->classify(pixel));
+            prediction.setLabel(x, y,
+                    configuration.isUseFloatResponses() ? tree->classify<float>(pixel) : tree->classify(pixel));
         }
     }
 }
 
 std::vector<PixelInstance> RandomTreeImage::subsampleTrainingDataPixelUniform(
-        const std::vector<LabeledRGBDImage>& trainLabelImages,
+        const DatasetIndex& index, const std::vector<size_t>& imageNrs,
         RandomSource& randomSource,
         size_t subsampleCount) const {
-    // Random across imags type [0..(n-1)]
-    auto rgen_image = randomSource.uniformSampler(trainLabelImages.size());
-
-    std::vector<PixelInstance> subsamples;
-    for (size_t n = 0; n < subsampleCount * trainLabelImages.size(); ++n) {
-        unsigned int image_id = rgen_image.getNext();
-        assert(image_id < trainLabelImages.size());
-
-        // Sample a random (x,y) coordinate for the image
-        const auto image = trainLabelImages[image_id].getLabelImage();
 
-        auto rgen_x = randomSource.uniformSampler(image.getWidth());
-        auto rgen_y = randomSource.uniformSampler(image.getHeight());
-
-        do {
-            uint16_t x = static_cast<uint16_t>(rgen_x.getNext());
-            uint16_t y = static_cast<uint16_t>(rgen_y.getNext());
-            assert(x < image.getWidth());
-            assert(y < image.getHeight());
-
-            LabelType label = image.getLabel(x, y);
-
-            if (shouldIgnoreLabel(label)) {
-                continue;
-            }
+    utils::Timer samplingTimer;
 
-            // Append to sample list
-            subsamples.push_back(PixelInstance(&(trainLabelImages[image_id].getRGBDImage()), label, x, y));
-            break;
-        } while (true);
+    std::vector<bool> ignoredLabels(classLabelPriorDistribution.size());
+    for (LabelType label = 0; label < classLabelPriorDistribution.size(); label++) {
+        ignoredLabels[label] = shouldIgnoreLabel(label);
     }
 
-    return subsamples;
-}
+    const int seed = randomSource.uniformSampler(0xFFFFFF).getNext();
+    std::vector<PixelInstance> subsamples = index.samplePixels(imageNrs, ignoredLabels,
+            subsampleCount * imageNrs.size(), seed);
 
-void RandomTreeImage::calculateLabelPriorDistribution(const std::vector<LabeledRGBDImage>& trainLabelImages) {
-
-    std::map<LabelType, size_t> priorDistribution;
-    for (const auto& trainLabelImage : trainLabelImages) {
-
-        const auto& img = trainLabelImage.getLabelImage();
-
-        for (int y = 0; y < img.getHeight(); ++y) {
-            for (int x = 0; x < img.getWidth(); ++x) {
-                LabelType label = img.getLabel(x, y);
-                assert(label >= 0);
-                priorDistribution[label]++;
-            }
-        }
-    }
-
-    classLabelPriorDistribution.resize(priorDistribution.size());
-    for (LabelType label = 0; label < priorDistribution.size(); label++) {
-        classLabelPriorDistribution[label] = priorDistribution[label];
-    }
+    CURFIL_INFO("sampled " << subsamples.size() << " pixels from " << imageNrs.size() << " images in "
+            << samplingTimer.format(4));
 
+    return subsamples;
 }
 
 std::vector<PixelInstance> RandomTreeImage::subsampleTrainingDataClassUniform(
-        const std::vector<LabeledRGBDImage>& trainLabelImages,
+        const DatasetIndex& index, const std::vector<size_t>& imageNrs,
         RandomSource& randomSource,
         size_t subsampleCount) const {
 
-    if (trainLabelImages.empty()) {
+    if (imageNrs.empty()) {
         throw std::runtime_error("got no label images");
     }
 
@@ -864,107 +1354,31 @@ std::vector<PixelInstance> RandomTreeImage::subsampleTrainingDataClassUniform(
 
     // Number of samples per class, rounded up
     const size_t samplesPerClass = static_cast<size_t>(
-            ceil(trainLabelImages.size() * static_cast<double>(subsampleCount) /
+            ceil(imageNrs.size() * static_cast<double>(subsampleCount) /
                     static_cast<double>(numLabels)));
 
     std::vector<PixelInstance> allSubsamples;
 
-    CURFIL_INFO("sampling " << numLabels << " classes. " << samplesPerClass << " samples per class with "
-            << configuration.getNumThreads() << " threads from " << trainLabelImages.size() << " images");
-
-    tbb::concurrent_vector<std::map<LabelType, ReservoirSampler<PixelInstance> > > samplersPerLabel;
-
-    int grainSize = ceil(trainLabelImages.size() / static_cast<double>(configuration.getNumThreads()));
-
-    const int randomSeed = randomSource.uniformSampler(0xFFFFFF).getNext();
-
-    std::set<LabelType> labelsToIgnore;
-    for (const std::string colorString : configuration.getIgnoredColors()) {
-        LabelType label = std::numeric_limits<LabelType>::max();
-        label = getOrAddColorId(RGBColor(colorString), label);
-        if (label == std::numeric_limits<LabelType>::max()) {
-            throw std::runtime_error(std::string("unknown color to ignore: ") + colorString);
-        }
-        labelsToIgnore.insert(label);
-    }
-
-    // Parallel Reservoir Sampling
-    tbb::parallel_for(tbb::blocked_range<size_t>(0, trainLabelImages.size(), grainSize),
-            [&](const tbb::blocked_range<size_t>& range) {
-
-#ifndef NDEBUG
-            size_t numImages = range.end() - range.begin();
-            assert(numImages > 0);
-            assert(numImages <= trainLabelImages.size());
-#endif
-
-            std::map<LabelType, ReservoirSampler<PixelInstance> > reservoirSamplers;
-
-            for (LabelType label = 0; label < classLabelPriorDistribution.size(); label++) {
-                reservoirSamplers[label] = ReservoirSampler<PixelInstance>(samplesPerClass);
-            }
-
-            const int randMax = 0x7FFFFFFF;
-            RandomSource randomSource(randomSeed);
-            Sampler sampler = randomSource.uniformSampler(randMax);
-
-            for(unsigned int imageNr = range.begin(); imageNr != range.end(); imageNr++) {
-
-                const auto image = trainLabelImages[imageNr].getLabelImage();
-                for(int y=0; y < image.getHeight(); y++) {
-                    for(int x=0; x < image.getWidth(); x++) {
-                        const LabelType label = image.getLabel(x, y);
-
-                        if (labelsToIgnore.find(label) != labelsToIgnore.end()) {
-                            continue;
-                        }
-
-                        PixelInstance sample(&(trainLabelImages[imageNr].getRGBDImage()), label, x, y);
-                        if (!sample.getDepth().isValid()) {
-                            continue;
-                        }
-
-                        reservoirSamplers[label].sample(sampler, sample);
-                    }
-                }
-
-            }
-
-            samplersPerLabel.push_back(reservoirSamplers);
-
-        });
-
-    const int randMax = 0x7FFFFFFF;
-    Sampler sampler = randomSource.uniformSampler(randMax);
+    CURFIL_INFO("sampling " << numLabels << " classes. " << samplesPerClass << " samples per class from "
+            << imageNrs.size() << " images");
 
     for (LabelType label = 0; label < classLabelPriorDistribution.size(); label++) {
 
-        ReservoirSampler<PixelInstance> reservoirSampler(samplesPerClass);
-
-        for (auto& samplers : samplersPerLabel) {
-            const auto& samples = samplers[label].getReservoir();
-
-            if (labelsToIgnore.find(label) != labelsToIgnore.end()) {
-                if (!samples.empty()) {
-                    throw std::runtime_error("sampled pixels for ignored class. must not happen");
-                }
-                continue;
-            }
-
-            for (const PixelInstance& sample : samples) {
-                reservoirSampler.sample(sampler, sample);
-            }
+        if (shouldIgnoreLabel(label)) {
+            continue;
         }
 
-        const std::vector<PixelInstance>& reservoir = reservoirSampler.getReservoir();
+        const int seed = randomSource.split(label).uniformSampler(0xFFFFFF).getNext();
+        const std::vector<PixelInstance> samples = index.samplePixelsOfClass(imageNrs, label, samplesPerClass,
+                seed);
 
         auto color = LabelImage::decodeLabel(label);
         CURFIL_INFO((boost::format("sampled %d pixels of class '%d' RGB(%s)")
-                % reservoir.size()
+                % samples.size()
                 % static_cast<int>(label)
                 % color.toString()).str());
 
-        allSubsamples.insert(allSubsamples.begin(), reservoir.begin(), reservoir.end());
+        allSubsamples.insert(allSubsamples.end(), samples.begin(), samples.end());
     }
 
     samplingTimer.stop();
@@ -979,6 +1393,36 @@ std::vector<PixelInstance> RandomTreeImage::subsampleTrainingDataClassUniform(
     return allSubsamples;
 }
 
+void RandomTreeImage::transformSubsamples(std::vector<PixelInstance>& subsamples, RandomSource& randomSource) const {
+
+    // the scale factor is drawn from a grid of this many steps in [1 - scaleJitter, 1 + scaleJitter]
+    static const int SCALE_STEPS = 1 << 16;
+
+    const bool flip = configuration.isUseFlipAugmentation();
+    const float scaleJitter = configuration.getScaleJitter();
+    // offsets and regions of the features are given in pixels of the full-resolution image
+    const float pyramidScale = 1.0f / (1 << configuration.getPyramidLevel());
+
+    Sampler flipSampler = randomSource.uniformSampler(2);
+    Sampler scaleSampler = randomSource.uniformSampler(0, SCALE_STEPS);
+
+    size_t numFlipped = 0;
+    for (PixelInstance& sample : subsamples) {
+        const bool flipped = flip && (flipSampler.getNext() == 1);
+        float scale = 1.0f;
+        if (scaleJitter > 0) {
+            scale += scaleJitter * (2.0f * scaleSampler.getNext() / SCALE_STEPS - 1.0f);
+        }
+        sample.setTransform(flipped, scale * pyramidScale);
+        if (flipped) {
+            numFlipped++;
+        }
+    }
+
+    CURFIL_INFO("transformed " << subsamples.size() << " samples: " << numFlipped << " flipped, scale jitter "
+            << scaleJitter << ", pyramid level " << configuration.getPyramidLevel());
+}
+
 }
 
 std::ostream& operator<<(std::ostream& os,
@@ -32,10 +32,10 @@ public:
         return (*this);
     }
 
-    XY normalize(const Depth& depth) const {
+    XY normalize(const Depth& depth, float scale = 1.0f) const {
         assert(depth.isValid());
-        int newX = static_cast<int>(x / depth.getFloatValue());
-        int newY = static_cast<int>(y / depth.getFloatValue());
+        int newX = static_cast<int>(x * scale / depth.getFloatValue());
+        int newY = static_cast<int>(y * scale / depth.getFloatValue());
         return XY(newX, newY);
     }
 
@@ -67,13 +67,24 @@ class PixelInstance {
 public:
 
     PixelInstance(const RGBDImage* image, const LabelType& label, uint16_t x, uint16_t y) :
-            image(image), label(label), point(x, y), depth(Depth::INVALID) {
+            image(image), label(label), point(x, y), depth(Depth::INVALID), flipped(false), scale(1.0f) {
         assert(image != NULL);
         assert(image->inImage(x, y));
         if (!image->hasIntegratedDepth()) {
             throw std::runtime_error("image is not integrated");
         }
 
+        switch (image->getIntegralStorage()) {
+            case COMPACT_INTEGRALS:
+                depth = getCompactPixelDepth<CompactFormat>();
+                return;
+            case WIDE_INTEGRALS:
+                depth = getCompactPixelDepth<WideFormat>();
+                return;
+            default:
+                break;
+        }
+
         int aboveValid = (y > 0) ? image->getDepthValid(x, y - 1) : 0;
         int leftValid = (x > 0) ? image->getDepthValid(x - 1, y) : 0;
         int aboveLeftValid = (x > 0 && y > 0) ? image->getDepthValid(x - 1, y - 1) : 0;
@@ -82,11 +93,11 @@ public:
         assert(valid == 0 || valid == 1);
 
         if (valid == 1) {
-            Depth above = (y > 0) ? image->getDepth(x, y - 1) : Depth(0);
-            Depth left = (x > 0) ? image->getDepth(x - 1, y) : Depth(0);
-            Depth aboveLeft = (x > 0 && y > 0) ? image->getDepth(x - 1, y - 1) : Depth(0);
+            const uint32_t above = (y > 0) ? image->getDepthIntegral(x, y - 1) : 0;
+            const uint32_t left = (x > 0) ? image->getDepthIntegral(x - 1, y) : 0;
+            const uint32_t aboveLeft = (x > 0 && y > 0) ? image->getDepthIntegral(x - 1, y - 1) : 0;
 
-            depth = image->getDepth(x, y) - (left + above - aboveLeft);
+            depth = Depth(static_cast<int>(image->getDepthIntegral(x, y) - (left + above - aboveLeft)));
             assert(depth.isValid());
         } else {
             assert(!depth.isValid());
@@ -95,7 +106,7 @@ public:
 
     PixelInstance(const RGBDImage* image, const LabelType& label, const Depth& depth,
             uint16_t x, uint16_t y) :
-            image(image), label(label), point(x, y), depth(depth) {
+            image(image), label(label), point(x, y), depth(depth), flipped(false), scale(1.0f) {
         assert(image != NULL);
         assert(image->inImage(x, y));
         assert(depth.isValid());
@@ -121,13 +132,56 @@ public:
         return static_cast<uint16_t>(point.getY());
     }
 
-    FeatureResponseType averageRegionColor(const Offset& offset, const Region& region, uint8_t channel) const {
+    /**
+     * Sets a virtual transform of the image around this pixel for data augmentation.
+     * The feature responses are calculated as if the image was mirrored horizontally (if flipped)
+     * and scaled by the given factor. The image itself is not copied.
+     */
+    void setTransform(bool flipped, float scale) {
+        assert(scale > 0);
+        this->flipped = flipped;
+        this->scale = scale;
+    }
+
+    bool isFlipped() const {
+        return flipped;
+    }
+
+    float getScale() const {
+        return scale;
+    }
+
+    // normalizes the feature offset by the depth of the pixel and applies the transform
+    Offset transformOffset(const Offset& offset) const {
+        const Offset normalized = offset.normalize(depth, scale);
+        if (flipped) {
+            return Offset(-normalized.getX(), normalized.getY());
+        }
+        return normalized;
+    }
+
+    // regions are symmetric around their center and therefore not affected by the mirroring
+    Region transformRegion(const Region& region) const {
+        return region.normalize(depth, scale);
+    }
+
+    template<class ResponseType = FeatureResponseType>
+    ResponseType averageRegionColor(const Offset& offset, const Region& region, uint8_t channel) const {
 
         assert(region.getX() >= 0);
         assert(region.getY() >= 0);
 
         assert(image->hasIntegratedColor());
 
+        switch (image->getIntegralStorage()) {
+            case COMPACT_INTEGRALS:
+                return averageCompactRegionColor<ResponseType, CompactFormat>(offset, region, channel);
+            case WIDE_INTEGRALS:
+                return averageCompactRegionColor<ResponseType, WideFormat>(offset, region, channel);
+            default:
+                break;
+        }
+
         const int width = std::max(1, region.getX());
         const int height = std::max(1, region.getY());
 
@@ -139,8 +193,15 @@ public:
         int upperY = y - height;
         int lowerY = y + height;
 
+        if (isInPadding(leftX, upperY) && isInPadding(rightX, lowerY)) {
+            // corners out of the image read the NaN border of the padded integral image
+            ResponseType sum = (image->getColor(rightX, lowerY, channel) - image->getColor(rightX, upperY, channel))
+                    + (image->getColor(leftX, upperY, channel) - image->getColor(leftX, lowerY, channel));
+            return sum;
+        }
+
         if (leftX < 0 || rightX >= image->getWidth() || upperY < 0 || lowerY >= image->getHeight()) {
-            return std::numeric_limits<double>::quiet_NaN();
+            return std::numeric_limits<ResponseType>::quiet_NaN();
         }
 
         assert(inImage(x, y));
@@ -150,22 +211,32 @@ public:
         Point lowerLeft(leftX, lowerY);
         Point lowerRight(rightX, lowerY);
 
-        FeatureResponseType lowerRightPixel = getColor(lowerRight, channel);
-        FeatureResponseType lowerLeftPixel = getColor(lowerLeft, channel);
-        FeatureResponseType upperRightPixel = getColor(upperRight, channel);
-        FeatureResponseType upperLeftPixel = getColor(upperLeft, channel);
+        ResponseType lowerRightPixel = getColor(lowerRight, channel);
+        ResponseType lowerLeftPixel = getColor(lowerLeft, channel);
+        ResponseType upperRightPixel = getColor(upperRight, channel);
+        ResponseType upperLeftPixel = getColor(upperLeft, channel);
 
-        FeatureResponseType sum = (lowerRightPixel - upperRightPixel) + (upperLeftPixel - lowerLeftPixel);
+        ResponseType sum = (lowerRightPixel - upperRightPixel) + (upperLeftPixel - lowerLeftPixel);
 
         return sum;
     }
 
-    FeatureResponseType averageRegionDepth(const Offset& offset, const Region& region) const {
+    template<class ResponseType = FeatureResponseType>
+    ResponseType averageRegionDepth(const Offset& offset, const Region& region) const {
         assert(region.getX() >= 0);
         assert(region.getY() >= 0);
 
         assert(image->hasIntegratedDepth());
 
+        switch (image->getIntegralStorage()) {
+            case COMPACT_INTEGRALS:
+                return averageCompactRegionDepth<ResponseType, CompactFormat>(offset, region);
+            case WIDE_INTEGRALS:
+                return averageCompactRegionDepth<ResponseType, WideFormat>(offset, region);
+            default:
+                break;
+        }
+
         const int width = std::max(1, region.getX());
         const int height = std::max(1, region.getY());
 
@@ -177,8 +248,25 @@ public:
         int upperY = y - height;
         int lowerY = y + height;
 
+        if (isInPadding(leftX, upperY) && isInPadding(rightX, lowerY)) {
+            // the sentinel is NaN if a corner is out of the image
+            const ResponseType sentinel = image->getBorderSentinel(leftX, upperY)
+                    + image->getBorderSentinel(rightX, lowerY);
+
+            const int numValid = (image->getDepthValid(rightX, lowerY) - image->getDepthValid(rightX, upperY))
+                    + (image->getDepthValid(leftX, upperY) - image->getDepthValid(leftX, lowerY));
+            if (numValid == 0) {
+                return std::numeric_limits<ResponseType>::quiet_NaN();
+            }
+
+            const int sum = regionDepthSum(image->getDepthIntegral(leftX, upperY),
+                    image->getDepthIntegral(rightX, upperY), image->getDepthIntegral(leftX, lowerY),
+                    image->getDepthIntegral(rightX, lowerY));
+            return sum / static_cast<ResponseType>(1000) / numValid + sentinel;
+        }
+
         if (leftX < 0 || rightX >= image->getWidth() || upperY < 0 || lowerY >= image->getHeight()) {
-            return std::numeric_limits<double>::quiet_NaN();
+            return std::numeric_limits<ResponseType>::quiet_NaN();
         }
 
         assert(inImage(x, y));
@@ -197,16 +285,13 @@ public:
         assert(numValid >= 0);
 
         if (numValid == 0) {
-            return std::numeric_limits<double>::quiet_NaN();
+            return std::numeric_limits<ResponseType>::quiet_NaN();
         }
 
-        const int lowerRightDepth = getDepth(lowerRight).getIntValue();
-        const int lowerLeftDepth = getDepth(lowerLeft).getIntValue();
-        const int upperRightDepth = getDepth(upperRight).getIntValue();
-        const int upperLeftDepth = getDepth(upperLeft).getIntValue();
-
-        int sum = (lowerRightDepth - upperRightDepth) + (upperLeftDepth - lowerLeftDepth);
-        FeatureResponseType feat = sum / static_cast<FeatureResponseType>(1000);
+        const int sum = regionDepthSum(getDepthIntegral(upperLeft), getDepthIntegral(upperRight),
+                getDepthIntegral(lowerLeft), getDepthIntegral(lowerRight));
+        assert(sum >= 0);
+        ResponseType feat = sum / static_cast<ResponseType>(1000);
         return (feat / numValid);
     }
 
@@ -227,6 +312,8 @@ private:
     LabelType label;
     Point point;
     Depth depth;
+    bool flipped;
+    float scale;
 
     float getColor(const Point& pos, uint8_t channel) const {
         if (!inImage(pos)) {
@@ -236,21 +323,124 @@ private:
         return image->getColor(pos.getX(), pos.getY(), channel);
     }
 
-    Depth getDepth(const Point& pos) const {
-        if (!inImage(pos)) {
-            return Depth::INVALID;
-        }
+    uint32_t getDepthIntegral(const Point& pos) const {
+        assert(inImage(pos));
         assert(image->hasIntegratedDepth());
-        const Depth depth = image->getDepth(pos.getX(), pos.getY());
-        // include zero as it is an integral
-        assert(depth.getIntValue() >= 0);
-        return depth;
+        return image->getDepthIntegral(pos.getX(), pos.getY());
+    }
+
+    // the integral values wrap around in large images. the region sum is exact in unsigned arithmetic
+    static int regionDepthSum(uint32_t upperLeft, uint32_t upperRight, uint32_t lowerLeft, uint32_t lowerRight) {
+        return static_cast<int>((lowerRight - upperRight) + (upperLeft - lowerLeft));
     }
 
     int getDepthValid(const Point& pos) const {
         return image->getDepthValid(pos.getX(), pos.getY());
     }
 
+    // the compact integral images are read in their element types. see RGBDImage::calculateCompactIntegral()
+
+    // the pixel is a region of one pixel. corners left of or above the image are zero
+    template<class Format>
+    Depth getCompactPixelDepth() const {
+        const int x = point.getX();
+        const int y = point.getY();
+
+        const typename Format::Count valid = Format::regionCount(getCompactValid<Format>(x - 1, y - 1),
+                getCompactValid<Format>(x, y - 1), getCompactValid<Format>(x - 1, y), getCompactValid<Format>(x, y));
+        assert(valid == 0 || valid == 1);
+        if (valid == 0) {
+            return Depth::INVALID;
+        }
+
+        const typename Format::Value sum = Format::regionSum(getCompactDepth<Format>(x - 1, y - 1),
+                getCompactDepth<Format>(x, y - 1), getCompactDepth<Format>(x - 1, y), getCompactDepth<Format>(x, y));
+        const Depth pixelDepth(static_cast<int>(sum));
+        assert(pixelDepth.isValid());
+        return pixelDepth;
+    }
+
+    template<class Format>
+    typename Format::Count getCompactValid(int x, int y) const {
+        return (x < 0 || y < 0) ? 0 : image->getCompactValid<Format>(x, y);
+    }
+
+    template<class Format>
+    typename Format::Value getCompactDepth(int x, int y) const {
+        return (x < 0 || y < 0) ? 0 : image->getCompactDepth<Format>(x, y);
+    }
+
+    // zero if the region is in the image, NaN if the region reaches into the border of the padded image.
+    // false if the region reaches out of the image without padding
+    bool getCompactSentinel(int leftX, int upperY, int rightX, int lowerY, float& sentinel) const {
+        if (isInPadding(leftX, upperY) && isInPadding(rightX, lowerY)) {
+            sentinel = image->getBorderSentinel(leftX, upperY) + image->getBorderSentinel(rightX, lowerY);
+            return true;
+        }
+        sentinel = 0.0f;
+        return (leftX >= 0 && rightX < image->getWidth() && upperY >= 0 && lowerY < image->getHeight());
+    }
+
+    template<class ResponseType, class Format>
+    ResponseType averageCompactRegionColor(const Offset& offset, const Region& region, uint8_t channel) const {
+
+        const int width = std::max(1, region.getX());
+        const int height = std::max(1, region.getY());
+
+        const int x = getX() + offset.getX();
+        const int y = getY() + offset.getY();
+
+        const int leftX = x - width;
+        const int rightX = x + width;
+        const int upperY = y - height;
+        const int lowerY = y + height;
+
+        float sentinel;
+        if (!getCompactSentinel(leftX, upperY, rightX, lowerY, sentinel)) {
+            return std::numeric_limits<ResponseType>::quiet_NaN();
+        }
+
+        const typename Format::SignedValue sum = static_cast<typename Format::SignedValue>(Format::regionSum(
+                image->getCompactColor<Format>(leftX, upperY, channel),
+                image->getCompactColor<Format>(rightX, upperY, channel),
+                image->getCompactColor<Format>(leftX, lowerY, channel),
+                image->getCompactColor<Format>(rightX, lowerY, channel)));
+        return sum / static_cast<ResponseType>(RGBDImage::COLOR_SCALE) + sentinel;
+    }
+
+    // the same responses as with the float integral images
+    template<class ResponseType, class Format>
+    ResponseType averageCompactRegionDepth(const Offset& offset, const Region& region) const {
+
+        const int width = std::max(1, region.getX());
+        const int height = std::max(1, region.getY());
+
+        const int x = getX() + offset.getX();
+        const int y = getY() + offset.getY();
+
+        const int leftX = x - width;
+        const int rightX = x + width;
+        const int upperY = y - height;
+        const int lowerY = y + height;
+
+        float sentinel;
+        if (!getCompactSentinel(leftX, upperY, rightX, lowerY, sentinel)) {
+            return std::numeric_limits<ResponseType>::quiet_NaN();
+        }
+
+        const typename Format::Count numValid = Format::regionCount(image->getCompactValid<Format>(leftX, upperY),
+                image->getCompactValid<Format>(rightX, upperY), image->getCompactValid<Format>(leftX, lowerY),
+                image->getCompactValid<Format>(rightX, lowerY));
+        if (numValid == 0) {
+            return std::numeric_limits<ResponseType>::quiet_NaN();
+        }
+
+        const typename Format::Value sum = Format::regionSum(image->getCompactDepth<Format>(leftX, upperY),
+                image->getCompactDepth<Format>(rightX, upperY), image->getCompactDepth<Format>(leftX, lowerY),
+                image->getCompactDepth<Format>(rightX, lowerY));
+        return sum / static_cast<ResponseType>(1000) / numValid + sentinel;
+    }
+
     bool inImage(int x, int y) const {
         return image->inImage(x, y);
     }
@@ -258,6 +448,16 @@ private:
     bool inImage(const Point& pos) const {
         return inImage(pos.getX(), pos.getY());
     }
+
+    // offsets are normalized by the depth and can reach beyond the padding for pixels closer than one meter.
+    // regions with corners beyond the padding take the bounds-checked path
+    bool isInPadding(int x, int y) const {
+        const int padding = image->getPadding();
+        if (padding == 0) {
+            return false;
+        }
+        return (x >= -padding && x < image->getWidth() + padding && y >= -padding && y < image->getHeight() + padding);
+    }
 };
 
 enum FeatureType {
@@ -321,13 +521,16 @@ public:
         return (offset1 != offset2);
     }
 
-    FeatureResponseType calculateFeatureResponse(const PixelInstance& instance) const {
+    // the response is calculated in the given precision. float responses are used for training on CPU
+    // if TrainingConfiguration::isUseFloatResponses() is set
+    template<class ResponseType = FeatureResponseType>
+    ResponseType calculateFeatureResponse(const PixelInstance& instance) const {
         assert(isValid());
         switch (featureType) {
             case DEPTH:
-                return calculateDepthFeature(instance);
+                return calculateDepthFeature<ResponseType>(instance);
             case COLOR:
-                return calculateColorFeature(instance);
+                return calculateColorFeature<ResponseType>(instance);
             default:
                 assert(false);
                 break;
@@ -376,39 +579,43 @@ private:
     Region region2;
     uint8_t channel2;
 
-    FeatureResponseType calculateColorFeature(const PixelInstance& instance) const {
+    template<class ResponseType>
+    ResponseType calculateColorFeature(const PixelInstance& instance) const {
 
         const Depth depth = instance.getDepth();
         if (!depth.isValid()) {
-            return std::numeric_limits<double>::quiet_NaN();
+            return std::numeric_limits<ResponseType>::quiet_NaN();
         }
 
-        FeatureResponseType a = instance.averageRegionColor(offset1.normalize(depth), region1.normalize(depth),
-                channel1);
+        ResponseType a = instance.averageRegionColor<ResponseType>(instance.transformOffset(offset1),
+                instance.transformRegion(region1), channel1);
         if (isnan(a))
             return a;
 
-        FeatureResponseType b = instance.averageRegionColor(offset2.normalize(depth), region2.normalize(depth),
-                channel2);
+        ResponseType b = instance.averageRegionColor<ResponseType>(instance.transformOffset(offset2),
+                instance.transformRegion(region2), channel2);
         if (isnan(b))
             return b;
 
         return (a - b);
     }
 
-    FeatureResponseType calculateDepthFeature(const PixelInstance& instance) const {
+    template<class ResponseType>
+    ResponseType calculateDepthFeature(const PixelInstance& instance) const {
 
         const Depth depth = instance.getDepth();
         if (!depth.isValid()) {
-            return std::numeric_limits<double>::quiet_NaN();
+            return std::numeric_limits<ResponseType>::quiet_NaN();
         }
 
-        FeatureResponseType a = instance.averageRegionDepth(offset1.normalize(depth), region1.normalize(depth));
+        ResponseType a = instance.averageRegionDepth<ResponseType>(instance.transformOffset(offset1),
+                instance.transformRegion(region1));
         if (isnan(a)) {
             return a;
         }
 
-        FeatureResponseType b = instance.averageRegionDepth(offset2.normalize(depth), region2.normalize(depth));
+        ResponseType b = instance.averageRegionDepth<ResponseType>(instance.transformOffset(offset2),
+                instance.transformRegion(region2));
         if (isnan(b)) {
             return b;
         }
@@ -694,7 +901,8 @@ public:
             RandomTree<PixelInstance, ImageFeatureFunction>& node,
             const std::vector<std::vector<const PixelInstance*> >& batches,
             const ImageFeaturesAndThresholds<memory_space>& featuresAndThresholds,
-            cuv::ndarray<FeatureResponseType, cuv::host_memory_space>* featureResponsesHost = 0);
+            cuv::ndarray<FeatureResponseType, cuv::host_memory_space>* featureResponsesHost = 0,
+            cuv::ndarray<WeightType, memory_space>* nanCounters = 0);
 
     template<class memory_space>
     cuv::ndarray<ScoreType, cuv::host_memory_space> calculateScores(
@@ -702,6 +910,20 @@ public:
             const ImageFeaturesAndThresholds<memory_space>& featuresAndThresholds,
             const cuv::ndarray<WeightType, memory_space>& histogram);
 
+    /**
+     * Inference cost per feature that is used to penalize the split scores if feature costs are configured.
+     * The cost of a feature is the cost of its type plus the NaN response cost weighted by the fraction of NaN
+     * responses. 'nanCounters' holds the weight of the samples with a NaN response per feature, 'total' the weight
+     * of all samples.
+     */
+    template<class memory_space>
+    std::vector<ScoreType> calculateFeatureCosts(
+            const cuv::ndarray<WeightType, memory_space>& nanCounters,
+            WeightType total,
+            const ImageFeaturesAndThresholds<memory_space>& featuresAndThresholds);
+
+    ScoreType calculateFeatureCost(int8_t featureType, double nanRate) const;
+
 private:
 
     void selectDevice();
@@ -730,6 +952,8 @@ private:
     boost::shared_ptr<cuv::allocator> featureResponsesAllocator;
 };
 
+class DatasetIndex;
+
 class RandomTreeImage {
 public:
 
@@ -739,13 +963,60 @@ public:
             const TrainingConfiguration& configuration,
             const cuv::ndarray<WeightType, cuv::host_memory_space>& classLabelPriorDistribution);
 
-    void train(const std::vector<LabeledRGBDImage>& trainLabelImages,
+    /**
+     * Trains the tree on a subsample of the images 'imageNrs' of the dataset index.
+     * If the tree was already trained (e.g. loaded from JSON), training continues at the current leaves (warm start):
+     * the subsampled pixels are routed down the existing splits and leaves are grown up to the configured maxDepth.
+     * Node ids and the class label prior distribution of the existing tree are kept.
+     *
+     * @param trainingSamples if not null, the subsampled training pixels are stored (in-bag pixels of the tree)
+     */
+    void train(const DatasetIndex& index, const std::vector<size_t>& imageNrs,
+            RandomSource& randomSource, size_t subsampleCount,
+            std::vector<PixelInstance>* trainingSamples = 0);
+
+    /**
+     * First step of train(): draws the training pixels of the tree from the images 'imageNrs'.
+     * Only the labels and the depth of the images are accessed.
+     */
+    std::vector<PixelInstance> subsample(const DatasetIndex& index, const std::vector<size_t>& imageNrs,
             RandomSource& randomSource, size_t subsampleCount);
 
+    /**
+     * Second step of train(): grows the tree on the pixels of subsample().
+     * The images of the pixels must be completely loaded.
+     */
+    void train(std::vector<PixelInstance>& subsamples, RandomSource& randomSource,
+            std::vector<PixelInstance>* trainingSamples = 0);
+
     void test(const RGBDImage* image, LabelImage& prediction) const;
 
     void normalizeHistograms(const double histogramBias);
 
+    /**
+     * Reduced-error pruning of the trained tree with held-out labeled images.
+     * Subtrees are collapsed if this does not increase the number of misclassified validation pixels at the node
+     * by more than 'tolerance' (relative to the number of validation pixels that reach the node).
+     * Histograms are normalized with 'histogramBias' before pruning.
+     *
+     * @return the number of removed nodes
+     */
+    size_t prune(const std::vector<LabeledRGBDImage>& validationImages, const double tolerance,
+            const double histogramBias);
+
+    /**
+     * Replaces the histograms of all nodes and the class label prior distribution by counts over a full dataset.
+     * With class-uniform subsampling, the counts are weighted per class such that all classes have the same weight.
+     *
+     * @param nodeHistograms N×C matrix with the counts of all nodes. row (nodeId - root node id) belongs to the node
+     * @param labelCounts counts per class of all pixels that were pushed through the tree: the pixels that training
+     *        samples from (valid depth, no ignored label). they are also the new class label prior distribution
+     * @param blend weight of the original histograms and prior distribution in [0, 1]
+     */
+    void refitHistograms(const cuv::ndarray<double, cuv::host_memory_space>& nodeHistograms,
+            const cuv::ndarray<double, cuv::host_memory_space>& labelCounts,
+            const double blend);
+
     const boost::shared_ptr<RandomTree<PixelInstance, ImageFeatureFunction> >& getTree() const {
         return tree;
     }
@@ -758,6 +1029,10 @@ public:
         return id;
     }
 
+    const TrainingConfiguration& getConfiguration() const {
+        return configuration;
+    }
+
     bool shouldIgnoreLabel(const LabelType& label) const;
 
 private:
@@ -774,16 +1049,16 @@ private:
 
     cuv::ndarray<WeightType, cuv::host_memory_space> classLabelPriorDistribution;
 
-    void calculateLabelPriorDistribution(const std::vector<LabeledRGBDImage>& trainLabelImages);
-
     std::vector<PixelInstance> subsampleTrainingDataPixelUniform(
-            const std::vector<LabeledRGBDImage>& trainLabelImages,
+            const DatasetIndex& index, const std::vector<size_t>& imageNrs,
             RandomSource& randomSource, size_t subsampleCount) const;
 
     std::vector<PixelInstance> subsampleTrainingDataClassUniform(
-            const std::vector<LabeledRGBDImage>& trainLabelImages,
+            const DatasetIndex& index, const std::vector<size_t>& imageNrs,
             RandomSource& randomSource, size_t subsampleCount) const;
 
+    void transformSubsamples(std::vector<PixelInstance>& subsamples, RandomSource& randomSource) const;
+
 };
 
 }
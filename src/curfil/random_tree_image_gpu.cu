@@ -1,5 +1,6 @@
 #include "random_tree_image_gpu.h"
 
+#include <algorithm>
 #include <boost/format.hpp>
 #include <cuda_runtime_api.h>
 #include <curand_kernel.h>
@@ -36,9 +37,10 @@ float getColorChannelValue(int x, int y, int imageNr, int channel) {
     return tex2DLayered(colorTexture, x, y, imageNr * colorChannels + channel);
 }
 
+// the depth integral modulo 2^32. see RGBDImage::getDepthIntegral()
 __device__
-int getDepthValue(int x, int y, int imageNr) {
-    return tex2DLayered(depthTexture, x, y, imageNr * depthChannels + depthChannel);
+unsigned int getDepthValue(int x, int y, int imageNr) {
+    return static_cast<unsigned int>(tex2DLayered(depthTexture, x, y, imageNr * depthChannels + depthChannel));
 }
 
 __device__
@@ -67,12 +69,12 @@ FeatureResponseType averageRegionDepth(int imageNr,
         return nan("");
     }
 
-    int upperLeftDepth = getDepthValue(leftX, upperY, imageNr);
-    int upperRightDepth = getDepthValue(rightX, upperY, imageNr);
-    int lowerRightDepth = getDepthValue(rightX, lowerY, imageNr);
-    int lowerLeftDepth = getDepthValue(leftX, lowerY, imageNr);
+    unsigned int upperLeftDepth = getDepthValue(leftX, upperY, imageNr);
+    unsigned int upperRightDepth = getDepthValue(rightX, upperY, imageNr);
+    unsigned int lowerRightDepth = getDepthValue(rightX, lowerY, imageNr);
+    unsigned int lowerLeftDepth = getDepthValue(leftX, lowerY, imageNr);
 
-    int sum = (lowerRightDepth - upperRightDepth) + (upperLeftDepth - lowerLeftDepth);
+    int sum = static_cast<int>((lowerRightDepth - upperRightDepth) + (upperLeftDepth - lowerLeftDepth));
     FeatureResponseType feat = sum / static_cast<FeatureResponseType>(1000);
     return (feat / numValid);
 }
@@ -744,18 +746,15 @@ void ImageCache::copyImages(size_t cacheSize, const std::set<const RGBDImage*>&
     if (images.empty())
         return;
 
-    int width = (*images.begin())->getWidth();
-    int height = (*images.begin())->getHeight();
-
-#ifndef NDEBUG
-    {
-        std::set<const RGBDImage*>::const_iterator it;
-        for (it = images.begin(); it != images.end(); it++) {
-            assert(width == (*it)->getWidth());
-            assert(height == (*it)->getHeight());
-        }
+    // the arrays are allocated at the largest image size. smaller images occupy the upper left corner of their
+    // layers, such that images of different sizes share the cache
+    int width = this->width;
+    int height = this->height;
+    std::set<const RGBDImage*>::const_iterator imageIt;
+    for (imageIt = images.begin(); imageIt != images.end(); imageIt++) {
+        width = std::max(width, (*imageIt)->getWidth());
+        height = std::max(height, (*imageIt)->getHeight());
     }
-#endif
 
     if (width != this->width || height != this->height) {
         this->width = width;
@@ -782,6 +781,11 @@ void ImageCache::transferElement(size_t imagePos, const void* imagePtr, cudaStre
 
     const RGBDImage* image = reinterpret_cast<const RGBDImage*>(imagePtr);
 
+    const int width = image->getWidth();
+    const int height = image->getHeight();
+    assert(width <= this->width);
+    assert(height <= this->height);
+
     struct cudaMemcpy3DParms colorCopyParams;
     memset(&colorCopyParams, 0, sizeof(colorCopyParams));
     colorCopyParams.extent = make_cudaExtent(width, height, colorChannels);
@@ -794,24 +798,39 @@ void ImageCache::transferElement(size_t imagePos, const void* imagePtr, cudaStre
     depthCopyParams.kind = cudaMemcpyHostToDevice;
     depthCopyParams.dstArray = depthTextureData;
 
+    if (image->isColorInterleaved()) {
+        throw std::runtime_error("images with interleaved color cannot be transferred to the GPU");
+    }
+
+    if (image->isCompact()) {
+        throw std::runtime_error("images with compact integral images cannot be transferred to the GPU");
+    }
+
+    // padded images are copied without their border
+    const int padding = image->getPadding();
+    const int paddedWidth = width + 2 * padding;
+    const int paddedHeight = height + 2 * padding;
+
     assert(image->getColorImage().ndim() == 3);
     assert(image->getColorImage().shape(0) == static_cast<unsigned int>(colorChannels));
-    assert(image->getColorImage().shape(1) == static_cast<unsigned int>(height));
-    assert(image->getColorImage().shape(2) == static_cast<unsigned int>(width));
+    assert(image->getColorImage().shape(1) == static_cast<unsigned int>(paddedHeight));
+    assert(image->getColorImage().shape(2) == static_cast<unsigned int>(paddedWidth));
     colorCopyParams.dstPos = make_cudaPos(0, 0, colorChannels * imagePos);
+    colorCopyParams.srcPos = make_cudaPos(sizeof(float) * padding, padding, 0);
     colorCopyParams.srcPtr = make_cudaPitchedPtr(
             const_cast<void*>(reinterpret_cast<const void*>(image->getColorImage().ptr())),
-            sizeof(float) * width, width, height);
+            sizeof(float) * paddedWidth, paddedWidth, paddedHeight);
     cudaSafeCall(cudaMemcpy3DAsync(&colorCopyParams, stream));
 
     assert(image->getDepthImage().ndim() == 3);
     assert(image->getDepthImage().shape(0) == static_cast<unsigned int>(depthChannels));
-    assert(image->getDepthImage().shape(1) == static_cast<unsigned int>(height));
-    assert(image->getDepthImage().shape(2) == static_cast<unsigned int>(width));
+    assert(image->getDepthImage().shape(1) == static_cast<unsigned int>(paddedHeight));
+    assert(image->getDepthImage().shape(2) == static_cast<unsigned int>(paddedWidth));
     depthCopyParams.dstPos = make_cudaPos(0, 0, depthChannels * imagePos);
+    depthCopyParams.srcPos = make_cudaPos(sizeof(int) * padding, padding, 0);
     depthCopyParams.srcPtr = make_cudaPitchedPtr(
             const_cast<void*>(reinterpret_cast<const void*>(image->getDepthImage().ptr())),
-            sizeof(int) * width, width, height);
+            sizeof(int) * paddedWidth, paddedWidth, paddedHeight);
     cudaSafeCall(cudaMemcpy3DAsync(&depthCopyParams, stream));
 }
 
@@ -1520,9 +1539,11 @@ __global__ void scoreKernel(const WeightType* counters,
     scores[thresh * numFeatures + feature] = score;
 }
 
+// nanCounters is optional. the blocks of the first threshold count the NaN responses of their feature
 __global__ void aggregateHistogramsKernel(
         const FeatureResponseType* featureResponses,
         WeightType* counters,
+        WeightType* nanCounters,
         const float* thresholds,
         const uint8_t* sampleLabel,
         unsigned int numThresholds,
@@ -1556,6 +1577,8 @@ __global__ void aggregateHistogramsKernel(
     __syncthreads();
 
     unsigned int labelFlags = 0;
+    const bool countNaN = (nanCounters != NULL && thresh == 0);
+    WeightType nanCount = 0;
 
     // iterate over all samples and increment the according counter in shared memory
     const FeatureResponseType* resultPtr = featureResponses
@@ -1571,6 +1594,10 @@ __global__ void aggregateHistogramsKernel(
         assert(label < 32);
         labelFlags |= 1 << label;
 
+        if (countNaN && isnan(featureResponse)) {
+            nanCount++;
+        }
+
         int value = static_cast<int>(!(featureResponse <= threshold));
         assert(value == 0 || value == 1);
         assert(counterShared[(2 * label) * blockDim.x + 2 * threadIdx.x + value] < COUNTER_MAX);
@@ -1578,6 +1605,10 @@ __global__ void aggregateHistogramsKernel(
         // no need to sync here because data is accessed only by the same thread in this loop
     }
 
+    if (nanCount > 0) {
+        atomicAdd(nanCounters + feature, nanCount);
+    }
+
     // no sync needed here because it is done in the loop over the labels
 
     assert(isPowerOfTwo(blockDim.x));
@@ -1703,17 +1734,39 @@ std::vector<std::vector<const PixelInstance*> > ImageFeatureEvaluation::prepare(
 
     utils::Timer prepareTime;
 
+    // the kernels evaluate the images of one size at once. group the samples by image size, starting with the
+    // sizes of the cached images, such that every batch consists of images of the same size
+    typedef std::pair<int, int> ImageSize;
+    std::vector<ImageSize> imageSizes;
+    for (int pass = 0; pass < 2; pass++) {
+        const bool cached = (pass == 0);
+        for (size_t sample = 0; sample < hostSamples.size(); sample++) {
+            if (imageCache.containsElement(hostSamples[sample]->getRGBDImage()) != cached) {
+                continue;
+            }
+            const ImageSize size = std::make_pair(hostSamples[sample]->width(), hostSamples[sample]->height());
+            if (std::find(imageSizes.begin(), imageSizes.end(), size) == imageSizes.end()) {
+                imageSizes.push_back(size);
+            }
+        }
+    }
+
     std::vector<const PixelInstance*> samples;
 
-    // take samples with cached images first. then the uncached images
-    for (size_t sample = 0; sample < hostSamples.size(); sample++) {
-        if (imageCache.containsElement(hostSamples[sample]->getRGBDImage())) {
-            samples.push_back(hostSamples[sample]);
+    // per image size, take samples with cached images first. then the uncached images
+    for (size_t sizeNr = 0; sizeNr < imageSizes.size(); sizeNr++) {
+        const ImageSize& size = imageSizes[sizeNr];
+        for (size_t sample = 0; sample < hostSamples.size(); sample++) {
+            if (hostSamples[sample]->width() == size.first && hostSamples[sample]->height() == size.second
+                    && imageCache.containsElement(hostSamples[sample]->getRGBDImage())) {
+                samples.push_back(hostSamples[sample]);
+            }
         }
-    }
-    for (size_t sample = 0; sample < hostSamples.size(); sample++) {
-        if (!imageCache.containsElement(hostSamples[sample]->getRGBDImage())) {
-            samples.push_back(hostSamples[sample]);
+        for (size_t sample = 0; sample < hostSamples.size(); sample++) {
+            if (hostSamples[sample]->width() == size.first && hostSamples[sample]->height() == size.second
+                    && !imageCache.containsElement(hostSamples[sample]->getRGBDImage())) {
+                samples.push_back(hostSamples[sample]);
+            }
         }
     }
 
@@ -1731,7 +1784,9 @@ std::vector<std::vector<const PixelInstance*> > ImageFeatureEvaluation::prepare(
 
         if ((imagesInCurrentBatch.find(sample->getRGBDImage()) == imagesInCurrentBatch.end()
                 && imagesInCurrentBatch.size() >= static_cast<size_t>(configuration.getImageCacheSize()))
-                || currentBatch.size() == configuration.getMaxSamplesPerBatch()) {
+                || currentBatch.size() == configuration.getMaxSamplesPerBatch()
+                || (!currentBatch.empty() && (sample->width() != currentBatch[0]->width()
+                        || sample->height() != currentBatch[0]->height()))) {
             addBatch(node, batches, currentBatch, imagesInCurrentBatch);
         }
 
@@ -1745,9 +1800,6 @@ std::vector<std::vector<const PixelInstance*> > ImageFeatureEvaluation::prepare(
 
     assert(!batches.empty());
 
-    imageWidth = batches[0][0]->width();
-    imageHeight = batches[0][0]->height();
-
     node.setTimerValue("prepareBatches", prepareTime);
 
     if (!keepMutexLocked) {
@@ -1810,6 +1862,10 @@ ImageFeaturesAndThresholds<cuv::dev_memory_space> ImageFeatureEvaluation::genera
 
     Samples<cuv::dev_memory_space> samplesOnDevice = copySamplesToDevice(samples, streams[0]);
 
+    // the samples are of images of the same size. see evaluateBestSplits()
+    imageWidth = samples[0]->width();
+    imageHeight = samples[0]->height();
+
     ImageFeaturesAndThresholds<cuv::dev_memory_space> featuresAndThresholds(numFeatures, numThresholds,
             featuresAllocator);
 
@@ -1866,7 +1922,8 @@ cuv::ndarray<WeightType, cuv::dev_memory_space> ImageFeatureEvaluation::calculat
         RandomTree<PixelInstance, ImageFeatureFunction>& node,
         const std::vector<std::vector<const PixelInstance*> >& batches,
         const ImageFeaturesAndThresholds<cuv::dev_memory_space>& featuresAndThresholds,
-        cuv::ndarray<FeatureResponseType, cuv::host_memory_space>* featureResponsesHost) {
+        cuv::ndarray<FeatureResponseType, cuv::host_memory_space>* featureResponsesHost,
+        cuv::ndarray<WeightType, cuv::dev_memory_space>* nanCounters) {
 
     unsigned int numFeatures = configuration.getFeatureCount();
     unsigned int numThresholds = configuration.getThresholds();
@@ -1902,6 +1959,12 @@ cuv::ndarray<WeightType, cuv::dev_memory_space> ImageFeatureEvaluation::calculat
     cudaSafeCall(cudaMemsetAsync(counters.ptr(), 0,
             static_cast<size_t>(counters.size() * sizeof(WeightType)), streams[0]));
 
+    if (nanCounters) {
+        assert(nanCounters->size() == numFeatures);
+        cudaSafeCall(cudaMemsetAsync(nanCounters->ptr(), 0,
+                static_cast<size_t>(nanCounters->size() * sizeof(WeightType)), streams[0]));
+    }
+
     assert(numFeatures == configuration.getFeatureCount());
     cuv::ndarray<FeatureResponseType, cuv::dev_memory_space> featureResponsesDevice(numFeatures,
             configuration.getMaxSamplesPerBatch(), featureResponsesAllocator);
@@ -1926,6 +1989,10 @@ cuv::ndarray<WeightType, cuv::dev_memory_space> ImageFeatureEvaluation::calculat
 
             Samples<cuv::dev_memory_space> sampleData = copySamplesToDevice(currentBatch, streams[0]);
 
+            // the images of a batch have the same size. see prepare()
+            imageWidth = currentBatch[0]->width();
+            imageHeight = currentBatch[0]->height();
+
             featureResponsesDevice.resize(numFeatures, batchSize);
 
             unsigned int featuresPerBlock = std::min(numFeatures, 32u);
@@ -1999,6 +2066,7 @@ cuv::ndarray<WeightType, cuv::dev_memory_space> ImageFeatureEvaluation::calculat
                 aggregateHistogramsKernel<<<blockSize, threads, sharedMemory, streams[1]>>>(
                         featureResponsesDevice.ptr(),
                         counters.ptr(),
+                        nanCounters ? nanCounters->ptr() : NULL,
                         featuresAndThresholds.thresholds().ptr(),
                         sampleData.labels,
                         numThresholds,
@@ -2072,6 +2140,30 @@ cuv::ndarray<ScoreType, cuv::host_memory_space> ImageFeatureEvaluation::calculat
     return scoresCPU;
 }
 
+template<>
+std::vector<ScoreType> ImageFeatureEvaluation::calculateFeatureCosts(
+        const cuv::ndarray<WeightType, cuv::dev_memory_space>& nanCounters,
+        WeightType total,
+        const ImageFeaturesAndThresholds<cuv::dev_memory_space>& featuresAndThresholds) {
+
+    const unsigned int numFeatures = configuration.getFeatureCount();
+    assert(nanCounters.size() == numFeatures);
+
+    // only one counter per feature is transferred
+    cuv::ndarray<WeightType, cuv::host_memory_space> nanCountersCPU(nanCounters, streams[1]);
+    cuv::ndarray<int8_t, cuv::host_memory_space> types(featuresAndThresholds.types(), streams[1]);
+    cudaSafeCall(cudaStreamSynchronize(streams[1]));
+
+    std::vector<ScoreType> costs(numFeatures);
+    for (size_t featureNr = 0; featureNr < numFeatures; featureNr++) {
+        assert(nanCountersCPU[featureNr] <= total);
+        const double nanRate = (total == 0) ? 0.0 : nanCountersCPU[featureNr] / static_cast<double>(total);
+        costs[featureNr] = calculateFeatureCost(types(featureNr), nanRate);
+    }
+
+    return costs;
+}
+
 boost::shared_ptr<const TreeNodes> convertTree(
         const boost::shared_ptr<const RandomTreeImage>& randomTreeImage) {
     const boost::shared_ptr<RandomTree<PixelInstance, ImageFeatureFunction> >& tree =
@@ -183,6 +183,21 @@ public:
 
     void copyImages(size_t imageCacheSize, const std::vector<const PixelInstance*>& samples);
 
+    /**
+     * @return the width of the cache arrays, which is the width of the largest cached image.
+     * the cache is cleared when it grows
+     */
+    int getWidth() const {
+        return width;
+    }
+
+    /**
+     * @return the height of the cache arrays
+     */
+    int getHeight() const {
+        return height;
+    }
+
 protected:
 
     virtual void bind();
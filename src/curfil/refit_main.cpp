@@ -0,0 +1,51 @@
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+
+#include "image.h"
+#include "random_forest_image.h"
+#include "tree_tool.h"
+#include "utils.h"
+
+namespace po = boost::program_options;
+
+using namespace curfil;
+
+int main(int argc, char **argv) {
+
+    double blend = 0.0;
+
+    TreeTool tool("folderTraining", "folder with labeled images used to refit the histograms",
+            "folder to output the refitted trees");
+    tool.addOptions()
+    ("blend", po::value<double>(&blend)->default_value(blend),
+            "weight of the original histograms in [0, 1]. 0 replaces the histograms")
+            ;
+
+    if (!tool.parseCommandLine(argc, argv)) {
+        return EXIT_FAILURE;
+    }
+
+    if (blend < 0.0 || blend > 1.0) {
+        throw std::runtime_error(boost::str(boost::format("illegal histogram blend: %lf") % blend));
+    }
+
+    CURFIL_INFO("blend: " << blend);
+
+    tool.readTrees();
+
+    const std::string& folderTraining = tool.getFolder();
+    const DatasetManifest manifest = DatasetManifest::load(folderTraining);
+    const std::vector<std::string> filenames = listImageFilenames(folderTraining, manifest);
+    if (filenames.empty()) {
+        throw std::runtime_error(std::string("found no files in ") + folderTraining);
+    }
+
+    RandomForestImage forest(tool.getTrees(), tool.getConfiguration());
+    const double histogramBias = 0.0;
+    forest.refitHistograms(filenames, tool.isUseCIELab(), tool.isUseDepthFilling(), blend, histogramBias, manifest);
+
+    tool.writeTrees(folderTraining);
+
+    CURFIL_INFO("finished");
+    return EXIT_SUCCESS;
+}
@@ -1,9 +1,11 @@
 #include "train.h"
 
+#include <algorithm>
 #include <cuda.h>
 #include <iomanip>
 
 #include "image.h"
+#include "import.h"
 #include "random_forest_image.h"
 #include "random_tree_image.h"
 #include "utils.h"
@@ -44,34 +46,73 @@ void determineImageCacheSizeAndSamplesPerBatch(const std::vector<LabeledRGBDImag
 
     CURFIL_INFO("max samples per batch: " << maxSamplesPerBatch);
 
-    if (images.size() * images[0].getSizeInMemory() <= imageCacheSizeMB * 1024lu * 1024lu) {
+    // the images may differ in size. the cache must hold as many of the largest images
+    size_t imageSizeInMemory = 0;
+    for (const LabeledRGBDImage& image : images) {
+        imageSizeInMemory = std::max(imageSizeInMemory, image.getSizeInMemory());
+    }
+
+    if (images.size() * imageSizeInMemory <= imageCacheSizeMB * 1024lu * 1024lu) {
         imageCacheSize = images.size();
     } else {
-        imageCacheSize = imageCacheSizeMB * 1024lu * 1024lu / images[0].getSizeInMemory();
+        imageCacheSize = imageCacheSizeMB * 1024lu * 1024lu / imageSizeInMemory;
     }
 
     CURFIL_INFO((boost::format("image cache size: %d images (%.1f MB)")
             % imageCacheSize
-            % (imageCacheSize * images[0].getSizeInMemory() / 1024.0 / 1024.0)).str());
+            % (imageCacheSize * imageSizeInMemory / 1024.0 / 1024.0)).str());
 
     if (imageCacheSizeMB * 1024lu * 1024lu >= freeMemoryOnGPU) {
         throw std::runtime_error("image cache size too large");
     }
 }
 
+static std::vector<boost::shared_ptr<RandomTreeImage> > readTrees(const std::vector<std::string>& treeFiles) {
+
+    std::vector<boost::shared_ptr<RandomTreeImage> > ensemble(treeFiles.size());
+
+    for (size_t treeNr = 0; treeNr < treeFiles.size(); treeNr++) {
+        CURFIL_INFO("reading tree " << treeNr << " from " << treeFiles[treeNr]);
+
+        std::string hostname;
+        boost::filesystem::path folderTraining;
+        boost::posix_time::ptime date;
+        RandomTreeImport::readJSON(treeFiles[treeNr], ensemble[treeNr], hostname, folderTraining, date);
+
+        CURFIL_INFO("trained " << date << " on " << hostname);
+        CURFIL_INFO(*ensemble[treeNr]);
+
+        if (ensemble[treeNr]->getId() != treeNr) {
+            throw std::runtime_error((boost::format("tree %d in '%s' has id %d. tree files must be given in order")
+                    % treeNr % treeFiles[treeNr] % ensemble[treeNr]->getId()).str());
+        }
+    }
+
+    return ensemble;
+}
+
 RandomForestImage train(std::vector<LabeledRGBDImage>& images, size_t trees,
-        const TrainingConfiguration& configuration, bool trainTreesInParallel) {
+        const TrainingConfiguration& configuration, bool trainTreesInParallel,
+        const std::vector<std::string>& warmStartTreeFiles, ConfusionMatrix* outOfBagConfusionMatrix,
+        const RandomForestImage::ImageLoader& imageLoader) {
 
     CURFIL_INFO("trees: " << trees);
     CURFIL_INFO("training trees in parallel: " << trainTreesInParallel);
     CURFIL_INFO(configuration);
 
+    if (!warmStartTreeFiles.empty() && warmStartTreeFiles.size() != trees) {
+        throw std::runtime_error((boost::format("got %d trees for warm start but %d trees to train")
+                % warmStartTreeFiles.size() % trees).str());
+    }
+
     // Train
 
-    RandomForestImage randomForest(trees, configuration);
+    RandomForestImage randomForest = warmStartTreeFiles.empty() ?
+            RandomForestImage(trees, configuration) :
+            RandomForestImage(readTrees(warmStartTreeFiles), configuration);
 
     utils::Timer trainTimer;
-    randomForest.train(images, !trainTreesInParallel);
+    randomForest.train(images, !trainTreesInParallel, outOfBagConfusionMatrix, imageLoader);
     trainTimer.stop();
 
     CURFIL_INFO("training took " << trainTimer.format(2) <<
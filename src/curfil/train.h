@@ -10,8 +10,16 @@ void determineImageCacheSizeAndSamplesPerBatch(const std::vector<LabeledRGBDImag
         const std::vector<int>& deviceId, const size_t featureCount, const size_t numThresholds,
         size_t imageCacheSizeMB, unsigned int& imageCacheSize, unsigned int& maxSamplesPerBatch);
 
+/**
+ * @param warmStartTreeFiles if not empty, the training of these serialized trees is continued (one file per tree)
+ * @param outOfBagConfusionMatrix if not null, the out-of-bag estimate is stored. see RandomForestImage::train
+ * @param imageLoader if set, the images are only partially loaded (two-pass loading). see RandomForestImage::train
+ */
 RandomForestImage train(std::vector<LabeledRGBDImage>& image, size_t trees,
-        const TrainingConfiguration& configuration, bool trainTreesInParallel);
+        const TrainingConfiguration& configuration, bool trainTreesInParallel,
+        const std::vector<std::string>& warmStartTreeFiles = std::vector<std::string>(),
+        ConfusionMatrix* outOfBagConfusionMatrix = 0,
+        const RandomForestImage::ImageLoader& imageLoader = RandomForestImage::ImageLoader());
 
 }
 
@@ -2,6 +2,7 @@
 #include <tbb/task_scheduler_init.h>
 
 #include "export.h"
+#include "predict.h"
 #include "train.h"
 #include "utils.h"
 #include "version.h"
@@ -35,6 +36,22 @@ int main(int argc, char **argv) {
     bool trainTreesInParallel = false; // parallel tree training on GPU is considered to be an experimental feature
     bool verboseTree = false;
     int imageCacheSizeMB = 0;
+    std::vector<std::string> warmStartTreeFiles;
+    uint16_t sortTileSize = 16;
+    bool useFloatResponses = false;
+    bool useFlipAugmentation = false;
+    float scaleJitter = 0.0f;
+    int pyramidLevel = 0;
+    float depthFeatureCost = 0.0f;
+    float colorFeatureCost = 0.0f;
+    float nanResponseCost = 0.0f;
+    bool padIntegralImages = false;
+    bool outOfBag = false;
+    std::string cacheFolder = "";
+    bool mapImages = false;
+    bool loadLabelsFirst = false;
+    bool interleaveColor = false;
+    bool compactIntegrals = false;
 
     // Declare the supported options.
     po::options_description options("options");
@@ -74,7 +91,46 @@ int main(int argc, char **argv) {
             "whether to write verbose tree include profiling and debugging information")
     ("trainTreesInParallel",
             po::value<bool>(&trainTreesInParallel)->implicit_value(true)->default_value(trainTreesInParallel),
-            "whether to train multiple trees sequentially (default) or in parallel (experimental)");
+            "whether to train multiple trees sequentially (default) or in parallel, sharing all threads (experimental on GPU)")
+    ("sortTileSize", po::value<uint16_t>(&sortTileSize)->default_value(sortTileSize),
+            "edge length of the spatial tiles by which training samples are sorted for cache locality")
+    ("useFloatResponses",
+            po::value<bool>(&useFloatResponses)->implicit_value(true)->default_value(useFloatResponses),
+            "calculate feature responses in single precision (CPU mode only)")
+    ("flipAugmentation",
+            po::value<bool>(&useFlipAugmentation)->implicit_value(true)->default_value(useFlipAugmentation),
+            "randomly mirror the training samples horizontally (CPU mode only)")
+    ("scaleJitter", po::value<float>(&scaleJitter)->default_value(scaleJitter),
+            "randomly scale the training samples by a factor in [1 - scaleJitter, 1 + scaleJitter] (CPU mode only)")
+    ("pyramidLevel", po::value<int>(&pyramidLevel)->default_value(pyramidLevel),
+            "train on the images downsampled by 2^pyramidLevel. the trees predict full-resolution images (CPU mode only)")
+    ("depthFeatureCost", po::value<float>(&depthFeatureCost)->default_value(depthFeatureCost),
+            "inference cost of depth features. split scores are divided by one plus the feature cost")
+    ("colorFeatureCost", po::value<float>(&colorFeatureCost)->default_value(colorFeatureCost),
+            "inference cost of color features")
+    ("nanResponseCost", po::value<float>(&nanResponseCost)->default_value(nanResponseCost),
+            "feature cost that is weighted by the estimated fraction of NaN responses of the feature")
+    ("padIntegralImages",
+            po::value<bool>(&padIntegralImages)->implicit_value(true)->default_value(padIntegralImages),
+            "pad the integral images by boxRadius + regionSize to avoid bounds checks in CPU feature evaluation. "
+            "regions of pixels closer than one meter can reach beyond the pad and keep the bounds checks. "
+            "the integral images grow to (width + 2 * pad) * (height + 2 * pad), "
+            "e.g. 2.3 times the memory for 640x480 images with boxRadius 127 and regionSize 16")
+    ("outOfBag", po::value<bool>(&outOfBag)->implicit_value(true)->default_value(outOfBag),
+            "estimate the accuracy of the forest on the pixels that the trees were not trained on (CPU)")
+    ("cacheFolder", po::value<std::string>(&cacheFolder)->default_value(cacheFolder),
+            "folder of the binary cache of preprocessed images. leave it empty to disable the cache")
+    ("mapImages", po::value<bool>(&mapImages)->implicit_value(true)->default_value(mapImages),
+            "memory-map the images from the image cache instead of keeping them in RAM. requires cacheFolder")
+    ("loadLabelsFirst", po::value<bool>(&loadLabelsFirst)->implicit_value(true)->default_value(loadLabelsFirst),
+            "load only labels and depth to draw the training pixels and then the color of the sampled images (CPU mode only)")
+    ("interleaveColor", po::value<bool>(&interleaveColor)->implicit_value(true)->default_value(interleaveColor),
+            "store the color integral images per pixel instead of per channel for fewer cache misses (CPU mode only)")
+    ("compactIntegrals", po::value<bool>(&compactIntegrals)->implicit_value(true)->default_value(compactIntegrals),
+            "store the integral images in fixed point with 16 bit valid counts where the region size allows. "
+            "cannot be combined with cacheFolder or interleaveColor (CPU mode only)")
+    ("warmStartTree", po::value<std::vector<std::string> >(&warmStartTreeFiles),
+            "continue training of this serialized tree (JSON) up to maxDepth. give one file per tree, in order");
     ;
 
     po::positional_options_description pod;
@@ -119,7 +175,34 @@ int main(int argc, char **argv) {
 
     tbb::task_scheduler_init init(numThreads);
 
-    std::vector<LabeledRGBDImage> images = loadImages(folderTraining, useCIELab, useDepthFilling);
+    if (mapImages && (cacheFolder.empty() || padIntegralImages || interleaveColor)) {
+        throw std::runtime_error(
+                "mapImages requires a cacheFolder and cannot be combined with padIntegralImages or interleaveColor");
+    }
+
+    if (loadLabelsFirst && TrainingConfiguration::parseAccelerationModeString(modeString) != CPU_ONLY) {
+        throw std::runtime_error("loadLabelsFirst is only supported in CPU mode");
+    }
+
+    if (interleaveColor && TrainingConfiguration::parseAccelerationModeString(modeString) != CPU_ONLY) {
+        throw std::runtime_error("interleaveColor is only supported in CPU mode");
+    }
+
+    if (compactIntegrals && TrainingConfiguration::parseAccelerationModeString(modeString) != CPU_ONLY) {
+        throw std::runtime_error("compactIntegrals is only supported in CPU mode");
+    }
+
+    if (compactIntegrals && (!cacheFolder.empty() || interleaveColor)) {
+        throw std::runtime_error("compactIntegrals cannot be combined with cacheFolder or interleaveColor");
+    }
+
+    const int integralPadding = padIntegralImages ? boxRadius + regionSize : 0;
+    // the regions of augmented samples are scaled by up to 1 + scaleJitter
+    const float compactRegionSize = compactIntegrals ? regionSize * (1 + scaleJitter) : 0;
+    std::vector<LabeledRGBDImage> images = loadLabelsFirst ?
+            loadLabelImages(folderTraining, useDepthFilling, pyramidLevel) :
+            loadImages(folderTraining, useCIELab, useDepthFilling, integralPadding, pyramidLevel, cacheFolder,
+                    mapImages, interleaveColor, compactRegionSize);
     if (images.empty()) {
         throw std::runtime_error(std::string("found no files in ") + folderTraining);
     }
@@ -136,13 +219,28 @@ int main(int argc, char **argv) {
     TrainingConfiguration configuration(randomSeed, samplesPerImage, featureCount, minSampleCount,
             maxDepth, boxRadius, regionSize, numThresholds, numThreads, maxImages, imageCacheSize, maxSamplesPerBatch,
             TrainingConfiguration::parseAccelerationModeString(modeString), useCIELab, useDepthFilling, deviceIds,
-            subsamplingType, ignoredColors);
+            subsamplingType, ignoredColors, sortTileSize, useFloatResponses, useFlipAugmentation,
+            scaleJitter, pyramidLevel, depthFeatureCost, colorFeatureCost, nanResponseCost);
+
+    RandomForestImage::ImageLoader imageLoader;
+    if (loadLabelsFirst) {
+        const DatasetManifest manifest = DatasetManifest::load(folderTraining);
+        imageLoader = [&, manifest](const std::vector<size_t>& imageNrs) {
+            loadColorImages(images, imageNrs, useCIELab, useDepthFilling, integralPadding, pyramidLevel, cacheFolder,
+                    mapImages, interleaveColor, compactRegionSize, manifest);
+        };
+    }
 
-    RandomForestImage forest = train(images, trees, configuration, trainTreesInParallel);
+    ConfusionMatrix outOfBagConfusionMatrix;
+    RandomForestImage forest = train(images, trees, configuration, trainTreesInParallel, warmStartTreeFiles,
+            outOfBag ? &outOfBagConfusionMatrix : 0, imageLoader);
 
     if (!outputFolder.empty()) {
         RandomTreeExport treeExport(configuration, outputFolder, folderTraining, verboseTree);
         treeExport.writeJSON(forest);
+        if (outOfBag) {
+            treeExport.writeOutOfBagJSON(outOfBagConfusionMatrix);
+        }
     } else {
         CURFIL_WARNING("no output folder given. skipping JSON export");
     }
@@ -0,0 +1,120 @@
+#include "tree_tool.h"
+
+#include <iostream>
+
+#include "export.h"
+#include "import.h"
+#include "utils.h"
+#include "version.h"
+
+namespace po = boost::program_options;
+
+namespace curfil {
+
+TreeTool::TreeTool(const std::string& folderOption, const std::string& folderDescription,
+        const std::string& outputDescription) :
+        options("options"), variables(), folderOption(folderOption), folder(), outputFolder(), treeFiles(),
+                numThreads(tbb::task_scheduler_init::default_num_threads()), profiling(false),
+                useDepthFillingOption(false), scheduler(), trees(), configurations(), trainingFolders() {
+
+    options.add_options()
+    ("help", "produce help message")
+    ("version", "show version and exit")
+    (folderOption.c_str(), po::value<std::string>(&folder)->required(), folderDescription.c_str())
+    ("outputFolder", po::value<std::string>(&outputFolder)->required(), outputDescription.c_str())
+    ("treeFile", po::value<std::vector<std::string> >(&treeFiles)->required(), "serialized tree(s) (JSON)")
+    ("numThreads", po::value<int>(&numThreads)->default_value(numThreads), "number of threads")
+    ("profile", po::value<bool>(&profiling)->implicit_value(true)->default_value(profiling), "profiling")
+    ("useDepthFilling",
+            po::value<bool>(&useDepthFillingOption)->implicit_value(true)->default_value(useDepthFillingOption),
+            "whether to do simple depth filling")
+            ;
+}
+
+bool TreeTool::parseCommandLine(int argc, char** argv) {
+
+    po::positional_options_description pod;
+    pod.add(folderOption.c_str(), 1);
+    pod.add("outputFolder", 1);
+    pod.add("treeFile", -1);
+
+    po::store(po::command_line_parser(argc, argv).positional(pod).options(options).run(), variables);
+
+    if (argc <= 1 || variables.count("help")) {
+        std::cout << options << std::endl;
+        return false;
+    }
+
+    if (argc <= 1 || variables.count("version")) {
+        std::cout << argv[0] << " version " << getVersion() << std::endl;
+        return false;
+    }
+
+    try {
+        po::notify(variables);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return false;
+    }
+
+    logVersionInfo();
+
+    utils::Profile::setEnabled(profiling);
+
+    scheduler.reset(new tbb::task_scheduler_init(numThreads));
+
+    return true;
+}
+
+void TreeTool::readTrees() {
+
+    trees.resize(treeFiles.size());
+    configurations.resize(treeFiles.size());
+    trainingFolders.resize(treeFiles.size());
+
+    for (size_t treeNr = 0; treeNr < treeFiles.size(); treeNr++) {
+        CURFIL_INFO("reading tree " << treeNr << " from " << treeFiles[treeNr]);
+
+        std::string hostname;
+        boost::posix_time::ptime date;
+        configurations[treeNr] = RandomTreeImport::readJSON(treeFiles[treeNr], trees[treeNr], hostname,
+                trainingFolders[treeNr], date);
+
+        CURFIL_INFO("trained " << date << " on " << hostname);
+        CURFIL_INFO(*trees[treeNr]);
+
+        bool strict = false;
+        if (!configurations[0].equals(configurations[treeNr], strict)) {
+            CURFIL_ERROR("configuration of tree 0: " << configurations[0]);
+            CURFIL_ERROR("configuration of tree " << treeNr << ": " << configurations[treeNr]);
+            throw std::runtime_error("different configurations");
+        }
+    }
+}
+
+bool TreeTool::isUseDepthFilling() const {
+    const bool useDepthFilling = getConfiguration().isUseDepthFilling();
+    if (!variables.count("useDepthFilling") || variables["useDepthFilling"].defaulted()) {
+        return useDepthFilling;
+    }
+    if (useDepthFillingOption != useDepthFilling) {
+        CURFIL_WARNING("overriding depth filling of the training configuration: " << useDepthFillingOption);
+    }
+    return useDepthFillingOption;
+}
+
+void TreeTool::writeTrees(const std::string& trainingFolder) const {
+
+    boost::filesystem::create_directories(outputFolder);
+
+    for (size_t treeNr = 0; treeNr < trees.size(); treeNr++) {
+        CURFIL_INFO(*trees[treeNr]);
+
+        const bool verbose = false;
+        RandomTreeExport treeExport(configurations[treeNr], outputFolder,
+                trainingFolder.empty() ? trainingFolders[treeNr].string() : trainingFolder, verbose);
+        treeExport.writeJSON(*trees[treeNr], treeNr);
+    }
+}
+
+}
@@ -0,0 +1,101 @@
+#ifndef CURFIL_TREE_TOOL_H
+#define CURFIL_TREE_TOOL_H
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <string>
+#include <tbb/task_scheduler_init.h>
+#include <vector>
+
+#include "random_tree_image.h"
+
+namespace curfil {
+
+/**
+ * Command line handling shared by the tools that modify the serialized trees of a forest (curfil_prune, curfil_refit).
+ *
+ * The positional arguments are the image folder, the output folder and the tree files.
+ */
+class TreeTool {
+
+public:
+
+    /**
+     * @param folderOption name of the option of the image folder the tool works on
+     * @param folderDescription help text of that option
+     * @param outputDescription help text of the output folder option
+     */
+    TreeTool(const std::string& folderOption, const std::string& folderDescription,
+            const std::string& outputDescription);
+
+    /**
+     * Adds tool specific options. Must be called before parseCommandLine().
+     */
+    boost::program_options::options_description_easy_init addOptions() {
+        return options.add_options();
+    }
+
+    /**
+     * Parses the command line, enables profiling and initializes the task scheduler with the number of threads.
+     *
+     * @return false if the tool must exit, e.g. after the help was printed or an option is missing
+     */
+    bool parseCommandLine(int argc, char** argv);
+
+    /**
+     * Reads the trees and checks that they were trained with the same configuration.
+     */
+    void readTrees();
+
+    /**
+     * Writes the trees to the output folder.
+     *
+     * @param trainingFolder the training folder that is stored with the trees. if empty, each tree keeps its own
+     */
+    void writeTrees(const std::string& trainingFolder = std::string()) const;
+
+    const std::string& getFolder() const {
+        return folder;
+    }
+
+    const std::vector<boost::shared_ptr<RandomTreeImage> >& getTrees() const {
+        return trees;
+    }
+
+    // the configuration of the first tree
+    const TrainingConfiguration& getConfiguration() const {
+        assert(!configurations.empty());
+        return configurations[0];
+    }
+
+    bool isUseCIELab() const {
+        return getConfiguration().isUseCIELab();
+    }
+
+    // the depth filling of the training configuration unless overridden on the command line
+    bool isUseDepthFilling() const;
+
+private:
+
+    boost::program_options::options_description options;
+    boost::program_options::variables_map variables;
+
+    const std::string folderOption;
+    std::string folder;
+    std::string outputFolder;
+    std::vector<std::string> treeFiles;
+    int numThreads;
+    bool profiling;
+    bool useDepthFillingOption;
+
+    boost::scoped_ptr<tbb::task_scheduler_init> scheduler;
+
+    std::vector<boost::shared_ptr<RandomTreeImage> > trees;
+    std::vector<TrainingConfiguration> configurations;
+    std::vector<boost::filesystem::path> trainingFolders;
+};
+
+}
+
+#endif
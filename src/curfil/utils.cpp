@@ -1,8 +1,13 @@
 #include "utils.h"
 
+#include <algorithm>
 #include <boost/algorithm/string.hpp>
 #include <boost/format.hpp>
+#include <cassert>
 #include <cuda_runtime_api.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_scheduler_init.h>
+#include <time.h>
 
 #include "version.h"
 
@@ -59,6 +64,14 @@ double Timer::getMilliseconds() {
     return duration.total_microseconds() / static_cast<double>(1e3);
 }
 
+double getThreadCPUSeconds() {
+    struct timespec time;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0) {
+        throw std::runtime_error("failed to get the CPU time of the thread");
+    }
+    return time.tv_sec + time.tv_nsec / static_cast<double>(1e9);
+}
+
 void logMessage(const std::string& msg, std::ostream& os) {
     boost::posix_time::ptime date_time = boost::posix_time::microsec_clock::local_time();
 
@@ -90,5 +103,78 @@ size_t getFreeMemoryOnGPU(int deviceId) {
     return freeMemory;
 }
 
+void radixSort(std::vector<uint64_t>& keys, std::vector<uint32_t>& values) {
+
+    assert(keys.size() == values.size());
+
+    const size_t numElements = keys.size();
+    if (numElements <= 1) {
+        return;
+    }
+
+    uint64_t maxKey = 0;
+    for (size_t i = 0; i < numElements; i++) {
+        maxKey = std::max(maxKey, keys[i]);
+    }
+
+    static const int BITS_PER_PASS = 8;
+    static const size_t NUM_BUCKETS = 1 << BITS_PER_PASS;
+    // small inputs are not worth to be split
+    static const size_t MIN_BLOCK_SIZE = 16384;
+
+    const size_t maxBlocks = 4 * tbb::task_scheduler_init::default_num_threads();
+    const size_t numBlocks = std::max<size_t>(1, std::min(maxBlocks, numElements / MIN_BLOCK_SIZE));
+    const size_t blockSize = (numElements + numBlocks - 1) / numBlocks;
+
+    std::vector<uint64_t> sortedKeys(numElements);
+    std::vector<uint32_t> sortedValues(numElements);
+
+    // offsets[block * NUM_BUCKETS + bucket]
+    std::vector<size_t> offsets(numBlocks * NUM_BUCKETS);
+
+    for (int shift = 0; shift < 64 && (maxKey >> shift) != 0; shift += BITS_PER_PASS) {
+
+        std::fill(offsets.begin(), offsets.end(), 0);
+
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, numBlocks, 1),
+                [&](const tbb::blocked_range<size_t>& range) {
+                    for (size_t block = range.begin(); block != range.end(); block++) {
+                        size_t* counts = &offsets[block * NUM_BUCKETS];
+                        const size_t end = std::min(numElements, (block + 1) * blockSize);
+                        for (size_t i = block * blockSize; i < end; i++) {
+                            counts[(keys[i] >> shift) & (NUM_BUCKETS - 1)]++;
+                        }
+                    }
+                });
+
+        // exclusive prefix sum in bucket-major order keeps the sort stable
+        size_t offset = 0;
+        for (size_t bucket = 0; bucket < NUM_BUCKETS; bucket++) {
+            for (size_t block = 0; block < numBlocks; block++) {
+                const size_t count = offsets[block * NUM_BUCKETS + bucket];
+                offsets[block * NUM_BUCKETS + bucket] = offset;
+                offset += count;
+            }
+        }
+        assert(offset == numElements);
+
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, numBlocks, 1),
+                [&](const tbb::blocked_range<size_t>& range) {
+                    for (size_t block = range.begin(); block != range.end(); block++) {
+                        size_t* blockOffsets = &offsets[block * NUM_BUCKETS];
+                        const size_t end = std::min(numElements, (block + 1) * blockSize);
+                        for (size_t i = block * blockSize; i < end; i++) {
+                            const size_t target = blockOffsets[(keys[i] >> shift) & (NUM_BUCKETS - 1)]++;
+                            sortedKeys[target] = keys[i];
+                            sortedValues[target] = values[i];
+                        }
+                    }
+                });
+
+        keys.swap(sortedKeys);
+        values.swap(sortedValues);
+    }
+}
+
 }
 }
@@ -4,7 +4,9 @@
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/format.hpp>
 #include <sstream>
+#include <stdint.h>
 #include <string>
+#include <vector>
 
 namespace curfil {
 
@@ -59,6 +61,12 @@ private:
 
 };
 
+/**
+ * @return the CPU time of the calling thread in seconds. unlike a Timer, it does not advance while the thread waits
+ * or is preempted
+ */
+double getThreadCPUSeconds();
+
 class Average {
 public:
     Average() :
@@ -142,6 +150,13 @@ private:
 
 size_t getFreeMemoryOnGPU(int deviceId);
 
+/**
+ * Stable parallel LSD radix sort of 64-bit keys with 8 bits per pass.
+ * The values are permuted along with the keys.
+ * Sorting stops after the pass over the most significant non-zero byte of the largest key.
+ */
+void radixSort(std::vector<uint64_t>& keys, std::vector<uint32_t>& values);
+
 }
 }
 
@@ -92,4 +92,45 @@ BOOST_AUTO_TEST_CASE(testImageCacheSimple) {
 
     CURFIL_INFO("done");
 }
+
+BOOST_AUTO_TEST_CASE(testImageCacheMixedSizes) {
+
+    const int imageCacheSize = 3;
+
+    RGBDImage largeImage(41, 33);
+    RGBDImage smallImage(20, 16);
+    RGBDImage largerImage(64, 48);
+
+    ImageCache imageCache;
+
+    std::map<const void*, size_t>& map = imageCache.getIdMap();
+
+    std::vector<PixelInstance> samples;
+    samples.push_back(PixelInstance(&largeImage, 0, Depth(1.0), 0, 0));
+    imageCache.copyImages(imageCacheSize, getPointers(samples));
+    BOOST_CHECK_EQUAL(41, imageCache.getWidth());
+    BOOST_CHECK_EQUAL(33, imageCache.getHeight());
+
+    // smaller images share the cache with the larger ones
+    samples.clear();
+    samples.push_back(PixelInstance(&smallImage, 0, Depth(1.0), 0, 0));
+    imageCache.copyImages(imageCacheSize, getPointers(samples));
+    BOOST_CHECK_EQUAL(2lu, map.size());
+    BOOST_CHECK(map.find(&largeImage) != map.end());
+    BOOST_CHECK(map.find(&smallImage) != map.end());
+    BOOST_CHECK_EQUAL(41, imageCache.getWidth());
+    BOOST_CHECK_EQUAL(33, imageCache.getHeight());
+
+    // the cache grows with a larger image
+    samples.clear();
+    samples.push_back(PixelInstance(&largerImage, 0, Depth(1.0), 0, 0));
+    samples.push_back(PixelInstance(&smallImage, 0, Depth(1.0), 0, 0));
+    imageCache.copyImages(imageCacheSize, getPointers(samples));
+    BOOST_CHECK_EQUAL(2lu, map.size());
+    BOOST_CHECK(map.find(&largeImage) == map.end());
+    BOOST_CHECK(map.find(&largerImage) != map.end());
+    BOOST_CHECK_EQUAL(64, imageCache.getWidth());
+    BOOST_CHECK_EQUAL(48, imageCache.getHeight());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
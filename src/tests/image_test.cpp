@@ -2,7 +2,12 @@
 
 #include <assert.h>
 #include <boost/filesystem.hpp>
+#include <boost/format.hpp>
 #include <boost/test/included/unit_test.hpp>
+#include <fstream>
+#include <tbb/parallel_for.h>
+#include <vigra/colorconversions.hxx>
+#include <vigra/impex.hxx>
 
 #include "image.h"
 #include "random_tree_image.h"
@@ -191,6 +196,387 @@ BOOST_AUTO_TEST_CASE(testColorIntegralLargeRandomImage) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(testPaddedIntegral) {
+
+    const int SEED = 4711;
+    Sampler colorSampler(SEED, 0, 255);
+    Sampler depthSampler(SEED, 0, 5000);
+
+    RGBDImage image(64, 48);
+    for (int y = 0; y < image.getHeight(); y++) {
+        for (int x = 0; x < image.getWidth(); x++) {
+            for (int c = 0; c < 3; c++) {
+                image.setColor(x, y, c, colorSampler.getNext());
+            }
+            // about 20% invalid depth
+            const int depth = depthSampler.getNext();
+            image.setDepth(x, y, (depth < 1000) ? Depth::INVALID : Depth(depth / 1000.0));
+        }
+    }
+    image.calculateIntegral();
+
+    const int boxRadius = 20;
+    const int regionSize = 8;
+
+    RGBDImage paddedImage(image);
+    paddedImage.padIntegralImages(boxRadius + regionSize);
+    BOOST_CHECK_EQUAL(boxRadius + regionSize, paddedImage.getPadding());
+
+    for (int y = 0; y < image.getHeight(); y += 3) {
+        for (int x = 0; x < image.getWidth(); x += 3) {
+            BOOST_REQUIRE_EQUAL(image.getDepthValid(x, y), paddedImage.getDepthValid(x, y));
+
+            const PixelInstance instance(&image, 0, x, y);
+            const PixelInstance paddedInstance(&paddedImage, 0, x, y);
+
+            // offsets of pixels closer than one meter reach beyond the padding
+            for (int offset = -2 * boxRadius; offset <= 2 * boxRadius; offset += 5) {
+                for (int region = 1; region <= regionSize; region += 3) {
+                    const Offset offsetXY(offset, -offset / 2);
+                    const Region regionXY(region, regionSize - region + 1);
+
+                    const double depth = instance.averageRegionDepth(offsetXY, regionXY);
+                    const double paddedDepth = paddedInstance.averageRegionDepth(offsetXY, regionXY);
+                    BOOST_REQUIRE_EQUAL(isnan(depth), isnan(paddedDepth));
+                    if (!isnan(depth)) {
+                        BOOST_REQUIRE_EQUAL(depth, paddedDepth);
+                    }
+
+                    const double color = instance.averageRegionColor(offsetXY, regionXY, 1);
+                    const double paddedColor = paddedInstance.averageRegionColor(offsetXY, regionXY, 1);
+                    BOOST_REQUIRE_EQUAL(isnan(color), isnan(paddedColor));
+                    if (!isnan(color)) {
+                        BOOST_REQUIRE_EQUAL(color, paddedColor);
+                    }
+                }
+            }
+        }
+    }
+
+    BOOST_CHECK_THROW(paddedImage.padIntegralImages(1), std::runtime_error);
+    BOOST_CHECK_THROW(paddedImage.calculateDerivative(), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(testInterleavedColor) {
+
+    const int SEED = 4711;
+    Sampler colorSampler(SEED, 0, 255);
+    Sampler depthSampler(SEED, 1000, 5000);
+
+    RGBDImage image(640, 480);
+    for (int y = 0; y < image.getHeight(); y++) {
+        for (int x = 0; x < image.getWidth(); x++) {
+            for (int c = 0; c < 3; c++) {
+                image.setColor(x, y, c, colorSampler.getNext());
+            }
+            image.setDepth(x, y, Depth(depthSampler.getNext() / 1000.0));
+        }
+    }
+    image.calculateIntegral();
+
+    const int boxRadius = 20;
+    const int regionSize = 8;
+    image.padIntegralImages(boxRadius + regionSize);
+
+    RGBDImage interleavedImage(image);
+    interleavedImage.interleaveColorImage();
+    BOOST_CHECK(interleavedImage.isColorInterleaved());
+    BOOST_CHECK_EQUAL(image.getPadding(), interleavedImage.getPadding());
+
+    for (int y = -image.getPadding(); y < image.getHeight() + image.getPadding(); y += 7) {
+        for (int x = -image.getPadding(); x < image.getWidth() + image.getPadding(); x += 7) {
+            for (int c = 0; c < 3; c++) {
+                const float color = image.getColor(x, y, c);
+                const float interleavedColor = interleavedImage.getColor(x, y, c);
+                BOOST_REQUIRE_EQUAL(isnan(color), isnan(interleavedColor));
+                if (!isnan(color)) {
+                    BOOST_REQUIRE_EQUAL(color, interleavedColor);
+                }
+            }
+        }
+    }
+
+    // compares the color feature evaluation of both layouts
+    std::vector<Offset> offsets;
+    std::vector<Region> regions;
+    for (int offset = -2 * boxRadius; offset <= 2 * boxRadius; offset += 5) {
+        for (int region = 1; region <= regionSize; region += 3) {
+            offsets.push_back(Offset(offset, -offset / 2));
+            regions.push_back(Region(region, regionSize - region + 1));
+        }
+    }
+
+    double sums[2] = { 0, 0 };
+    double milliseconds[2] = { 0, 0 };
+    const RGBDImage* images[2] = { &image, &interleavedImage };
+    for (int layout = 0; layout < 2; layout++) {
+        utils::Timer timer;
+        for (int y = 0; y < image.getHeight(); y += 2) {
+            for (int x = 0; x < image.getWidth(); x += 2) {
+                const PixelInstance instance(images[layout], 0, x, y);
+                for (size_t i = 0; i < offsets.size(); i++) {
+                    // a color feature of two different channels
+                    const double response = instance.averageRegionColor(offsets[i], regions[i], 0)
+                            - instance.averageRegionColor(offsets[offsets.size() - 1 - i], regions[i], 2);
+                    if (!isnan(response)) {
+                        sums[layout] += response;
+                    }
+                }
+            }
+        }
+        milliseconds[layout] = timer.getMilliseconds();
+    }
+    BOOST_CHECK_EQUAL(sums[0], sums[1]);
+
+    CURFIL_INFO("color feature evaluation: planar " << milliseconds[0] << " ms, interleaved "
+            << milliseconds[1] << " ms");
+
+    BOOST_CHECK_THROW(interleavedImage.interleaveColorImage(), std::runtime_error);
+    BOOST_CHECK_THROW(interleavedImage.padIntegralImages(1), std::runtime_error);
+    BOOST_CHECK_THROW(interleavedImage.calculateDerivative(), std::runtime_error);
+}
+
+// the compact integral images must give the same responses for integer colors
+static void checkCompactResponses(const RGBDImage& image, const RGBDImage& compactImage, int boxRadius,
+        int regionSize, int step) {
+    for (int y = 0; y < image.getHeight(); y += step) {
+        for (int x = 0; x < image.getWidth(); x += step) {
+            const PixelInstance instance(&image, 0, x, y);
+            const PixelInstance compactInstance(&compactImage, 0, x, y);
+            BOOST_REQUIRE_EQUAL(instance.getDepth().getIntValue(), compactInstance.getDepth().getIntValue());
+
+            for (int offset = -2 * boxRadius; offset <= 2 * boxRadius; offset += 5) {
+                for (int region = 1; region <= regionSize; region += 3) {
+                    const Offset offsetXY(offset, -offset / 2);
+                    const Region regionXY(region, regionSize - region + 1);
+
+                    const double depth = instance.averageRegionDepth(offsetXY, regionXY);
+                    const double compactDepth = compactInstance.averageRegionDepth(offsetXY, regionXY);
+                    BOOST_REQUIRE_EQUAL(isnan(depth), isnan(compactDepth));
+                    if (!isnan(depth)) {
+                        BOOST_REQUIRE_EQUAL(depth, compactDepth);
+                    }
+
+                    for (int c = 0; c < 3; c++) {
+                        const double color = instance.averageRegionColor(offsetXY, regionXY, c);
+                        const double compactColor = compactInstance.averageRegionColor(offsetXY, regionXY, c);
+                        BOOST_REQUIRE_EQUAL(isnan(color), isnan(compactColor));
+                        if (!isnan(color)) {
+                            BOOST_REQUIRE_EQUAL(color, compactColor);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(testCompactIntegral) {
+
+    const int SEED = 4711;
+    Sampler colorSampler(SEED, 0, 255);
+    Sampler depthSampler(SEED, 0, 5000);
+
+    RGBDImage image(64, 48);
+    for (int y = 0; y < image.getHeight(); y++) {
+        for (int x = 0; x < image.getWidth(); x++) {
+            // negative colors as in CIELab
+            image.setColor(x, y, 0, colorSampler.getNext());
+            image.setColor(x, y, 1, colorSampler.getNext() - 128.0f);
+            image.setColor(x, y, 2, colorSampler.getNext());
+            // about 20% invalid depth
+            const int depth = depthSampler.getNext();
+            image.setDepth(x, y, (depth < 1000) ? Depth::INVALID : Depth(depth / 1000.0));
+        }
+    }
+
+    const int boxRadius = 20;
+    const int regionSize = 8;
+
+    RGBDImage compactImage(image);
+    compactImage.calculateCompactIntegral(regionSize);
+    image.calculateIntegral();
+
+    BOOST_CHECK(compactImage.isCompact());
+    BOOST_CHECK_EQUAL(COMPACT_INTEGRALS, compactImage.getIntegralStorage());
+    // 3 * 4 bytes of color, 4 bytes of depth and 2 bytes of valid counts
+    BOOST_CHECK_EQUAL(18lu * image.getWidth() * image.getHeight(), compactImage.getSizeInMemory());
+    BOOST_CHECK_LT(compactImage.getSizeInMemory(), image.getSizeInMemory());
+
+    checkCompactResponses(image, compactImage, boxRadius, regionSize, 3);
+
+    RGBDImage paddedImage(image);
+    paddedImage.padIntegralImages(boxRadius + regionSize);
+    RGBDImage paddedCompactImage(compactImage);
+    paddedCompactImage.padIntegralImages(boxRadius + regionSize);
+    BOOST_CHECK_EQUAL(boxRadius + regionSize, paddedCompactImage.getPadding());
+
+    checkCompactResponses(paddedImage, paddedCompactImage, boxRadius, regionSize, 3);
+
+    BOOST_CHECK_THROW(compactImage.calculateCompactIntegral(regionSize), std::runtime_error);
+    BOOST_CHECK_THROW(compactImage.calculateIntegral(), std::runtime_error);
+    BOOST_CHECK_THROW(compactImage.calculateDerivative(), std::runtime_error);
+    BOOST_CHECK_THROW(compactImage.interleaveColorImage(), std::runtime_error);
+    BOOST_CHECK_THROW(paddedCompactImage.padIntegralImages(1), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(testWideCompactIntegral) {
+
+    const int SEED = 4711;
+    // the float integral images of this image are exact for colors below 64
+    Sampler colorSampler(SEED, 0, 63);
+    Sampler depthSampler(SEED, 0, 5000);
+
+    RGBDImage image(400, 300);
+    for (int y = 0; y < image.getHeight(); y++) {
+        for (int x = 0; x < image.getWidth(); x++) {
+            for (int c = 0; c < 3; c++) {
+                image.setColor(x, y, c, colorSampler.getNext());
+            }
+            const int depth = depthSampler.getNext();
+            image.setDepth(x, y, (depth < 1000) ? Depth::INVALID : Depth(depth / 1000.0));
+        }
+    }
+
+    // regions of close pixels can cover more than 2^16 pixels of this image
+    const int regionSize = 200;
+
+    RGBDImage compactImage(image);
+    compactImage.calculateCompactIntegral(regionSize);
+    image.calculateIntegral();
+
+    BOOST_CHECK_EQUAL(WIDE_INTEGRALS, compactImage.getIntegralStorage());
+
+    checkCompactResponses(image, compactImage, 20, regionSize, 17);
+}
+
+BOOST_AUTO_TEST_CASE(testAugmentationTransform) {
+
+    const int SEED = 4711;
+    Sampler colorSampler(SEED, 0, 255);
+    Sampler depthSampler(SEED, 0, 5000);
+
+    RGBDImage image(64, 48);
+    for (int y = 0; y < image.getHeight(); y++) {
+        for (int x = 0; x < image.getWidth(); x++) {
+            for (int c = 0; c < 3; c++) {
+                image.setColor(x, y, c, colorSampler.getNext());
+            }
+            const int depth = depthSampler.getNext();
+            image.setDepth(x, y, (depth < 1000) ? Depth::INVALID : Depth(depth / 1000.0));
+        }
+    }
+    image.calculateIntegral();
+
+    for (int y = 0; y < image.getHeight(); y += 3) {
+        for (int x = 0; x < image.getWidth(); x += 3) {
+            const PixelInstance instance(&image, 0, x, y);
+            if (!instance.getDepth().isValid()) {
+                continue;
+            }
+
+            PixelInstance flipped(instance);
+            flipped.setTransform(true, 1.0f);
+
+            PixelInstance scaled(instance);
+            scaled.setTransform(false, 2.0f);
+
+            for (int offset = -10; offset <= 10; offset += 5) {
+                for (int type = DEPTH; type <= COLOR; type++) {
+                    const Offset offset1(offset, 3), offset2(-3, offset + 1);
+                    const Region region1(2, 3), region2(4, 1);
+
+                    const ImageFeatureFunction feature(static_cast<FeatureType>(type), offset1, region1, 0,
+                            offset2, region2, 1);
+
+                    // a flipped sample reads the image at the mirrored x offsets
+                    const ImageFeatureFunction mirroredFeature(static_cast<FeatureType>(type),
+                            Offset(-offset1.getX(), offset1.getY()), region1, 0,
+                            Offset(-offset2.getX(), offset2.getY()), region2, 1);
+
+                    const double flippedResponse = feature.calculateFeatureResponse(flipped);
+                    const double mirroredResponse = mirroredFeature.calculateFeatureResponse(instance);
+                    BOOST_REQUIRE_EQUAL(isnan(flippedResponse), isnan(mirroredResponse));
+                    if (!isnan(flippedResponse)) {
+                        BOOST_REQUIRE_EQUAL(flippedResponse, mirroredResponse);
+                    }
+
+                    // a scaled sample reads the image at scaled offsets and regions
+                    const ImageFeatureFunction scaledFeature(static_cast<FeatureType>(type),
+                            Offset(2 * offset1.getX(), 2 * offset1.getY()),
+                            Region(2 * region1.getX(), 2 * region1.getY()), 0,
+                            Offset(2 * offset2.getX(), 2 * offset2.getY()),
+                            Region(2 * region2.getX(), 2 * region2.getY()), 1);
+
+                    const double scaledResponse = feature.calculateFeatureResponse(scaled);
+                    const double expectedResponse = scaledFeature.calculateFeatureResponse(instance);
+                    BOOST_REQUIRE_EQUAL(isnan(scaledResponse), isnan(expectedResponse));
+                    if (!isnan(scaledResponse)) {
+                        BOOST_REQUIRE_EQUAL(scaledResponse, expectedResponse);
+                    }
+                }
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(testDownsample) {
+
+    RGBDImage image(5, 4);
+    LabelImage labelImage(5, 4);
+    for (int y = 0; y < image.getHeight(); y++) {
+        for (int x = 0; x < image.getWidth(); x++) {
+            for (int c = 0; c < 3; c++) {
+                image.setColor(x, y, c, 10 * x + y + c);
+            }
+            labelImage.setLabel(x, y, (x + y) % 3 == 0 ? 1 : 2);
+        }
+    }
+
+    // block (0,0) has valid depth of 1 and 3 meters. block (1,0) has no valid depth
+    image.setDepth(0, 0, Depth(1.0));
+    image.setDepth(1, 1, Depth(3.0));
+
+    image.downsample(1);
+    labelImage.downsample(1);
+
+    BOOST_CHECK_EQUAL(2, image.getWidth());
+    BOOST_CHECK_EQUAL(2, image.getHeight());
+    BOOST_CHECK_EQUAL(2, labelImage.getWidth());
+    BOOST_CHECK_EQUAL(2, labelImage.getHeight());
+
+    for (int y = 0; y < image.getHeight(); y++) {
+        for (int x = 0; x < image.getWidth(); x++) {
+            for (int c = 0; c < 3; c++) {
+                const float expected = 10 * (2 * x + 0.5) + (2 * y + 0.5) + c;
+                BOOST_CHECK_CLOSE(expected, image.getColor(x, y, c), 1e-4);
+            }
+        }
+    }
+
+    BOOST_CHECK_EQUAL(1, image.getDepthValid(0, 0));
+    BOOST_CHECK_EQUAL(2000, image.getDepth(0, 0).getIntValue());
+    BOOST_CHECK_EQUAL(0, image.getDepthValid(1, 0));
+
+    // labels of block (0,0): 1 2 / 2 2
+    BOOST_CHECK_EQUAL(2, static_cast<int>(labelImage.getLabel(0, 0)));
+    // labels of block (1,0): 2 1 / 1 2. label 1 is the first to reach the highest count
+    BOOST_CHECK_EQUAL(1, static_cast<int>(labelImage.getLabel(1, 0)));
+
+    const LabelImage upsampled = labelImage.upsample(1, 5, 4);
+    BOOST_CHECK_EQUAL(5, upsampled.getWidth());
+    BOOST_CHECK_EQUAL(4, upsampled.getHeight());
+    for (int y = 0; y < upsampled.getHeight(); y++) {
+        for (int x = 0; x < upsampled.getWidth(); x++) {
+            const int expected = labelImage.getLabel(std::min(x / 2, 1), y / 2);
+            BOOST_CHECK_EQUAL(expected, static_cast<int>(upsampled.getLabel(x, y)));
+        }
+    }
+
+    image.calculateIntegral();
+    BOOST_CHECK_THROW(image.downsample(1), std::runtime_error);
+}
+
 BOOST_AUTO_TEST_CASE(testDepthIntegral) {
 
     std::cout << std::endl;
@@ -251,6 +637,132 @@ BOOST_AUTO_TEST_CASE(testDepthIntegral) {
     BOOST_CHECK_EQUAL(image.getDepthValid(2, 1), 4);
 }
 
+BOOST_AUTO_TEST_CASE(testIntegralLargeOddImage) {
+    // the size is not a multiple of the column blocks. the depth integral exceeds the range of int
+    RGBDImage image(1031, 777);
+
+    Sampler sampler(4711, 0, 255);
+    for (int y = 0; y < image.getHeight(); y++) {
+        for (int x = 0; x < image.getWidth(); x++) {
+            image.setDepth(x, y, Depth(10.0));
+            for (unsigned int c = 0; c < 3; c++) {
+                image.setColor(x, y, c, sampler.getNext() - 128.0f);
+            }
+        }
+    }
+
+    RGBDImage integratedImage(image);
+    integratedImage.calculateIntegral();
+
+    const int x0 = 500;
+    const int y0 = 400;
+    const int x1 = image.getWidth() - 1;
+    const int y1 = image.getHeight() - 1;
+
+    const unsigned int depthSum = static_cast<unsigned int>(integratedImage.getDepth(x1, y1).getIntValue())
+            - static_cast<unsigned int>(integratedImage.getDepth(x0, y1).getIntValue())
+            - static_cast<unsigned int>(integratedImage.getDepth(x1, y0).getIntValue())
+            + static_cast<unsigned int>(integratedImage.getDepth(x0, y0).getIntValue());
+    BOOST_CHECK_EQUAL(static_cast<int>(depthSum), (x1 - x0) * (y1 - y0) * 10000);
+
+    const int validSum = integratedImage.getDepthValid(x1, y1) - integratedImage.getDepthValid(x0, y1)
+            - integratedImage.getDepthValid(x1, y0) + integratedImage.getDepthValid(x0, y0);
+    BOOST_CHECK_EQUAL(validSum, (x1 - x0) * (y1 - y0));
+
+    for (unsigned int c = 0; c < 3; c++) {
+        double expectedSum = 0.0;
+        for (int y = y0 + 1; y <= y1; y++) {
+            for (int x = x0 + 1; x <= x1; x++) {
+                expectedSum += image.getColor(x, y, c);
+            }
+        }
+        const double regionSum = static_cast<double>(integratedImage.getColor(x1, y1, c))
+                - integratedImage.getColor(x0, y1, c) - integratedImage.getColor(x1, y0, c)
+                + integratedImage.getColor(x0, y0, c);
+        BOOST_CHECK_SMALL(regionSum - expectedSum, 1.0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(testDepthIntegralLargeImage) {
+    // the depth integral wraps around in the lower right part of the image
+    RGBDImage image(2000, 1000);
+    for (int y = 0; y < image.getHeight(); y++) {
+        for (int x = 0; x < image.getWidth(); x++) {
+            image.setDepth(x, y, Depth((x + y) % 7 == 0 ? 0.5 : 60.0));
+        }
+    }
+    image.calculateIntegral();
+
+    RGBDImage paddedImage(image);
+    paddedImage.padIntegralImages(50);
+
+    const XY offset(10, -20);
+    const XY region(15, 10);
+    for (int y = image.getHeight() - 100; y < image.getHeight(); y += 7) {
+        for (int x = image.getWidth() - 100; x < image.getWidth(); x += 7) {
+            const Depth expectedDepth((x + y) % 7 == 0 ? 0.5 : 60.0);
+
+            const PixelInstance instance(&image, 0, x, y);
+            const PixelInstance paddedInstance(&paddedImage, 0, x, y);
+            BOOST_REQUIRE_EQUAL(instance.getDepth().getIntValue(), expectedDepth.getIntValue());
+            BOOST_REQUIRE_EQUAL(paddedInstance.getDepth().getIntValue(), expectedDepth.getIntValue());
+
+            const PixelInstance fixedDepthInstance(&image, 0, Depth(1.0), x, y);
+            const double depth = fixedDepthInstance.averageRegionDepth(offset, region);
+            if (x + offset.getX() + region.getX() >= image.getWidth()) {
+                BOOST_CHECK(isnan(depth));
+                continue;
+            }
+
+            double expectedSum = 0.0;
+            for (int dy = -region.getY() + 1; dy <= region.getY(); dy++) {
+                for (int dx = -region.getX() + 1; dx <= region.getX(); dx++) {
+                    const int px = x + offset.getX() + dx;
+                    const int py = y + offset.getY() + dy;
+                    expectedSum += ((px + py) % 7 == 0) ? 0.5 : 60.0;
+                }
+            }
+            BOOST_CHECK_CLOSE(depth, expectedSum / (4 * region.getX() * region.getY()), 1e-4);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(testConvertRGB2CIELab) {
+    // all combinations of the color values 0, 5, ..., 255
+    const int STEPS = 52;
+    const int width = STEPS * STEPS;
+    const int height = STEPS;
+
+    vigra::UInt8RGBImage rgbImage(width, height);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            rgbImage(x, y) = vigra::RGBValue<vigra::UInt8>(5 * y, 5 * (x / STEPS), 5 * (x % STEPS));
+        }
+    }
+
+    std::vector<float> lab(3 * width * height);
+    convertRGB2CIELab(reinterpret_cast<const uint8_t*>(rgbImage.data()), width, height, lab.data());
+
+    BOOST_REQUIRE(!fs::exists(temporaryColorFile));
+    vigra::exportImage(srcImageRange(rgbImage), vigra::ImageExportInfo(temporaryColorFile.c_str()));
+    vigra::UInt16Image depthImage(width, height, vigra::UInt16(1000));
+    vigra::exportImage(srcImageRange(depthImage), vigra::ImageExportInfo(temporaryDepthFile.c_str()));
+
+    RGBDImage readImage(temporaryColorFile.native(), temporaryDepthFile.native(), true, false, false);
+
+    const vigra::RGB2LabFunctor<double> rgb2lab;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const vigra::RGB2LabFunctor<double>::result_type expected = rgb2lab(
+                    vigra::RGBValue<double>(rgbImage(x, y).red(), rgbImage(x, y).green(), rgbImage(x, y).blue()));
+            for (unsigned int c = 0; c < 3; c++) {
+                BOOST_REQUIRE_SMALL(lab[(c * height + y) * width + x] - expected[c], 1e-3);
+                BOOST_REQUIRE_SMALL(readImage.getColor(x, y, c) - expected[c], 1e-3);
+            }
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(testWriteReadRGBDImage) {
     RGBDImage image(200, 100);
 
@@ -383,6 +895,47 @@ BOOST_AUTO_TEST_CASE(testWriteReadLabelImage) {
         }
     }
 
+    // the label colors must not leak into the following test cases
+    clearColorIds();
+}
+
+BOOST_AUTO_TEST_CASE(testParallelReadLabelImage) {
+    LabelImage image(64, 48);
+
+    for (int y = 0; y < image.getHeight(); y++) {
+        for (int x = 0; x < image.getWidth(); x++) {
+            const int i = (x / 8 + y / 8) % 16;
+            const LabelType label = getOrAddColorId(RGBColor(3 * i, 7, 200 - i), 100 + i);
+            BOOST_REQUIRE_EQUAL(static_cast<int>(label), 100 + i);
+            image.setLabel(x, y, label);
+        }
+    }
+
+    BOOST_CHECK_THROW(addColorId(RGBColor(3, 7, 199), 100), std::runtime_error);
+    BOOST_CHECK_EQUAL(LabelImage::decodeLabel(101), RGBColor(3, 7, 199));
+
+    image.save(temporaryColorFile.native());
+
+    // label images are decoded concurrently without locks
+    std::vector<int> differences(16, 0);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, differences.size(), 1),
+            [&](const tbb::blocked_range<size_t>& range) {
+                for (size_t i = range.begin(); i != range.end(); i++) {
+                    const LabelImage readImage(temporaryColorFile.native());
+                    for (int y = 0; y < image.getHeight(); y++) {
+                        for (int x = 0; x < image.getWidth(); x++) {
+                            differences[i] += (readImage.getLabel(x, y) != image.getLabel(x, y));
+                        }
+                    }
+                }
+            });
+
+    for (const int difference : differences) {
+        BOOST_CHECK_EQUAL(difference, 0);
+    }
+
+    // the label colors must not leak into the following test cases
+    clearColorIds();
 }
 
 BOOST_AUTO_TEST_CASE(testLabeledRGBDImage) {
@@ -427,4 +980,217 @@ BOOST_AUTO_TEST_CASE(testDepthFilling) {
     }
 
 }
+BOOST_AUTO_TEST_CASE(testImageCache) {
+    const fs::path folder = fs::temp_directory_path() / fs::unique_path("%%%%-%%%%-%%%%-%%%%");
+    const fs::path cacheFolder = folder / "cache";
+    fs::create_directories(folder);
+
+    const std::string colorFilename = (folder / "image_colors.png").native();
+    const std::string depthFilename = (folder / "image_depth.png").native();
+    const std::string labelFilename = (folder / "image_ground_truth.png").native();
+
+    RGBDImage image(40, 30);
+    LabelImage labelImage(40, 30);
+    const LabelType backgroundLabel = getOrAddColorId(RGBColor(0, 0, 0), 0);
+    const LabelType foregroundLabel = getOrAddColorId(RGBColor(201, 13, 77), 201);
+
+    Sampler sampler(4711, 0, 255);
+    for (int y = 0; y < image.getHeight(); y++) {
+        for (int x = 0; x < image.getWidth(); x++) {
+            image.setDepth(x, y, Depth(1.0f + (x + y) / 100.0f));
+            for (unsigned int c = 0; c < 3; c++) {
+                image.setColor(x, y, c, sampler.getNext() / 255.0f);
+            }
+            labelImage.setLabel(x, y, (x < 20) ? backgroundLabel : foregroundLabel);
+        }
+    }
+    image.saveColor(colorFilename);
+    image.saveDepth(depthFilename);
+    labelImage.save(labelFilename);
+
+    const std::string cacheFilename = getImageCacheFilename(cacheFolder.native(), colorFilename);
+
+    const LabeledRGBDImage uncached = loadImagePair(colorFilename, true, false);
+    BOOST_REQUIRE(!fs::exists(cacheFilename));
+
+    const auto checkEqual = [&](const LabeledRGBDImage& a, const LabeledRGBDImage& b) {
+        const RGBDImage& imageA = a.getRGBDImage();
+        const RGBDImage& imageB = b.getRGBDImage();
+        BOOST_REQUIRE_EQUAL(imageA.getWidth(), imageB.getWidth());
+        BOOST_REQUIRE_EQUAL(imageA.getHeight(), imageB.getHeight());
+        BOOST_REQUIRE(imageB.hasIntegratedColor());
+        BOOST_REQUIRE(imageB.hasIntegratedDepth());
+        for (size_t i = 0; i < imageA.getColorImage().size(); i++) {
+            BOOST_REQUIRE_EQUAL(imageA.getColorImage().ptr()[i], imageB.getColorImage().ptr()[i]);
+        }
+        for (size_t i = 0; i < imageA.getDepthImage().size(); i++) {
+            BOOST_REQUIRE_EQUAL(imageA.getDepthImage().ptr()[i], imageB.getDepthImage().ptr()[i]);
+        }
+        for (int y = 0; y < imageA.getHeight(); y++) {
+            for (int x = 0; x < imageA.getWidth(); x++) {
+                BOOST_REQUIRE_EQUAL(a.getLabelImage().getLabel(x, y), b.getLabelImage().getLabel(x, y));
+            }
+        }
+    };
+
+    // writes the cache file
+    checkEqual(uncached, loadImagePair(colorFilename, true, false, true, 0, 0, cacheFolder.native()));
+    BOOST_REQUIRE(fs::exists(cacheFilename));
+
+    // reads the cache file. a rewrite would update the modification time
+    const std::time_t cacheTime = fs::last_write_time(cacheFilename) - 100;
+    fs::last_write_time(cacheFilename, cacheTime);
+    checkEqual(uncached, loadImagePair(colorFilename, true, false, true, 0, 0, cacheFolder.native()));
+    BOOST_CHECK_EQUAL(fs::last_write_time(cacheFilename), cacheTime);
+
+    // padding is applied after loading the cache
+    const LabeledRGBDImage padded = loadImagePair(colorFilename, true, false, true, 5, 0, cacheFolder.native());
+    BOOST_CHECK_EQUAL(padded.getRGBDImage().getPadding(), 5);
+    BOOST_CHECK_EQUAL(fs::last_write_time(cacheFilename), cacheTime);
+
+    // mapped images are views of the cache file
+    const LabeledRGBDImage mapped = loadImagePair(colorFilename, true, false, true, 0, 0, cacheFolder.native(), true);
+    BOOST_CHECK(mapped.getRGBDImage().isMapped());
+    BOOST_CHECK(!uncached.getRGBDImage().isMapped());
+    checkEqual(uncached, mapped);
+    BOOST_CHECK_THROW(loadImagePair(colorFilename, true, false, true, 5, 0, cacheFolder.native(), true),
+            std::runtime_error);
+    BOOST_CHECK_THROW(loadImagePair(colorFilename, true, false, true, 0, 0, "", true), std::runtime_error);
+
+    // touched but unchanged sources keep the cache valid
+    fs::last_write_time(colorFilename, fs::last_write_time(colorFilename) + 100);
+    loadImagePair(colorFilename, true, false, true, 0, 0, cacheFolder.native());
+    BOOST_CHECK_EQUAL(fs::last_write_time(cacheFilename), cacheTime);
+
+    // other preprocessing parameters or a changed source invalidate the cache
+    checkEqual(loadImagePair(colorFilename, false, false),
+            loadImagePair(colorFilename, false, false, true, 0, 0, cacheFolder.native()));
+    BOOST_CHECK_NE(fs::last_write_time(cacheFilename), cacheTime);
+
+    for (int y = 0; y < image.getHeight(); y++) {
+        for (int x = 0; x < image.getWidth(); x++) {
+            image.setDepth(x, y, Depth(2.0f));
+        }
+    }
+    image.saveDepth(depthFilename);
+    // the modification time has a resolution of one second
+    fs::last_write_time(depthFilename, fs::last_write_time(depthFilename) + 100);
+    checkEqual(loadImagePair(colorFilename, false, false),
+            loadImagePair(colorFilename, false, false, true, 0, 0, cacheFolder.native()));
+
+    fs::remove_all(folder);
+}
+BOOST_AUTO_TEST_CASE(testImageCodecs) {
+    const fs::path folder = fs::temp_directory_path() / fs::unique_path("%%%%-%%%%-%%%%-%%%%");
+    const fs::path pngFolder = folder / "png";
+    const fs::path fastFolder = folder / "fast";
+    fs::create_directories(pngFolder);
+    fs::create_directories(fastFolder);
+
+    const int width = 40;
+    const int height = 30;
+
+    vigra::UInt8RGBImage colorImage(width, height);
+    vigra::UInt16Image depthImage(width, height);
+    vigra::UInt8RGBImage labelImage(width, height);
+    Sampler sampler(4711, 0, 255);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            colorImage(x, y) = vigra::RGBValue<vigra::UInt8>(sampler.getNext(), sampler.getNext(), sampler.getNext());
+            depthImage(x, y) = ((x + y) % 11 == 0) ? 0 : 1000 + 37 * x + 11 * y;
+            labelImage(x, y) = (x < 20) ? vigra::RGBValue<vigra::UInt8>(0, 0, 0) : vigra::RGBValue<vigra::UInt8>(201, 13, 77);
+        }
+    }
+
+    vigra::exportImage(srcImageRange(colorImage), vigra::ImageExportInfo((pngFolder / "image_colors.png").c_str()));
+    vigra::exportImage(srcImageRange(depthImage),
+            vigra::ImageExportInfo((pngFolder / "image_depth.png").c_str()).setPixelType("UINT16"));
+    vigra::exportImage(srcImageRange(labelImage),
+            vigra::ImageExportInfo((pngFolder / "image_ground_truth.png").c_str()).setPixelType("UINT8"));
+
+    // color as binary PPM, depth as little-endian raw uint16, labels as NumPy array and depth as 16-bit PGM
+    {
+        std::ofstream ppm((fastFolder / "image_c.ppm").c_str(), std::ios::binary);
+        ppm << "P6\n# comment\n" << width << " " << height << "\n255\n";
+        std::ofstream raw((fastFolder / "image_d.raw").c_str(), std::ios::binary);
+        std::ofstream pgm((folder / "depth.pgm").c_str(), std::ios::binary);
+        pgm << "P5 " << width << " " << height << " 65535\n";
+
+        std::ofstream npy((fastFolder / "image_l.npy").c_str(), std::ios::binary);
+        std::string header = (boost::format("{'descr': '|u1', 'fortran_order': False, 'shape': (%d, %d, 3), }")
+                % height % width).str();
+        header.append(63 - (10 + header.length()) % 64, ' ');
+        header += '\n';
+        const uint16_t headerLength = header.length();
+        npy.write("\x93NUMPY\x01\x00", 8);
+        npy.put(headerLength & 0xFF);
+        npy.put(headerLength >> 8);
+        npy << header;
+
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                for (int c = 0; c < 3; c++) {
+                    ppm.put(colorImage(x, y)[c]);
+                    npy.put(labelImage(x, y)[c]);
+                }
+                const uint16_t depth = depthImage(x, y);
+                raw.put(depth & 0xFF);
+                raw.put(depth >> 8);
+                pgm.put(depth >> 8);
+                pgm.put(depth & 0xFF);
+            }
+        }
+    }
+
+    std::ofstream((fastFolder / DatasetManifest::FILENAME).c_str())
+            << "{ \"color\": { \"suffix\": \"_c.ppm\" },"
+            << " \"depth\": { \"suffix\": \"_d.raw\", \"width\": " << width << ", \"height\": " << height << " },"
+            << " \"label\": { \"suffix\": \"_l.npy\" } }";
+
+    const DatasetManifest manifest = DatasetManifest::load(fastFolder.native());
+    BOOST_CHECK_EQUAL("raw", manifest.getDepthFormat().getCodec((fastFolder / "image_d.raw").native()));
+    BOOST_CHECK_EQUAL((fastFolder / "image_l.npy").native(),
+            manifest.getLabelFilename((fastFolder / "image_c.ppm").native()));
+
+    const DecodedImage pngDepth = decodeImage((pngFolder / "image_depth.png").native());
+    const DecodedImage rawDepth = decodeImage((fastFolder / "image_d.raw").native(), manifest.getDepthFormat());
+    const DecodedImage pgmDepth = decodeImage((folder / "depth.pgm").native());
+    const DecodedImage ppmColor = decodeImage((fastFolder / "image_c.ppm").native());
+    BOOST_CHECK(!pngDepth.isMapped());
+    BOOST_CHECK(rawDepth.isMapped());
+    BOOST_CHECK(ppmColor.isMapped());
+    BOOST_REQUIRE_EQUAL(2, pgmDepth.getBytesPerSample());
+    for (size_t i = 0; i < pngDepth.getNumSamples(); i++) {
+        BOOST_REQUIRE_EQUAL(pngDepth.getSample(i), rawDepth.getSample(i));
+        BOOST_REQUIRE_EQUAL(pngDepth.getSample(i), pgmDepth.getSample(i));
+    }
+
+    BOOST_CHECK_THROW(decodeImage((fastFolder / "image_d.raw").native()), std::runtime_error);
+    BOOST_CHECK_THROW(decodeImage((fastFolder / "image_c.ppm").native(), ImageFileFormat("", "npy")),
+            std::runtime_error);
+
+    const std::vector<LabeledRGBDImage> pngImages = loadImages(pngFolder.native(), true, false);
+    const std::vector<LabeledRGBDImage> fastImages = loadImages(fastFolder.native(), true, false);
+    BOOST_REQUIRE_EQUAL(1u, pngImages.size());
+    BOOST_REQUIRE_EQUAL(1u, fastImages.size());
+
+    const RGBDImage& pngImage = pngImages[0].getRGBDImage();
+    const RGBDImage& fastImage = fastImages[0].getRGBDImage();
+    BOOST_REQUIRE_EQUAL(pngImage.getWidth(), fastImage.getWidth());
+    BOOST_REQUIRE_EQUAL(pngImage.getHeight(), fastImage.getHeight());
+    for (size_t i = 0; i < pngImage.getColorImage().size(); i++) {
+        BOOST_REQUIRE_EQUAL(pngImage.getColorImage().ptr()[i], fastImage.getColorImage().ptr()[i]);
+    }
+    for (size_t i = 0; i < pngImage.getDepthImage().size(); i++) {
+        BOOST_REQUIRE_EQUAL(pngImage.getDepthImage().ptr()[i], fastImage.getDepthImage().ptr()[i]);
+    }
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            BOOST_REQUIRE_EQUAL(pngImages[0].getLabelImage().getLabel(x, y),
+                    fastImages[0].getLabelImage().getLabel(x, y));
+        }
+    }
+
+    fs::remove_all(folder);
+}
 BOOST_AUTO_TEST_SUITE_END()
@@ -3,6 +3,7 @@
 #include <boost/filesystem.hpp>
 #include <boost/test/included/unit_test.hpp>
 #include <math.h>
+#include <set>
 #include <stdlib.h>
 #include <tbb/task_scheduler_init.h>
 #include <vector>
@@ -12,6 +13,7 @@
 #include <vigra/stdimage.hxx>
 #include <vigra/transformimage.hxx>
 
+#include "dataset_index.h"
 #include "export.h"
 #include "image.h"
 #include "predict.h"
@@ -57,6 +59,80 @@ static double predict(RandomForestImage& randomForest) {
     return accuracy;
 }
 
+BOOST_AUTO_TEST_CASE(datasetIndexTest) {
+    const bool useCIELab = true;
+    const bool useDepthFilling = false;
+
+    std::vector<LabeledRGBDImage> images;
+    images.push_back(loadImagePair(getFolderTraining() + "/training1_colors.png", useCIELab, useDepthFilling));
+    images.push_back(loadImagePair(getFolderTraining() + "/training2_colors.png", useCIELab, useDepthFilling));
+
+    tbb::task_scheduler_init init(NUM_THREADS);
+
+    const DatasetIndex index(images);
+    BOOST_CHECK_EQUAL(2u, index.getNumImages());
+
+    std::vector<size_t> imageNrs;
+    imageNrs.push_back(0);
+    imageNrs.push_back(1);
+
+    const auto priorDistribution = index.getClassLabelPriorDistribution(imageNrs);
+    size_t numPixels = 0;
+    for (size_t label = 0; label < priorDistribution.size(); label++) {
+        numPixels += priorDistribution[label];
+    }
+    BOOST_CHECK_EQUAL(numPixels, 2u * images[0].getWidth() * images[0].getHeight());
+
+    const LabelType label = 0;
+    const size_t numValidPixels = index.getNumValidPixels(0, label) + index.getNumValidPixels(1, label);
+    BOOST_REQUIRE_GT(numValidPixels, 100u);
+
+    const int seed = 4711;
+    const auto samples = index.samplePixelsOfClass(imageNrs, label, 100, seed);
+    BOOST_CHECK_EQUAL(100u, samples.size());
+
+    std::set<std::pair<const RGBDImage*, std::pair<int, int> > > distinctSamples;
+    for (const PixelInstance& sample : samples) {
+        BOOST_CHECK_EQUAL(label, sample.getLabel());
+        BOOST_CHECK(sample.getDepth().isValid());
+        distinctSamples.insert(std::make_pair(sample.getRGBDImage(), std::make_pair(sample.getX(), sample.getY())));
+    }
+    BOOST_CHECK_EQUAL(samples.size(), distinctSamples.size());
+
+    // not enough pixels: all pixels are returned
+    BOOST_CHECK_EQUAL(numValidPixels, index.samplePixelsOfClass(imageNrs, label, numValidPixels + 1, seed).size());
+
+    std::vector<bool> ignoredLabels(priorDistribution.size(), false);
+    ignoredLabels[label] = true;
+    for (const PixelInstance& sample : index.samplePixels(imageNrs, ignoredLabels, 1000, seed)) {
+        BOOST_CHECK_NE(label, sample.getLabel());
+        BOOST_CHECK(sample.getDepth().isValid());
+    }
+
+    // without the coordinates, the same pixels are drawn
+    const bool storeCoordinates = false;
+    const DatasetIndex countIndex(images, storeCoordinates);
+    BOOST_CHECK_EQUAL(numValidPixels, countIndex.getNumValidPixels(0, label) + countIndex.getNumValidPixels(1, label));
+
+    const auto countSamples = countIndex.samplePixelsOfClass(imageNrs, label, 100, seed);
+    BOOST_REQUIRE_EQUAL(samples.size(), countSamples.size());
+    for (size_t i = 0; i < samples.size(); i++) {
+        BOOST_CHECK_EQUAL(samples[i].getRGBDImage(), countSamples[i].getRGBDImage());
+        BOOST_CHECK_EQUAL(samples[i].getX(), countSamples[i].getX());
+        BOOST_CHECK_EQUAL(samples[i].getY(), countSamples[i].getY());
+    }
+
+    const auto pixels = index.samplePixels(imageNrs, ignoredLabels, 1000, seed);
+    const auto countPixels = countIndex.samplePixels(imageNrs, ignoredLabels, 1000, seed);
+    BOOST_REQUIRE_EQUAL(pixels.size(), countPixels.size());
+    for (size_t i = 0; i < pixels.size(); i++) {
+        BOOST_CHECK_EQUAL(pixels[i].getRGBDImage(), countPixels[i].getRGBDImage());
+        BOOST_CHECK_EQUAL(pixels[i].getLabel(), countPixels[i].getLabel());
+        BOOST_CHECK_EQUAL(pixels[i].getX(), countPixels[i].getX());
+        BOOST_CHECK_EQUAL(pixels[i].getY(), countPixels[i].getY());
+    }
+}
+
 BOOST_AUTO_TEST_CASE(trainTest) {
     const bool useCIELab = true;
     const bool useDepthFilling = false;
@@ -134,6 +210,546 @@ BOOST_AUTO_TEST_CASE(trainTestGPU) {
     BOOST_CHECK_CLOSE_FRACTION(73, accuracy, 10.0);
 }
 
+BOOST_AUTO_TEST_CASE(mixedImageSizesTest) {
+    const bool useCIELab = true;
+    const bool useDepthFilling = false;
+
+    // the second and third image at half size, as if they were recorded with another camera
+    std::vector<LabeledRGBDImage> trainImages;
+    trainImages.push_back(loadImagePair(getFolderTraining() + "/training1_colors.png", useCIELab, useDepthFilling));
+    trainImages.push_back(loadImagePair(getFolderTraining() + "/training2_colors.png", useCIELab, useDepthFilling,
+            true, 0, 1));
+    trainImages.push_back(loadImagePair(getFolderTraining() + "/training3_colors.png", useCIELab, useDepthFilling,
+            true, 0, 1));
+
+    BOOST_REQUIRE_EQUAL(trainImages[0].getWidth() / 2, trainImages[1].getWidth());
+    BOOST_REQUIRE_EQUAL(trainImages[0].getHeight() / 2, trainImages[1].getHeight());
+
+    tbb::task_scheduler_init init(NUM_THREADS);
+
+    unsigned int samplesPerImage = 500;
+    unsigned int featureCount = 500;
+    unsigned int minSampleCount = 100;
+    int maxDepth = 10;
+    uint16_t boxRadius = 127;
+    uint16_t regionSize = 16;
+    uint16_t thresholds = 50;
+    int maxImages = 10;
+    int imageCacheSize = 10;
+    unsigned int maxSamplesPerBatch = 5000;
+    // compares the CPU evaluation with the GPU batches of one image size
+    AccelerationMode accelerationMode = AccelerationMode::GPU_AND_CPU_COMPARE;
+
+    const int SEED = 4713;
+
+    TrainingConfiguration configuration(SEED, samplesPerImage, featureCount, minSampleCount, maxDepth, boxRadius,
+            regionSize, thresholds, NUM_THREADS, maxImages, imageCacheSize, maxSamplesPerBatch, accelerationMode);
+
+    RandomForestImage randomForest(1, configuration);
+    randomForest.train(trainImages);
+
+    double accuracy = predict(randomForest);
+
+    // reference: the same forest trained on the full-size images
+    std::vector<LabeledRGBDImage> fullSizeImages;
+    fullSizeImages.push_back(trainImages[0]);
+    fullSizeImages.push_back(loadImagePair(getFolderTraining() + "/training2_colors.png", useCIELab, useDepthFilling));
+    fullSizeImages.push_back(loadImagePair(getFolderTraining() + "/training3_colors.png", useCIELab, useDepthFilling));
+
+    RandomForestImage fullSizeForest(1, configuration);
+    fullSizeForest.train(fullSizeImages);
+
+    double fullSizeAccuracy = predict(fullSizeForest);
+    CURFIL_INFO("accuracy with mixed image sizes: " << accuracy << ", with full-size images: " << fullSizeAccuracy);
+
+    // the half-size images lose detail, but the forest must stay close to the reference
+    BOOST_CHECK_GT(accuracy, 0.85 * fullSizeAccuracy);
+
+    // the forest predicts images of both sizes
+    const auto halfSize = loadImagePair(getFolderTraining() + "/testing1_colors.png", useCIELab, useDepthFilling,
+            true, 0, 1);
+    const LabelImage prediction = randomForest.predict(halfSize.getRGBDImage());
+    BOOST_CHECK_EQUAL(halfSize.getWidth(), prediction.getWidth());
+    BOOST_CHECK_EQUAL(halfSize.getHeight(), prediction.getHeight());
+}
+
+// the training images and a small CPU configuration for the tests that modify trained trees
+class TreeFixture {
+public:
+    TreeFixture() :
+            init(NUM_THREADS) {
+        const bool useCIELab = true;
+        const bool useDepthFilling = false;
+        for (const char* name : { "training1", "training2", "training3" }) {
+            images.push_back(loadImagePair(getFolderTraining() + "/" + name + "_colors.png", useCIELab,
+                    useDepthFilling));
+        }
+    }
+
+    TrainingConfiguration getConfiguration(int maxDepth, unsigned int minSampleCount) const {
+        unsigned int samplesPerImage = 500;
+        unsigned int featureCount = 500;
+        uint16_t boxRadius = 127;
+        uint16_t regionSize = 16;
+        uint16_t thresholds = 50;
+        int maxImages = 10;
+        int imageCacheSize = 10;
+        unsigned int maxSamplesPerBatch = 5000;
+        AccelerationMode accelerationMode = AccelerationMode::CPU_ONLY;
+
+        const int SEED = 4711;
+
+        return TrainingConfiguration(SEED, samplesPerImage, featureCount, minSampleCount, maxDepth, boxRadius,
+                regionSize, thresholds, NUM_THREADS, maxImages, imageCacheSize, maxSamplesPerBatch,
+                accelerationMode);
+    }
+
+    tbb::task_scheduler_init init;
+    std::vector<LabeledRGBDImage> images;
+};
+
+// the histogram of every interior node must be the sum of the histograms of its children
+static void checkHistogramSums(const RandomTree<PixelInstance, ImageFeatureFunction>& node) {
+    if (node.isLeaf()) {
+        return;
+    }
+    for (size_t label = 0; label < node.getHistogram().size(); label++) {
+        BOOST_CHECK_EQUAL(node.getHistogram()[label],
+                node.getLeft()->getHistogram()[label] + node.getRight()->getHistogram()[label]);
+    }
+    checkHistogramSums(*node.getLeft());
+    checkHistogramSums(*node.getRight());
+}
+
+BOOST_FIXTURE_TEST_CASE(pruneTest, TreeFixture) {
+    std::vector<LabeledRGBDImage> trainImages(images.begin(), images.begin() + 2);
+    std::vector<LabeledRGBDImage> validationImages(images.begin() + 2, images.end());
+
+    RandomForestImage randomForest(1, getConfiguration(15, 10));
+    randomForest.train(trainImages);
+
+    double accuracy = predict(randomForest);
+
+    const size_t numNodes = randomForest.getTree(0)->getTree()->countNodes();
+
+    const double tolerance = 0.0;
+    randomForest.prune(validationImages, tolerance, 0.0);
+
+    const size_t numNodesPruned = randomForest.getTree(0)->getTree()->countNodes();
+    CURFIL_INFO("nodes before pruning: " << numNodes << ", after pruning: " << numNodesPruned);
+
+    BOOST_CHECK_LT(numNodesPruned, numNodes);
+
+    // node ids must stay contiguous
+    const auto& prunedTree = randomForest.getTree(0)->getTree();
+    BOOST_CHECK_EQUAL(prunedTree->getMaxNodeId() - prunedTree->getTreeId() + 1, numNodesPruned);
+
+    double accuracyPruned = predict(randomForest);
+
+    BOOST_CHECK_CLOSE_FRACTION(accuracy, accuracyPruned, 5.0);
+}
+
+BOOST_FIXTURE_TEST_CASE(warmStartTest, TreeFixture) {
+    const unsigned int minSampleCount = 100;
+
+    RandomForestImage shallowForest(1, getConfiguration(5, minSampleCount));
+    shallowForest.train(images);
+
+    const auto& shallowTree = shallowForest.getTree(0)->getTree();
+    const size_t numNodes = shallowTree->countNodes();
+    const size_t treeDepth = shallowTree->getTreeDepth();
+    BOOST_CHECK_LE(treeDepth, 5u);
+
+    RandomForestImage randomForest(shallowForest.getTrees(), getConfiguration(10, minSampleCount));
+    randomForest.train(images);
+
+    const auto& tree = randomForest.getTree(0)->getTree();
+    CURFIL_INFO("nodes before warm start: " << numNodes << ", after warm start: " << tree->countNodes());
+
+    BOOST_CHECK_GT(tree->countNodes(), numNodes);
+    BOOST_CHECK_GT(tree->getTreeDepth(), treeDepth);
+    BOOST_CHECK_LE(tree->getTreeDepth(), 10u);
+
+    // node ids must stay contiguous
+    BOOST_CHECK_EQUAL(tree->getMaxNodeId() - tree->getTreeId() + 1, tree->countNodes());
+
+    // the old and the new nodes count the same samples
+    checkHistogramSums(*tree);
+
+    double accuracy = predict(randomForest);
+
+    BOOST_CHECK_CLOSE_FRACTION(73, accuracy, 10.0);
+}
+
+BOOST_AUTO_TEST_CASE(refitHistogramsTest) {
+    const bool useCIELab = true;
+    const bool useDepthFilling = false;
+
+    std::vector<std::string> filenames;
+    filenames.push_back(getFolderTraining() + "/training1_colors.png");
+    filenames.push_back(getFolderTraining() + "/training2_colors.png");
+    filenames.push_back(getFolderTraining() + "/training3_colors.png");
+
+    std::vector<LabeledRGBDImage> trainImages;
+    for (const auto& filename : filenames) {
+        trainImages.push_back(loadImagePair(filename, useCIELab, useDepthFilling));
+    }
+
+    tbb::task_scheduler_init init(NUM_THREADS);
+
+    unsigned int samplesPerImage = 500;
+    unsigned int featureCount = 500;
+    unsigned int minSampleCount = 100;
+    int maxDepth = 10;
+    uint16_t boxRadius = 127;
+    uint16_t regionSize = 16;
+    uint16_t thresholds = 50;
+    int maxImages = 10;
+    int imageCacheSize = 10;
+    unsigned int maxSamplesPerBatch = 5000;
+    AccelerationMode accelerationMode = AccelerationMode::GPU_ONLY;
+
+    const int SEED = 4711;
+
+    TrainingConfiguration configuration(SEED, samplesPerImage, featureCount, minSampleCount, maxDepth, boxRadius,
+            regionSize, thresholds, NUM_THREADS, maxImages, imageCacheSize, maxSamplesPerBatch, accelerationMode);
+
+    RandomForestImage randomForest(1, configuration);
+    randomForest.train(trainImages);
+
+    double accuracy = predict(randomForest);
+
+    const auto& tree = randomForest.getTree(0)->getTree();
+    const size_t numNodes = tree->countNodes();
+    const size_t numTrainSamples = tree->getNumTrainSamples();
+
+    const double blend = 0.0;
+    randomForest.refitHistograms(filenames, useCIELab, useDepthFilling, blend, 0.0);
+
+    BOOST_CHECK_EQUAL(numNodes, tree->countNodes());
+
+    size_t numRefitSamples = 0;
+    for (size_t label = 0; label < tree->getHistogram().size(); label++) {
+        numRefitSamples += tree->getHistogram()[label];
+    }
+    BOOST_CHECK_GT(numRefitSamples, numTrainSamples);
+
+    double accuracyRefit = predict(randomForest);
+
+    BOOST_CHECK_CLOSE_FRACTION(accuracy, accuracyRefit, 5.0);
+}
+
+BOOST_AUTO_TEST_CASE(deterministicTrainingTest) {
+    const bool useCIELab = true;
+    const bool useDepthFilling = false;
+
+    std::vector<LabeledRGBDImage> trainImages;
+    trainImages.push_back(loadImagePair(getFolderTraining() + "/training1_colors.png", useCIELab, useDepthFilling));
+    trainImages.push_back(loadImagePair(getFolderTraining() + "/training2_colors.png", useCIELab, useDepthFilling));
+
+    const auto testing = loadImagePair(getFolderTraining() + "/testing1_colors.png", useCIELab, useDepthFilling);
+
+    unsigned int samplesPerImage = 500;
+    unsigned int featureCount = 100;
+    unsigned int minSampleCount = 32;
+    int maxDepth = 8;
+    uint16_t boxRadius = 127;
+    uint16_t regionSize = 16;
+    uint16_t thresholds = 10;
+    int maxImages = 0;
+    int imageCacheSize = 2;
+    unsigned int maxSamplesPerBatch = 5000;
+    AccelerationMode accelerationMode = AccelerationMode::CPU_ONLY;
+
+    const int SEED = 4711;
+    const size_t trees = 2;
+
+    std::vector<LabelImage> predictions;
+    std::vector<size_t> numNodes;
+
+    // the same seed must give the same trees regardless of the number of threads and the training order
+    for (int numThreads = 1; numThreads <= NUM_THREADS; numThreads += NUM_THREADS - 1) {
+        TrainingConfiguration configuration(SEED, samplesPerImage, featureCount, minSampleCount, maxDepth, boxRadius,
+                regionSize, thresholds, numThreads, maxImages, imageCacheSize, maxSamplesPerBatch, accelerationMode);
+
+        RandomForestImage randomForest(trees, configuration);
+        const bool trainTreesSequentially = (numThreads == 1);
+        randomForest.train(trainImages, trainTreesSequentially);
+
+        size_t nodes = 0;
+        for (size_t treeNr = 0; treeNr < trees; treeNr++) {
+            nodes += randomForest.getTree(treeNr)->getTree()->countNodes();
+        }
+        numNodes.push_back(nodes);
+
+        randomForest.normalizeHistograms(0.0);
+        predictions.push_back(randomForest.predict(testing.getRGBDImage(), NULL, false));
+    }
+
+    BOOST_REQUIRE_EQUAL(2lu, predictions.size());
+    BOOST_CHECK_EQUAL(numNodes[0], numNodes[1]);
+    for (int y = 0; y < testing.getHeight(); y++) {
+        for (int x = 0; x < testing.getWidth(); x++) {
+            BOOST_REQUIRE_EQUAL(static_cast<int>(predictions[0].getLabel(x, y)),
+                    static_cast<int>(predictions[1].getLabel(x, y)));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(twoPassLoadingTest) {
+    const bool useCIELab = true;
+    const bool useDepthFilling = false;
+
+    const std::vector<LabeledRGBDImage> images = loadImages(getFolderTraining(), useCIELab, useDepthFilling);
+    std::vector<LabeledRGBDImage> labelImages = loadLabelImages(getFolderTraining(), useDepthFilling);
+    BOOST_REQUIRE_EQUAL(images.size(), labelImages.size());
+    BOOST_REQUIRE_GT(images.size(), 1lu);
+    for (const auto& image : labelImages) {
+        BOOST_CHECK(!image.getRGBDImage().hasColorImage());
+        BOOST_CHECK(image.getRGBDImage().hasIntegratedDepth());
+    }
+
+    const auto testing = loadImagePair(getFolderTraining() + "/testing1_colors.png", useCIELab, useDepthFilling);
+
+    unsigned int samplesPerImage = 500;
+    unsigned int featureCount = 100;
+    unsigned int minSampleCount = 32;
+    int maxDepth = 8;
+    uint16_t boxRadius = 127;
+    uint16_t regionSize = 16;
+    uint16_t thresholds = 10;
+    int maxImages = 1;
+    int imageCacheSize = 2;
+    unsigned int maxSamplesPerBatch = 5000;
+    AccelerationMode accelerationMode = AccelerationMode::CPU_ONLY;
+
+    const int SEED = 4711;
+    const size_t trees = 1;
+
+    TrainingConfiguration configuration(SEED, samplesPerImage, featureCount, minSampleCount, maxDepth, boxRadius,
+            regionSize, thresholds, NUM_THREADS, maxImages, imageCacheSize, maxSamplesPerBatch, accelerationMode,
+            useCIELab, useDepthFilling);
+
+    RandomForestImage randomForest(trees, configuration);
+    randomForest.train(images);
+    randomForest.normalizeHistograms(0.0);
+
+    std::vector<size_t> loadedImageNrs;
+    RandomForestImage twoPassRandomForest(trees, configuration);
+    twoPassRandomForest.train(labelImages, false, 0, [&](const std::vector<size_t>& imageNrs) {
+        loadedImageNrs = imageNrs;
+        loadColorImages(labelImages, imageNrs, useCIELab, useDepthFilling);
+    });
+    twoPassRandomForest.normalizeHistograms(0.0);
+
+    // the tree selected one image. only this image is loaded
+    BOOST_REQUIRE_EQUAL(loadedImageNrs.size(), 1lu);
+    size_t numColorImages = 0;
+    for (const auto& image : labelImages) {
+        numColorImages += image.getRGBDImage().hasColorImage();
+    }
+    BOOST_CHECK_EQUAL(numColorImages, 1lu);
+
+    // both passes draw the same pixels and grow the same tree
+    BOOST_CHECK_EQUAL(randomForest.getTree(0)->getTree()->countNodes(),
+            twoPassRandomForest.getTree(0)->getTree()->countNodes());
+    const LabelImage prediction = randomForest.predict(testing.getRGBDImage(), NULL, false);
+    const LabelImage twoPassPrediction = twoPassRandomForest.predict(testing.getRGBDImage(), NULL, false);
+    for (int y = 0; y < testing.getHeight(); y++) {
+        for (int x = 0; x < testing.getWidth(); x++) {
+            BOOST_REQUIRE_EQUAL(static_cast<int>(prediction.getLabel(x, y)),
+                    static_cast<int>(twoPassPrediction.getLabel(x, y)));
+        }
+    }
+}
+
+static void collectSplitNodes(const boost::shared_ptr<const RandomTree<PixelInstance, ImageFeatureFunction> >& node,
+        std::vector<const RandomTree<PixelInstance, ImageFeatureFunction>*>& splitNodes) {
+    if (node->isLeaf()) {
+        return;
+    }
+    splitNodes.push_back(node.get());
+    collectSplitNodes(node->getLeft(), splitNodes);
+    collectSplitNodes(node->getRight(), splitNodes);
+}
+
+BOOST_AUTO_TEST_CASE(floatResponsesTest) {
+    const bool useCIELab = true;
+    const bool useDepthFilling = false;
+
+    std::vector<LabeledRGBDImage> trainImages;
+    trainImages.push_back(loadImagePair(getFolderTraining() + "/training1_colors.png", useCIELab, useDepthFilling));
+    trainImages.push_back(loadImagePair(getFolderTraining() + "/training2_colors.png", useCIELab, useDepthFilling));
+    trainImages.push_back(loadImagePair(getFolderTraining() + "/training3_colors.png", useCIELab, useDepthFilling));
+
+    const auto testing = loadImagePair(getFolderTraining() + "/testing1_colors.png", useCIELab, useDepthFilling);
+
+    unsigned int samplesPerImage = 500;
+    unsigned int featureCount = 500;
+    unsigned int minSampleCount = 32;
+    int maxDepth = 10;
+    uint16_t boxRadius = 127;
+    uint16_t regionSize = 16;
+    uint16_t thresholds = 20;
+    int maxImages = 0;
+    int imageCacheSize = 3;
+    unsigned int maxSamplesPerBatch = 5000;
+    AccelerationMode accelerationMode = AccelerationMode::CPU_ONLY;
+
+    const int SEED = 4711;
+    const size_t trees = 1;
+
+    std::vector<double> accuracies;
+
+    for (int useFloatResponses = 0; useFloatResponses <= 1; useFloatResponses++) {
+        TrainingConfiguration configuration(SEED, samplesPerImage, featureCount, minSampleCount, maxDepth, boxRadius,
+                regionSize, thresholds, NUM_THREADS, maxImages, imageCacheSize, maxSamplesPerBatch,
+                accelerationMode, useCIELab, useDepthFilling, std::vector<int>(1, 0), "classUniform",
+                std::vector<std::string>(), 16, useFloatResponses);
+
+        RandomForestImage randomForest(trees, configuration);
+        randomForest.train(trainImages);
+
+        // compare the branch decisions of both precisions for every split of the tree and every test pixel
+        std::vector<const RandomTree<PixelInstance, ImageFeatureFunction>*> splitNodes;
+        collectSplitNodes(randomForest.getTree(0)->getTree(), splitNodes);
+
+        size_t agreement = 0;
+        size_t numSplits = 0;
+        for (int y = 0; y < testing.getHeight(); y++) {
+            for (int x = 0; x < testing.getWidth(); x++) {
+                const PixelInstance pixel(&testing.getRGBDImage(), 0, x, y);
+                if (!pixel.getDepth().isValid()) {
+                    continue;
+                }
+                for (const auto node : splitNodes) {
+                    const SplitFunction<PixelInstance, ImageFeatureFunction>& split = node->getSplit();
+                    const double responseDouble = split.getFeature().calculateFeatureResponse<double>(pixel);
+                    const float responseFloat = split.getFeature().calculateFeatureResponse<float>(pixel);
+                    // NaN responses go right in both precisions
+                    if ((responseDouble <= split.getThreshold()) == (responseFloat <= split.getThreshold())) {
+                        agreement++;
+                    }
+                    numSplits++;
+                }
+            }
+        }
+        CURFIL_INFO("float responses: " << useFloatResponses << ", split agreement: " << agreement << "/"
+                << numSplits << " (" << 100.0 * agreement / numSplits << "%)");
+
+        BOOST_REQUIRE_GT(numSplits, 0lu);
+        BOOST_CHECK_GE(static_cast<double>(agreement) / numSplits, 0.995);
+
+        accuracies.push_back(predict(randomForest));
+    }
+
+    // the forests differ in a few splits only
+    BOOST_CHECK_CLOSE_FRACTION(accuracies[0], accuracies[1], 0.05);
+}
+
+BOOST_AUTO_TEST_CASE(featureCostTest) {
+    const bool useCIELab = true;
+    const bool useDepthFilling = false;
+
+    std::vector<LabeledRGBDImage> trainImages;
+    trainImages.push_back(loadImagePair(getFolderTraining() + "/training1_colors.png", useCIELab, useDepthFilling));
+    trainImages.push_back(loadImagePair(getFolderTraining() + "/training2_colors.png", useCIELab, useDepthFilling));
+    trainImages.push_back(loadImagePair(getFolderTraining() + "/training3_colors.png", useCIELab, useDepthFilling));
+
+    unsigned int samplesPerImage = 500;
+    unsigned int featureCount = 500;
+    unsigned int minSampleCount = 32;
+    int maxDepth = 10;
+    uint16_t boxRadius = 127;
+    uint16_t regionSize = 16;
+    uint16_t thresholds = 20;
+    int maxImages = 0;
+    int imageCacheSize = 3;
+    unsigned int maxSamplesPerBatch = 5000;
+    AccelerationMode accelerationMode = AccelerationMode::CPU_ONLY;
+
+    const int SEED = 4711;
+    const size_t trees = 1;
+
+    std::vector<std::map<std::string, size_t> > featureCounts;
+    std::vector<double> accuracies;
+
+    for (float depthFeatureCost : { 0.0f, 1.0f }) {
+        TrainingConfiguration configuration(SEED, samplesPerImage, featureCount, minSampleCount, maxDepth, boxRadius,
+                regionSize, thresholds, NUM_THREADS, maxImages, imageCacheSize, maxSamplesPerBatch,
+                accelerationMode, useCIELab, useDepthFilling, std::vector<int>(1, 0), "classUniform",
+                std::vector<std::string>(), 16, false, false, 0.0f, 0, depthFeatureCost);
+
+        RandomForestImage randomForest(trees, configuration);
+        randomForest.train(trainImages);
+
+        featureCounts.push_back(randomForest.countFeatures());
+        accuracies.push_back(predict(randomForest));
+
+        CURFIL_INFO("depth feature cost: " << depthFeatureCost << ", depth features: "
+                << featureCounts.back()["depth"] << ", color features: " << featureCounts.back()["color"]
+                << ", accuracy: " << accuracies.back());
+    }
+
+    // expensive depth features are only selected if they are much better than the color features
+    BOOST_CHECK_LT(featureCounts[1]["depth"], featureCounts[0]["depth"]);
+    BOOST_CHECK_GT(accuracies[1], 0.5 * accuracies[0]);
+}
+
+BOOST_AUTO_TEST_CASE(outOfBagTest) {
+    const bool useCIELab = true;
+    const bool useDepthFilling = false;
+
+    std::vector<LabeledRGBDImage> trainImages;
+    trainImages.push_back(loadImagePair(getFolderTraining() + "/training1_colors.png", useCIELab, useDepthFilling));
+    trainImages.push_back(loadImagePair(getFolderTraining() + "/training2_colors.png", useCIELab, useDepthFilling));
+    trainImages.push_back(loadImagePair(getFolderTraining() + "/training3_colors.png", useCIELab, useDepthFilling));
+
+    unsigned int samplesPerImage = 500;
+    unsigned int featureCount = 500;
+    unsigned int minSampleCount = 32;
+    int maxDepth = 10;
+    uint16_t boxRadius = 127;
+    uint16_t regionSize = 16;
+    uint16_t thresholds = 20;
+    int maxImages = 2;
+    int imageCacheSize = 2;
+    unsigned int maxSamplesPerBatch = 5000;
+    AccelerationMode accelerationMode = AccelerationMode::CPU_ONLY;
+
+    const int SEED = 4711;
+    const size_t trees = 3;
+
+    TrainingConfiguration configuration(SEED, samplesPerImage, featureCount, minSampleCount, maxDepth, boxRadius,
+            regionSize, thresholds, NUM_THREADS, maxImages, imageCacheSize, maxSamplesPerBatch,
+            accelerationMode, useCIELab, useDepthFilling);
+
+    RandomForestImage randomForest(trees, configuration);
+    ConfusionMatrix confusionMatrix;
+    randomForest.train(trainImages, false, &confusionMatrix);
+
+    BOOST_REQUIRE_GT(confusionMatrix.getNumClasses(), 0u);
+
+    double numPixels = 0;
+    for (unsigned int label = 0; label < confusionMatrix.getNumClasses(); label++) {
+        for (unsigned int prediction = 0; prediction < confusionMatrix.getNumClasses(); prediction++) {
+            numPixels += confusionMatrix(label, prediction);
+        }
+    }
+    // the trees sample few pixels, almost all pixels are out-of-bag for every tree
+    BOOST_CHECK_GT(numPixels, 0.9 * samplesPerImage * trainImages.size());
+    BOOST_CHECK_LE(numPixels, samplesPerImage * trainImages.size());
+
+    const double outOfBagAccuracy = 100 * confusionMatrix.pixelAccuracy();
+    const double testAccuracy = predict(randomForest);
+
+    CURFIL_INFO("out-of-bag accuracy: " << outOfBagAccuracy << ", test accuracy: " << testAccuracy);
+
+    // a rough estimate of the generalization of the forest
+    BOOST_CHECK_GT(outOfBagAccuracy, 0.5 * testAccuracy);
+    BOOST_CHECK_LT(outOfBagAccuracy, 100.0);
+}
+
 BOOST_AUTO_TEST_CASE(trainTestEnsemble) {
 
     const bool useCIELab = true;
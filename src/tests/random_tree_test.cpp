@@ -10,6 +10,7 @@
 
 #include "random_tree.h"
 #include "test_common.h"
+#include "utils.h"
 
 using namespace curfil;
 using namespace cuv;
@@ -157,27 +158,97 @@ BOOST_AUTO_TEST_CASE(testReservoirSampler) {
     double stddev = std::sqrt(static_cast<double>(boost::accumulators::variance(acc)));
 
     /*
-     * values are empirically determined with python and numpy
-     *
-     * >>> import random, numpy as np
-     * >>> a = np.arange(100000)
-     * >>> random.shuffle(a)
-     * >>> b = a[:10000]
-     * >>> b.mean()
-     * 50271.870999999999
-     *
-     * >>> np.sqrt(b.var())
-     * 28804.962206705768
-     *
-     * >>> b.min()
-     * 12.0
-     *
-     * >>> b.max()
-     * 99996.0
+     * a uniform sample without replacement of 1000 values from [0, 100000) has
+     * mean 49999.5 with a standard error of 100000 / sqrt(12 * 1000) = 913 and
+     * standard deviation 100000 / sqrt(12) = 28868 with a standard error of about 410.
+     * the tolerances are a bit larger than two standard errors.
+     * a biased draw, such as a modulo of a larger range, shifts the mean towards the end of the stream.
      */
     BOOST_REQUIRE_LT(min, 0.01 * MAX);
     BOOST_REQUIRE_GT(max, 0.99 * MAX);
-    BOOST_REQUIRE_CLOSE(mean, 50000.0, 0.05);
-    BOOST_REQUIRE_CLOSE(stddev, 28000.0, 2.0);
+    BOOST_REQUIRE_CLOSE(mean, 50000.0, 4.0);
+    BOOST_REQUIRE_CLOSE(stddev, 28868.0, 3.0);
+}
+
+BOOST_AUTO_TEST_CASE(testSamplerGetNextBelow) {
+
+    RandomSource randomSource(4711);
+    Sampler sampler = randomSource.uniformSampler(0, 1000000);
+
+    const size_t numDraws = 300000;
+    std::vector<size_t> counts(3, 0);
+    for (size_t i = 0; i < numDraws; i++) {
+        size_t value = sampler.getNextBelow(3);
+        BOOST_REQUIRE_LT(value, 3lu);
+        counts[value]++;
+    }
+    for (size_t i = 0; i < counts.size(); i++) {
+        BOOST_CHECK_CLOSE(static_cast<double>(counts[i]), numDraws / 3.0, 1.0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(testRandomSourceSplit) {
+
+    RandomSource randomSource(4711);
+    RandomSource otherRandomSource(4711);
+
+    Sampler sampler = otherRandomSource.uniformSampler(100);
+    BOOST_CHECK_EQUAL(sampler.getNext(), randomSource.uniformSampler(100).getNext());
+
+    // drawing more samplers does not change the split streams
+    otherRandomSource.uniformSampler(100).getNext();
+
+    Sampler a = randomSource.split(1).uniformSampler(-1000, 1000);
+    Sampler b = otherRandomSource.split(1).uniformSampler(-1000, 1000);
+    Sampler c = randomSource.split(2).uniformSampler(-1000, 1000);
+
+    size_t numDifferent = 0;
+    for (int i = 0; i < 1000; i++) {
+        const int value = a.getNext();
+        BOOST_REQUIRE_GE(value, -1000);
+        BOOST_REQUIRE_LE(value, 1000);
+        BOOST_REQUIRE_EQUAL(value, b.getNext());
+        if (value != c.getNext()) {
+            numDifferent++;
+        }
+    }
+    BOOST_CHECK_GT(numDifferent, 900lu);
+
+    Sampler full = randomSource.uniformSampler(std::numeric_limits<int>::min(), std::numeric_limits<int>::max());
+    Sampler single = randomSource.uniformSampler(42, 42);
+    for (int i = 0; i < 1000; i++) {
+        full.getNext();
+        BOOST_REQUIRE_EQUAL(42, single.getNext());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(testRadixSort) {
+
+    const size_t numElements = 100000;
+
+    RandomSource randomSource(4711);
+    Sampler sampler = randomSource.uniformSampler(0, 1 << 20);
+
+    std::vector<std::pair<uint64_t, uint32_t> > expected(numElements);
+    std::vector<uint64_t> keys(numElements);
+    std::vector<uint32_t> values(numElements);
+    for (size_t i = 0; i < numElements; i++) {
+        // few distinct keys with bits in the high bytes to check stability and skipped passes
+        keys[i] = (static_cast<uint64_t>(sampler.getNext() % 100) << 40) | (sampler.getNext() % 3);
+        values[i] = i;
+        expected[i] = std::make_pair(keys[i], values[i]);
+    }
+
+    std::stable_sort(expected.begin(), expected.end(),
+            [](const std::pair<uint64_t, uint32_t>& a, const std::pair<uint64_t, uint32_t>& b) {
+                return (a.first < b.first);
+            });
+
+    utils::radixSort(keys, values);
+
+    for (size_t i = 0; i < numElements; i++) {
+        BOOST_REQUIRE_EQUAL(keys[i], expected[i].first);
+        BOOST_REQUIRE_EQUAL(values[i], expected[i].second);
+    }
 }
 BOOST_AUTO_TEST_SUITE_END()